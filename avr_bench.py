@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+
+AVR_BENCH_ENV = "uno-cycles"
+FIRMWARE = os.path.join(".pio", "build", AVR_BENCH_ENV, "firmware.elf")
+HARNESS_SOURCE = "src/avr_bench/simavr_harness.c"
+HARNESS = os.path.join(".pio", "build", "simavr_harness")
+# Where simavr's headers land when pkg-config doesn't know about it
+SIMAVR_INCLUDES = ["/usr/include/simavr", "/usr/local/include/simavr"]
+MCU_FREQUENCY = 16000000
+# Saved with --save where PlatformIO and libsimavr are installed; mcu_sim.py --check compares against it
+BASELINE = "avr_baseline.json"
+
+# --compare fails a call whose cycles grew by more than this fraction, or whose stack grew at all
+CYCLE_TOLERANCE = 0.02
+
+
+def build_firmware(defines=()):
+    """Build the uno-cycles env, adding -D flags (e.g. APDS9930_LEAN) through PLATFORMIO_BUILD_FLAGS."""
+    if not shutil.which("pio"):
+        sys.exit("avr_bench.py needs PlatformIO to build the ATmega328P firmware")
+    env = dict(os.environ, PLATFORMIO_BUILD_FLAGS=" ".join(f"-D{define}" for define in defines))
+    subprocess.run(["pio", "run", "-e", AVR_BENCH_ENV], check=True, env=env, stdout=subprocess.DEVNULL)
+    return FIRMWARE
+
+
+def simavr_flags():
+    """Compiler and linker flags for libsimavr, or None if it isn't installed."""
+    try:
+        return subprocess.run(["pkg-config", "--cflags", "--libs", "simavr"], check=True,
+                              capture_output=True, text=True).stdout.split()
+    except (OSError, subprocess.CalledProcessError):
+        pass
+    includes = [f"-I{path}" for path in SIMAVR_INCLUDES if os.path.isdir(path)]
+    return includes + ["-lsimavr"] if includes else None
+
+
+def available():
+    """True if the bench can run here: PlatformIO for the firmware and libsimavr for the harness."""
+    return bool(shutil.which("pio")) and simavr_flags() is not None
+
+
+def build_harness(program=HARNESS):
+    """Compile the simavr harness with the host C compiler against libsimavr."""
+    flags = simavr_flags() or ["-lsimavr"]
+    os.makedirs(os.path.dirname(program), exist_ok=True)
+    subprocess.run([os.environ.get("CC", "cc"), "-O2", "-Isrc/avr_bench", HARNESS_SOURCE, "-o", program,
+                    *flags, "-lelf"], check=True)
+    return program
+
+
+def run_bench(firmware, harness=HARNESS):
+    """Run the firmware under simavr.
+
+    Returns:
+        dict: call name -> (cycles, stack bytes, succeeded), with the marker
+        overhead (the `nothing` call) taken off the cycles
+    """
+    output = subprocess.run([harness, firmware], check=True, capture_output=True, text=True).stdout
+    results = {}
+    for line in output.splitlines():
+        name, cycles, stack, ok = line.split()
+        results[name] = (int(cycles), int(stack), ok == "1")
+    overhead, _, _ = results.pop("nothing")
+    return {name: (cycles - overhead, stack, ok) for name, (cycles, stack, ok) in results.items()}
+
+
+def regressions(results, baseline, tolerance=CYCLE_TOLERANCE):
+    """Calls that got slower than the tolerance allows, or deeper on the stack, than in baseline.
+
+    Returns:
+        list: Message per regression
+    """
+    found = []
+    for name, (cycles, stack, _) in results.items():
+        if name not in baseline:
+            continue
+        base_cycles, base_stack = baseline[name]["cycles"], baseline[name]["stack"]
+        if cycles > base_cycles * (1 + tolerance):
+            found.append(f"{name}: {base_cycles} -> {cycles} cycles")
+        if stack > base_stack:
+            found.append(f"{name}: {base_stack} -> {stack} stack bytes")
+    return found
+
+
+def compare(baseline=BASELINE, defines=()):
+    """Build and run the bench, then check it against a saved baseline.
+
+    Returns:
+        list: Message per regression or failed call
+    """
+    results = run_bench(build_firmware(defines), build_harness())
+    with open(baseline) as f:
+        found = regressions(results, json.load(f))
+    return found + [f"{name}: failed" for name, (_, _, ok) in results.items() if not ok]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Cycles and stack per APDS9930 driver call on a simulated "
+                                                 "ATmega328P (simavr)")
+    parser.add_argument("--define", action="append", default=[],
+                        help="Extra driver define, e.g. APDS9930_LEAN or APDS9930_HEADER_ONLY; repeatable")
+    parser.add_argument("--save", metavar="FILE", help="Write the results as a JSON baseline")
+    parser.add_argument("--compare", metavar="FILE",
+                        help=f"Fail on calls more than {CYCLE_TOLERANCE:.0%} slower, or deeper, than a baseline")
+    args = parser.parse_args()
+
+    results = run_bench(build_firmware(args.define), build_harness())
+    print(f"ATmega328P @ {MCU_FREQUENCY // 1000000} MHz, APDS9930 driver"
+          f"{' with ' + ', '.join(args.define) if args.define else ''}, I2C time included")
+    for name, (cycles, stack, ok) in results.items():
+        print(f"{name:<30} {cycles:>8} cycles  {cycles * 1e6 / MCU_FREQUENCY:>8.1f} us  "
+              f"stack {stack:>4} B{'' if ok else '  FAILED'}")
+    failed = [name for name, (_, _, ok) in results.items() if not ok]
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump({name: {"cycles": cycles, "stack": stack} for name, (cycles, stack, _) in results.items()},
+                      f, indent=2)
+    found = []
+    if args.compare:
+        with open(args.compare) as f:
+            found = regressions(results, json.load(f))
+        for message in found:
+            print(f"regression: {message}")
+    if failed or found:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
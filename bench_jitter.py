@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+
+import argparse
+import multiprocessing
+import time
+
+from realtime import DeadlineTimer, configure_thread, lock_memory
+
+
+def _burn():
+    while True:
+        pass
+
+
+def run(period, seconds, role=None, mlock=False):
+    """Tick a DeadlineTimer and measure wake-up latency and period.
+
+    Returns:
+        tuple: (list of wake latencies in ns, list of periods in ns, overruns)
+    """
+    if mlock:
+        lock_memory()
+    if role:
+        configure_thread(role)
+
+    timer = DeadlineTimer(period)
+    count = int(seconds / period)
+    latencies = [0] * count
+    periods = [0] * count
+    last = None
+    for i in range(count):
+        deadline = timer.wait()
+        now = time.monotonic_ns()
+        latencies[i] = now - deadline
+        if last is not None:
+            periods[i] = now - last
+        last = now
+    return latencies, periods[1:], timer.overruns
+
+
+def print_histogram(periods, period_ns, bucket_us):
+    buckets = {}
+    for p in periods:
+        key = int((p - period_ns) / 1000 // bucket_us)
+        buckets[key] = buckets.get(key, 0) + 1
+    peak = max(buckets.values())
+    print(f"\nPeriod histogram (nominal {period_ns / 1e6:.2f} ms, {bucket_us} us buckets):")
+    for key in sorted(buckets):
+        lo = key * bucket_us
+        bar = "#" * max(1, int(50 * buckets[key] / peak))
+        print(f"  {lo:>+7} .. {lo + bucket_us:>+7} us  {buckets[key]:>7}  {bar}")
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, len(values) * p // 100)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure sweep timer jitter")
+    parser.add_argument("--period-ms", type=float, default=10.0, help="Timer period in ms")
+    parser.add_argument("--seconds", type=float, default=10.0, help="How long to run")
+    parser.add_argument("--role", choices=["sensor", "audio", "background"],
+                        help="Apply the realtime.THREAD_CONFIG settings for this role")
+    parser.add_argument("--mlock", action="store_true", help="Lock memory with mlockall first")
+    parser.add_argument("--load", type=int, default=0, help="Busy-loop processes to run alongside")
+    parser.add_argument("--bucket-us", type=int, default=50, help="Histogram bucket width in us")
+    args = parser.parse_args()
+
+    burners = [multiprocessing.Process(target=_burn, daemon=True) for _ in range(args.load)]
+    for p in burners:
+        p.start()
+    try:
+        period = args.period_ms / 1000.0
+        latencies, periods, overruns = run(period, args.seconds, args.role, args.mlock)
+    finally:
+        for p in burners:
+            p.terminate()
+
+    print(f"{len(latencies)} ticks, {overruns} overruns")
+    print(f"Wake latency us: p50 {percentile(latencies, 50) / 1000:.1f}  p99 {percentile(latencies, 99) / 1000:.1f}"
+          f"  max {max(latencies) / 1000:.1f}")
+    jitter = [abs(p - int(period * 1e9)) for p in periods]
+    print(f"Period jitter us: p50 {percentile(jitter, 50) / 1000:.1f}  p99 {percentile(jitter, 99) / 1000:.1f}"
+          f"  max {max(jitter) / 1000:.1f}")
+    print_histogram(periods, int(period * 1e9), args.bucket_us)
+
+
+if __name__ == "__main__":
+    main()
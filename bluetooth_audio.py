@@ -3,8 +3,11 @@
 import subprocess
 import time
 import os
+import queue
 import re
+import threading
 import pygame
+from realtime import configure_thread
 
 os.environ['SDL_AUDIODRIVER'] = 'alsa'
 class BluetoothAudio:
@@ -14,7 +17,11 @@ class BluetoothAudio:
         self.connected = False
         # Initialize pygame and its mixer with multiple channels
         pygame.init()
-        pygame.mixer.init(frequency=44100, size=-16, channels=2, buffer=512)
+        # Open the mixer from a thread set up for the audio core; SDL's audio
+        # thread inherits that thread's affinity and priority
+        mixer_thread = threading.Thread(target=self._init_mixer, name="audio-init")
+        mixer_thread.start()
+        mixer_thread.join()
         # Reserve 14 channels (one for each stair)
         pygame.mixer.set_num_channels(14)
         # Store sound objects for each stair
@@ -26,6 +33,10 @@ class BluetoothAudio:
                 self.sounds[i] = pygame.mixer.Sound(sound_file)
                 print(f"Loaded sound for stair {i}")
         
+    def _init_mixer(self):
+        configure_thread("audio")
+        pygame.mixer.init(frequency=44100, size=-16, channels=2, buffer=512)
+
     def set_sound_file(self, file_path):
         """Set the sound file to be played when triggered"""
         if not os.path.exists(file_path):
@@ -130,6 +141,72 @@ class BluetoothAudio:
             self.connected = False
             return False
 
+class AudioWorker:
+    """Plays sounds on the audio thread, so the event loop never waits on the mixer or a Bluetooth reconnect.
+
+    play_sound() queues the request and returns at once. Each result comes
+    back to the loop thread through EventLoop.call_soon_threadsafe(), which
+    wakes it on its eventfd. Requests in flight are counted on the loop
+    thread only, so no lock is needed. While max_pending are outstanding
+    (usually a reconnect in progress), new requests are dropped rather than
+    played seconds late.
+    """
+
+    _STOP = object()
+
+    def __init__(self, audio, loop, max_pending=4):
+        """
+        Args:
+            audio: BluetoothAudio (needs play_sound)
+            loop: EventLoop to report results on
+            max_pending: Requests queued or playing before new ones are dropped
+        """
+        self.audio = audio
+        self.loop = loop
+        self.max_pending = max_pending
+        self.pending = 0
+        self.played = 0
+        self.failed = 0
+        self.dropped = 0
+        self._requests = queue.SimpleQueue()
+        self._thread = threading.Thread(target=self._run, name="audio", daemon=True)
+        self._thread.start()
+
+    def play_sound(self, stair_num=None):
+        """Queue a sound. Call from the loop thread.
+
+        Returns:
+            bool: False if the request was dropped
+        """
+        if self.pending >= self.max_pending:
+            self.dropped += 1
+            return False
+        self.pending += 1
+        self._requests.put(stair_num)
+        return True
+
+    def close(self):
+        """Stop the audio thread once it has played what is queued. Call before closing the loop."""
+        self._requests.put(self._STOP)
+        self._thread.join()
+
+    def _run(self):
+        configure_thread("audio")
+        while True:
+            stair_num = self._requests.get()
+            if stair_num is self._STOP:
+                return
+            ok = self.audio.play_sound(stair_num)
+            self.loop.call_soon_threadsafe(self._done, ok)
+
+    def _done(self, ok):
+        self.pending -= 1
+        if ok:
+            self.played += 1
+        else:
+            self.failed += 1
+
+
 def setup_bluetooth_audio(device_name="JBL GO 2+"):
     """
     Set up audio playback with automatic Bluetooth connection.
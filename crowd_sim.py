@@ -0,0 +1,334 @@
+#!/usr/bin/env python3
+
+import argparse
+import errno
+import random
+import time
+
+from replay import NullStrip, StageStats
+from sim_apds9930 import (SimulatedAPDS9930, SimulatedTCA9548A, SimulatedI2CBus, APDS9930_I2C_ADDR,
+                          AUTO_INCREMENT, APDS9930_ENABLE, APDS9930_ID, APDS9930_PDATAL, APDS9930_PPULSE,
+                          APDS9930_CONTROL, APDS9930_PIHTL, APDS9930_PERS, PON, PEN, WEN,
+                          APDS9930_ID_VALUE, NO_TARGET, INTEGRATION_STEP, PULSE_TIME,
+                          proximity_scale, proximity_to_distance)
+from stair_pipeline import StairPipeline
+from phasing import PhasedSweep, measure_interference, plan_groups
+
+SENSORS_PER_MUX = 8
+MUXES_PER_BUS = 8
+LEDS_PER_STAIR = 114
+
+# Crosstalk model: counts a stair's LED adds to its neighbours at the driver
+# defaults when their pulses coincide, by distance in stairs
+CROSSTALK_FALLOFF = {1: 1.0, 2: 0.3}
+OSC_TOLERANCE = 0.01        # Spread of the parts' internal oscillators, so free-running phases drift
+
+
+class Person:
+    """Someone walking the staircase at a constant pace."""
+
+    def __init__(self, start, going_up, stairs_per_second, foot_distance):
+        self.start = start
+        self.going_up = going_up
+        self.stairs_per_second = stairs_per_second
+        self.foot_distance = foot_distance
+
+    def stair_at(self, t, num_stairs):
+        """Index of the stair this person has a foot planted on at time t, or None."""
+        position = (t - self.start) * self.stairs_per_second
+        if position < 0 or position >= num_stairs:
+            return None
+        index = int(position)
+        if position - index > 0.7:   # Foot in the air between stairs
+            return None
+        return index if self.going_up else num_stairs - 1 - index
+
+    def done(self, t, num_stairs):
+        return (t - self.start) * self.stairs_per_second >= num_stairs
+
+
+class Crowd:
+    """Poisson arrivals of people with realistic stair-climbing speeds.
+
+    Going up averages about 1.8 stairs/s and going down about 2.2 stairs/s,
+    with the spread you see between a stroll and someone running late.
+    """
+
+    def __init__(self, num_stairs, people_per_minute, rng):
+        self.num_stairs = num_stairs
+        self.rate = people_per_minute / 60.0
+        self.rng = rng
+        self.people = []
+        self.next_arrival = rng.expovariate(self.rate) if self.rate > 0 else float("inf")
+        self.arrived = 0
+
+    def update(self, t):
+        while t >= self.next_arrival:
+            going_up = self.rng.random() < 0.5
+            speed = self.rng.gauss(1.8 if going_up else 2.2, 0.4)
+            self.people.append(Person(self.next_arrival, going_up, max(0.8, min(3.5, speed)),
+                                      self.rng.uniform(120.0, 450.0)))
+            self.arrived += 1
+            self.next_arrival += self.rng.expovariate(self.rate)
+        self.people = [p for p in self.people if not p.done(t, self.num_stairs)]
+
+    def distances(self, t):
+        """Return {stair_index: nearest foot distance in mm} for occupied stairs."""
+        occupied = {}
+        for person in self.people:
+            stair = person.stair_at(t, self.num_stairs)
+            if stair is not None:
+                occupied[stair] = min(occupied.get(stair, person.foot_distance), person.foot_distance)
+        return occupied
+
+
+class SimulatedArray:
+    """N simulated APDS-9930s behind TCA9548A muxes, 64 sensors per bus."""
+
+    def __init__(self, num_stairs, clock_hz=400000, seed=1, crosstalk=0.0):
+        self.rng = random.Random(seed)
+        self.sensors = []
+        self.routes = []    # sensor index -> (bus index, mux address, mux channel)
+        self.buses = []
+        for index in range(num_stairs):
+            bus_index, slot = divmod(index, SENSORS_PER_MUX * MUXES_PER_BUS)
+            if bus_index == len(self.buses):
+                self.buses.append(SimulatedI2CBus(clock_hz))
+            mux_address = 0x70 + slot // SENSORS_PER_MUX
+            bus = self.buses[bus_index]
+            if mux_address not in bus.devices:
+                bus.attach(mux_address, SimulatedTCA9548A())
+            osc = 1.0 + self.rng.gauss(0.0, OSC_TOLERANCE) if crosstalk else 1.0
+            sensor = SimulatedAPDS9930(self.rng, osc=osc)
+            bus.devices[mux_address].attach(slot % SENSORS_PER_MUX, APDS9930_I2C_ADDR, sensor)
+            self.sensors.append(sensor)
+            self.routes.append((bus_index, mux_address, slot % SENSORS_PER_MUX))
+        if crosstalk:
+            for index, sensor in enumerate(self.sensors):
+                for reach, falloff in CROSSTALK_FALLOFF.items():
+                    for other in (index - reach, index + reach):
+                        if 0 <= other < num_stairs:
+                            sensor.neighbours.append((self.sensors[other], crosstalk * falloff))
+
+    def neighbours(self, reach=max(CROSSTALK_FALLOFF)):
+        """Channels within `reach` stairs of each channel: the candidates to measure."""
+        count = len(self.sensors)
+        return {index: [other for other in range(index - reach, index + reach + 1)
+                        if other != index and 0 <= other < count]
+                for index in range(count)}
+
+
+class SimulatedMultiplexer:
+    """Host driver for SimulatedArray with the same interface as VL53L0XMultiplexer.
+
+    Bus time is charged to a per-bus clock so the simulator knows when each
+    read actually happens and how long a sweep occupies the bus.
+    """
+
+    def __init__(self, array, ppulse=8):
+        self.array = array
+        self.ppulse = ppulse
+        self.scale = proximity_scale(ppulse, 0, 3)
+        self.selected = {}  # (bus index, mux address) -> selected channel mask
+        self.initialized = [False] * len(array.sensors)
+        self.waited = 0.0   # Time spent waiting on conversions, on top of bus time
+        self.conversion_time = INTEGRATION_STEP + PULSE_TIME * ppulse  # PTIME = 0xFF, no wait or ALS
+
+    def _select(self, global_channel):
+        bus_index, mux_address, channel = self.array.routes[global_channel]
+        return self._select_mask(bus_index, mux_address, 1 << channel)
+
+    def _select_mask(self, bus_index, mux_address, mask):
+        bus = self.array.buses[bus_index]
+        for (other_bus, other_mux), other_mask in self.selected.items():
+            if other_bus == bus_index and other_mux != mux_address and other_mask:
+                bus.write(other_mux, bytes([0]))
+                self.selected[(other_bus, other_mux)] = 0
+        if self.selected.get((bus_index, mux_address)) != mask:
+            bus.write(mux_address, bytes([mask]))
+            self.selected[(bus_index, mux_address)] = mask
+        return bus
+
+    def wait(self, seconds):
+        self.waited += seconds
+
+    def set_enable(self, channels, value, now):
+        """Write ENABLE to several sensors: one broadcast write per mux."""
+        masks = {}
+        for channel in channels:
+            bus_index, mux_address, local = self.array.routes[channel]
+            masks[(bus_index, mux_address)] = masks.get((bus_index, mux_address), 0) | 1 << local
+        for (bus_index, mux_address), mask in masks.items():
+            bus = self._select_mask(bus_index, mux_address, mask)
+            for channel in channels:
+                if self.array.routes[channel][:2] == (bus_index, mux_address):
+                    self.array.sensors[channel].advance(now + bus.busy_time + self.waited)
+            bus.write(APDS9930_I2C_ADDR, bytes([AUTO_INCREMENT | APDS9930_ENABLE, value]))
+
+    def read_pdata(self, global_channel, now):
+        """Read raw PDATA, or None on error."""
+        bus = self._select(global_channel)
+        self.array.sensors[global_channel].advance(now + bus.busy_time + self.waited)
+        try:
+            data = bus.write_read(APDS9930_I2C_ADDR, bytes([AUTO_INCREMENT | APDS9930_PDATAL]), 2)
+        except OSError:
+            return None
+        return data[0] | (data[1] << 8)
+
+    def init_sensor(self, global_channel, enable=PON | PEN | WEN):
+        try:
+            bus = self._select(global_channel)
+            ident = bus.write_read(APDS9930_I2C_ADDR, bytes([AUTO_INCREMENT | APDS9930_ID]), 1)[0]
+            if ident != APDS9930_ID_VALUE:
+                return False
+            bus.write(APDS9930_I2C_ADDR, bytes([AUTO_INCREMENT | APDS9930_PPULSE, self.ppulse]))
+            bus.write(APDS9930_I2C_ADDR, bytes([AUTO_INCREMENT | APDS9930_CONTROL, 0x2C]))
+            bus.write(APDS9930_I2C_ADDR, bytes([AUTO_INCREMENT | APDS9930_PIHTL, 50, 0]))
+            bus.write(APDS9930_I2C_ADDR, bytes([AUTO_INCREMENT | APDS9930_PERS, 0x22]))
+            self.array.sensors[global_channel].advance(bus.busy_time + self.waited)
+            bus.write(APDS9930_I2C_ADDR, bytes([AUTO_INCREMENT | APDS9930_ENABLE, enable]))
+        except OSError as e:
+            if e.errno != errno.EREMOTEIO:
+                raise
+            return False
+        self.initialized[global_channel] = True
+        return True
+
+    def read_range(self, global_channel, now):
+        """Read PDATA and convert it to a distance in mm, or None on error."""
+        if not self.initialized[global_channel]:
+            return None
+        pdata = self.read_pdata(global_channel, now)
+        return None if pdata is None else proximity_to_distance(pdata, self.scale)
+
+
+def run(num_stairs, people_per_minute, duration, sweep_period, clock_hz, seed=1,
+        crosstalk=0.0, phased=False, pulses=8):
+    """Simulate `duration` seconds of crowd traffic on `num_stairs` stairs.
+
+    Args:
+        crosstalk: Counts a sensor's LED adds to the next stair when pulses coincide
+        phased: Measure interference first and sweep in non-interfering groups
+        pulses: Proximity LED pulses per conversion (PPULSE)
+
+    Returns:
+        dict: Simulation report
+    """
+    rng = random.Random(seed)
+    array = SimulatedArray(num_stairs, clock_hz, seed, crosstalk)
+    driver = SimulatedMultiplexer(array, pulses)
+    crowd = Crowd(num_stairs, people_per_minute, rng)
+    led_counts = {stair: LEDS_PER_STAIR for stair in range(1, num_stairs + 1)}
+    mapping = {channel: channel + 1 for channel in range(num_stairs)}
+    strip = NullStrip(LEDS_PER_STAIR * num_stairs)
+    stats = StageStats()
+    pipeline = StairPipeline(strip, fade_in_delay=0, fade_out_delay=0, stats=stats,
+                             stair_mapping=mapping, led_counts=led_counts)
+
+    for channel in range(num_stairs):
+        if driver.init_sensor(channel, PON if phased else PON | PEN | WEN):
+            pipeline.add_sensor(channel)
+
+    groups = None
+    if phased:
+        channels = [channel for channel in range(num_stairs) if driver.initialized[channel]]
+        coupling = measure_interference(driver, channels, array.neighbours())
+        groups = plan_groups(channels, coupling)
+        sweeper = PhasedSweep(driver, groups)
+
+    t = 0.0
+    sweeps = overruns = edges = false_edges = samples = 0
+    worst_sweep = 0.0
+    host_time = 0.0
+    wall_start = time.perf_counter()
+    while t < duration:
+        crowd.update(t)
+        occupied = crowd.distances(t)
+        for index, sensor in enumerate(array.sensors):
+            sensor.target_distance = occupied.get(index, NO_TARGET)
+
+        for bus in array.buses:
+            bus.busy_time = 0.0
+        driver.waited = 0.0
+
+        def on_sample(channel, distance):
+            nonlocal samples, edges, false_edges
+            samples += 1
+            if distance is None:
+                return
+            state = pipeline.process_sample(channel, distance)
+            if state is not None:
+                edges += 1
+                if state and channel not in occupied:
+                    false_edges += 1
+
+        host_start = time.perf_counter()
+        if groups is not None:
+            sweeper.run(t, lambda channel, pdata: on_sample(
+                channel, None if pdata is None else proximity_to_distance(pdata, driver.scale)))
+        else:
+            for channel in range(num_stairs):
+                on_sample(channel, driver.read_range(channel, t))
+        host_time += time.perf_counter() - host_start
+
+        # Buses run in parallel; the sweep takes as long as the busiest one plus conversion waits
+        sweep_time = max(bus.busy_time for bus in array.buses) + driver.waited
+        worst_sweep = max(worst_sweep, sweep_time)
+        if sweep_time > sweep_period:
+            overruns += 1
+        t += max(sweep_period, sweep_time)
+        sweeps += 1
+
+    wall = time.perf_counter() - wall_start
+    return {
+        "stairs": num_stairs,
+        "buses": len(array.buses),
+        "people": crowd.arrived,
+        "sweeps": sweeps,
+        "samples": samples,
+        "edges": edges,
+        "false_edges": false_edges,
+        "groups": len(groups) if groups else 0,
+        "shows": strip.shows,
+        "worst_sweep": worst_sweep,
+        "overruns": overruns,
+        "host_per_sweep": host_time / sweeps if sweeps else 0.0,
+        "speedup": duration / wall if wall else float("inf"),
+        "stats": stats,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Simulate crowds on the stairs and find where the design saturates")
+    parser.add_argument("--stairs", type=int, nargs="+", default=[14, 64, 128, 256, 512],
+                        help="Stair counts to simulate")
+    parser.add_argument("--people", type=float, default=20.0, help="Arrivals per minute")
+    parser.add_argument("--duration", type=float, default=60.0, help="Simulated seconds per run")
+    parser.add_argument("--sweep-ms", type=float, default=20.0, help="Target sweep period in ms")
+    parser.add_argument("--clock", type=int, default=400000, help="I2C clock in Hz")
+    parser.add_argument("--crosstalk", type=float, default=0.0,
+                        help="Counts a stair's LED adds to the next stair when pulses coincide")
+    parser.add_argument("--phased", action="store_true",
+                        help="Measure interference at startup and convert in non-interfering groups")
+    parser.add_argument("--pulses", type=int, default=8, help="Proximity LED pulses per conversion")
+    args = parser.parse_args()
+
+    sweep_period = args.sweep_ms / 1000.0
+    print(f"{'stairs':>6} {'buses':>5} {'people':>6} {'edges':>6} {'false':>6} {'sweep ms':>12} "
+          f"{'overruns':>9} {'host ms/sweep':>13} {'led p99 us':>10} {'x realtime':>10}")
+    for num_stairs in args.stairs:
+        report = run(num_stairs, args.people, args.duration, sweep_period, args.clock,
+                     crosstalk=args.crosstalk, phased=args.phased, pulses=args.pulses)
+        led = report["stats"].percentiles("led", (99,))
+        host_ms = report["host_per_sweep"] * 1000
+        verdict = "" if report["overruns"] == 0 and host_ms <= args.sweep_ms else "  <-- cannot keep up"
+        if report["groups"]:
+            verdict += f"  ({report['groups']} phase groups)"
+        print(f"{report['stairs']:>6} {report['buses']:>5} {report['people']:>6} {report['edges']:>6} "
+              f"{report['false_edges']:>6} "
+              f"{report['worst_sweep'] * 1000:>12.2f} {report['overruns']:>9} {host_ms:>13.2f} "
+              f"{(led[0] / 1000) if led else 0:>10.1f} {report['speedup']:>10.1f}{verdict}")
+
+
+if __name__ == "__main__":
+    main()
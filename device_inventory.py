@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+
+import json
+import os
+
+
+class DeviceInventory:
+    """Persisted map of which mux channels hold which sensor, and how it was configured.
+
+    On startup, main.py initializes only the channels listed here and hands
+    every other channel to the background prober. Empty channels then cost
+    nothing before the first sweep. The file is rewritten only when a channel
+    is added or its entry changes.
+
+    File format (JSON):
+        {"channels": {"<global channel>": {"mux": 112, "local": 3, "type": "VL53L0X",
+                                           "id": 238, "calibration": {...}}}}
+
+    "mux" and "local" are the last hop of the channel's route. Channels
+    behind cascaded muxes also get "route", the full path as "0x70:3/0x74:5".
+
+    Entries are only a cache. main.py drops the ones no mux route reaches
+    any more, and re-records a channel whose sensor reports a different ID.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self.channels = {}
+        try:
+            with open(path) as f:
+                data = json.load(f)
+            self.channels = {int(channel): entry for channel, entry in data.get("channels", {}).items()}
+        except FileNotFoundError:
+            pass
+        except (OSError, ValueError) as e:
+            print(f"Ignoring unreadable device inventory {path}: {e}")
+
+    def __bool__(self):
+        return bool(self.channels)
+
+    def known_channels(self):
+        return sorted(self.channels)
+
+    def calibration(self):
+        """Per-channel calibration, in the form VL53L0XMultiplexer.calibration uses."""
+        return {channel: entry["calibration"] for channel, entry in self.channels.items()
+                if entry.get("calibration")}
+
+    def prune(self, channels):
+        """Drop the entries of channels that are no longer routable, and save if any went.
+
+        Args:
+            channels: Every channel a mux route still reaches
+
+        Returns:
+            list: The dropped channels
+        """
+        gone = sorted(set(self.channels) - set(channels))
+        for channel in gone:
+            del self.channels[channel]
+        if gone:
+            self.save()
+        return gone
+
+    def record(self, channel, route, device_type, model_id, calibration):
+        """Add or update a channel's entry and save if anything changed.
+
+        Args:
+            route: mux_topology.MuxRoute the channel was found on
+        """
+        entry = {
+            "mux": route.mux,
+            "local": route.channel,
+            "type": device_type,
+            "id": model_id,
+            "calibration": calibration,
+        }
+        if len(route) > 1:
+            entry["route"] = str(route)
+        if self.channels.get(channel) == entry:
+            return
+        self.channels[channel] = entry
+        self.save()
+
+    def save(self):
+        os.makedirs(os.path.dirname(self.path) or ".", exist_ok=True)
+        tmp = self.path + ".tmp"
+        with open(tmp, "w") as f:
+            json.dump({"channels": {str(channel): entry for channel, entry in sorted(self.channels.items())}},
+                      f, indent=1)
+        os.replace(tmp, self.path)
@@ -4,6 +4,7 @@ module.exports = {
       script: "bash",
       args: "-c 'sudo /home/connor/crazy-stairs/venv/bin/python3 /home/connor/crazy-stairs/main.py'",
       watch: true,
+      ignore_watch: ["logs", "tone_cache"],
       env: {
         "PYTHONUNBUFFERED": "1"
       },
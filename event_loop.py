@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+
+import collections
+import ctypes
+import ctypes.util
+import os
+import select
+import signal
+import struct
+
+CLOCK_MONOTONIC = 1
+TFD_NONBLOCK = os.O_NONBLOCK
+TFD_CLOEXEC = os.O_CLOEXEC
+SFD_NONBLOCK = os.O_NONBLOCK
+SFD_CLOEXEC = os.O_CLOEXEC
+SIGSET_SIZE = 128           # sizeof(sigset_t) in glibc
+SIGNALFD_SIGINFO_SIZE = 128
+
+_libc = ctypes.CDLL(ctypes.util.find_library("c") or "libc.so.6", use_errno=True)
+
+
+class _Timespec(ctypes.Structure):
+    _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+
+class _Itimerspec(ctypes.Structure):
+    _fields_ = [("it_interval", _Timespec), ("it_value", _Timespec)]
+
+
+def _timespec(seconds):
+    ns = int(seconds * 1_000_000_000)
+    return _Timespec(ns // 1_000_000_000, ns % 1_000_000_000)
+
+
+def _check(result, what):
+    if result < 0:
+        err = ctypes.get_errno()
+        raise OSError(err, f"{what}: {os.strerror(err)}")
+    return result
+
+
+class Timer:
+    """Periodic timerfd registered with an EventLoop."""
+
+    def __init__(self, loop, interval, callback):
+        self.loop = loop
+        self.interval = interval
+        self.callback = callback
+        self.armed = False
+        self.fd = _check(_libc.timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), "timerfd_create")
+
+    def arm(self, interval=None):
+        """Start (or restart) the timer. The first tick is one interval from now."""
+        if interval is not None:
+            self.interval = interval
+        spec = _Itimerspec(_timespec(self.interval), _timespec(self.interval))
+        _check(_libc.timerfd_settime(self.fd, 0, ctypes.byref(spec), None), "timerfd_settime")
+        self.armed = True
+
+    def disarm(self):
+        spec = _Itimerspec(_timespec(0), _timespec(0))
+        _check(_libc.timerfd_settime(self.fd, 0, ctypes.byref(spec), None), "timerfd_settime")
+        self.armed = False
+
+    def remaining(self):
+        """Seconds until the next tick, or None if the timer is disarmed."""
+        if not self.armed:
+            return None
+        spec = _Itimerspec()
+        _check(_libc.timerfd_gettime(self.fd, ctypes.byref(spec)), "timerfd_gettime")
+        return spec.it_value.tv_sec + spec.it_value.tv_nsec / 1_000_000_000
+
+    def _ready(self):
+        try:
+            expirations = struct.unpack("<Q", os.read(self.fd, 8))[0]
+        except BlockingIOError:
+            return
+        self.callback(expirations)
+
+
+class EventLoop:
+    """Single-threaded epoll loop over timerfds, an eventfd, a signalfd and GPIO line fds.
+
+    Nothing polls: with no timers armed and no interrupts pending the process
+    sleeps in epoll_wait and uses no CPU.
+    """
+
+    def __init__(self):
+        self._epoll = select.epoll()
+        self._callbacks = {}
+        self._timers = []
+        self._running = False
+
+        # Cross-thread wakeups (audio thread, logging thread)
+        self._pending = collections.deque()
+        self._eventfd = os.eventfd(0, os.EFD_NONBLOCK | os.EFD_CLOEXEC)
+        self.add_reader(self._eventfd, self._run_pending)
+
+        self._signalfd = None
+        self._signal_handlers = {}
+
+    def add_reader(self, fd, callback):
+        """Call callback() whenever fd becomes readable."""
+        self._callbacks[fd] = callback
+        self._epoll.register(fd, select.EPOLLIN)
+
+    def remove_reader(self, fd):
+        if self._callbacks.pop(fd, None) is not None:
+            self._epoll.unregister(fd)
+
+    def add_timer(self, interval, callback, start=True):
+        """Create a periodic timer.
+
+        Args:
+            interval: Period in seconds
+            callback: Called as callback(expirations) on each tick
+            start: Arm the timer immediately
+
+        Returns:
+            Timer: The timer, so it can be armed and disarmed later
+        """
+        timer = Timer(self, interval, callback)
+        self._timers.append(timer)
+        self.add_reader(timer.fd, timer._ready)
+        if start:
+            timer.arm()
+        return timer
+
+    def add_signal_handlers(self, handlers):
+        """Route signals through a signalfd instead of asynchronous Python handlers.
+
+        Must be called before any other thread is started, so the blocked
+        signal mask is inherited and no thread receives them asynchronously.
+
+        Args:
+            handlers: Dict of {signal number: callback(signum)}
+        """
+        self._signal_handlers.update(handlers)
+        signal.pthread_sigmask(signal.SIG_BLOCK, self._signal_handlers.keys())
+        mask = ctypes.create_string_buffer(SIGSET_SIZE)
+        _libc.sigemptyset(mask)
+        for signum in self._signal_handlers:
+            _libc.sigaddset(mask, int(signum))
+        fd = self._signalfd if self._signalfd is not None else -1
+        fd = _check(_libc.signalfd(fd, mask, SFD_NONBLOCK | SFD_CLOEXEC), "signalfd")
+        if self._signalfd is None:
+            self._signalfd = fd
+            self.add_reader(fd, self._read_signals)
+
+    def _read_signals(self):
+        while True:
+            try:
+                info = os.read(self._signalfd, SIGNALFD_SIGINFO_SIZE)
+            except BlockingIOError:
+                return
+            signum = struct.unpack_from("<I", info, 0)[0]
+            handler = self._signal_handlers.get(signum)
+            if handler is not None:
+                handler(signum)
+
+    def call_soon_threadsafe(self, callback, *args):
+        """Run callback(*args) on the loop thread. Safe to call from any thread."""
+        self._pending.append((callback, args))
+        os.eventfd_write(self._eventfd, 1)
+
+    def _run_pending(self):
+        try:
+            os.eventfd_read(self._eventfd)
+        except BlockingIOError:
+            return
+        while self._pending:
+            callback, args = self._pending.popleft()
+            callback(*args)
+
+    def run(self):
+        """Dispatch events until stop() is called."""
+        self._running = True
+        while self._running:
+            self.run_once()
+
+    def run_once(self, timeout=-1):
+        """Wait up to `timeout` seconds (forever if negative) and dispatch whatever is ready."""
+        try:
+            # One slot per registered fd; without maxevents CPython allocates room for 1023 each call
+            events = self._epoll.poll(timeout, len(self._callbacks))
+        except InterruptedError:
+            return
+        for fd, _mask in events:
+            callback = self._callbacks.get(fd)
+            if callback is not None:
+                callback()
+
+    def stop(self, *args):
+        self._running = False
+
+    def close(self):
+        for timer in self._timers:
+            os.close(timer.fd)
+        os.close(self._eventfd)
+        if self._signalfd is not None:
+            os.close(self._signalfd)
+        self._epoll.close()
@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+
+import argparse
+import os
+import re
+import shutil
+import struct
+import subprocess
+import tempfile
+
+PLATFORMIO_INI = "platformio.ini"
+DRIVER_SOURCES = ["lib/APDS9930/src/APDS9930.cpp", "lib/APDS9930/src/APDS9930Mux.cpp",
+                  "lib/APDS9930/src/APDS9930AutoGain.cpp"]
+HOST_FLAGS = ["-std=gnu++17", "-Os", "-fdata-sections", "-ffunction-sections", "-Isrc/native",
+              "-Ilib/APDS9930/src", "-Iinclude"]
+# On the host PROGMEM data lands in its own section, so it can be counted as flash like on the AVR
+HOST_PROGMEM = "-DPROGMEM=__attribute__((section(\".progmem.data\")))"
+
+# Flash and RAM in bytes, as PlatformIO's board definitions give them
+BOARD_MEMORY = {"uno": (32256, 2048), "esp32dev": (1310720, 327680)}
+
+# --bench: the driver's sweep loop built three ways, against a Wire that answers at once
+BENCH_BUILDS = [
+    ("out-of-line", []),
+    ("out-of-line + LTO", ["-flto"]),
+    ("header-only", ["-DAPDS9930_HEADER_ONLY"]),
+]
+BENCH_SWEEPS = 1000000
+BENCH_RUNS = 5
+BENCH_SOURCE = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Wire.h>
+
+#include "APDS9930Mux.h"
+
+TwoWire Wire;
+
+void TwoWire::setClock(uint32_t hz) { (void)hz; }
+size_t TwoWire::write(uint8_t value) { tx_buf[tx_len++ % WIRE_BUFFER_LENGTH] = value; return 1; }
+size_t TwoWire::write(const uint8_t *data, size_t len) { while( len-- ) write(*data++); return 1; }
+uint8_t TwoWire::endTransmission(uint8_t stop) { (void)stop; return 0; }
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t len, uint8_t stop)
+{
+    (void)addr; (void)stop;
+    memset(rx_buf, APDS9930_ID_2, len);
+    rx_len = len;
+    rx_pos = 0;
+    return len;
+}
+
+static APDS9930Mux muxes[] = { 0x70, 0x71 };
+
+__attribute__((noinline)) static uint32_t sweep()
+{
+    APDS9930Sample sample;
+    uint32_t sum = 0;
+
+    for( APDS9930Mux &mux : muxes ) {
+        for( uint8_t channel = 0; channel < TCA9548A_CHANNELS; channel++ ) {
+            if( (mux.getPopulated() & (1 << channel)) && mux.select(channel) && mux.sensor().readSample(sample) ) {
+                sum += sample.pdata;
+            }
+        }
+        mux.deselect();
+    }
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec start, end;
+    long sweeps = atol(argv[1]);
+    uint32_t sum = 0;
+
+    (void)argc;
+    for( APDS9930Mux &mux : muxes ) {
+        mux.begin();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for( long i = 0; i < sweeps; i++ ) {
+        sum += sweep();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%.1f %u\n", ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / sweeps, sum);
+    return 0;
+}
+"""
+
+RAM_SECTIONS = (".data", ".bss", ".noinit")
+FLASH_SECTIONS = (".text", ".data", ".progmem", ".rodata")
+
+
+def env_options(env, path=PLATFORMIO_INI):
+    """Board and build_flags of a platformio.ini env, following extends and ${env:x.build_flags}."""
+    sections = {}
+    name = None
+    for line in open(path):
+        line = line.split(";")[0].rstrip()
+        if line.startswith("["):
+            name = line.strip("[]")
+            sections[name] = {}
+            key = None
+        elif "=" in line and not line[0].isspace():
+            key, _, value = line.partition("=")
+            key = key.strip()
+            sections[name][key] = value.strip()
+        elif line.strip() and name and key:
+            sections[name][key] += "\n" + line.strip()
+
+    def lookup(section, key):
+        options = sections.get(section, {})
+        if key in options:
+            return options[key]
+        if "extends" in options:
+            return lookup(options["extends"], key)
+        return sections.get("env", {}).get(key, "")
+
+    def flags(section):
+        text = lookup(section, "build_flags")
+        text = re.sub(r"\$\{env:([\w-]+)\.build_flags\}", lambda m: " ".join(flags(f"env:{m.group(1)}")), text)
+        return text.split()
+
+    return lookup(f"env:{env}", "board"), flags(f"env:{env}")
+
+
+def elf_sections(path):
+    """{section name: size} for an ELF file, 32 or 64 bit, either byte order."""
+    with open(path, "rb") as f:
+        data = f.read()
+    is64 = data[4] == 2
+    order = "<" if data[5] == 1 else ">"
+    if is64:
+        shoff, = struct.unpack_from(order + "Q", data, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(order + "HHH", data, 0x3A)
+        header = order + "IIQQQQIIQQ"
+    else:
+        shoff, = struct.unpack_from(order + "I", data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(order + "HHH", data, 0x2E)
+        header = order + "IIIIIIIIII"
+    headers = [struct.unpack_from(header, data, shoff + i * shentsize) for i in range(shnum)]
+    names = headers[shstrndx][4]
+    sizes = {}
+    for entry in headers:
+        sh_name, sh_type, size = entry[0], entry[1], entry[5]
+        if sh_type == 0:
+            continue
+        name = data[names + sh_name:data.index(b"\0", names + sh_name)].decode()
+        sizes[name] = sizes.get(name, 0) + size
+    return sizes
+
+
+def memory_use(sections):
+    """(flash, static RAM) in bytes for a set of ELF sections.
+
+    Constant tables the AVR core would copy into RAM (.rodata outside
+    PROGMEM, host builds only) count as RAM. String literals and the host's
+    constant pools count as flash: the driver only logs through F(), and the
+    AVR loads such constants as immediates.
+    """
+    flash = ram = 0
+    for name, size in sections.items():
+        if name.startswith(RAM_SECTIONS):
+            ram += size
+        if name.startswith(".rodata") and ".str" not in name and ".cst" not in name:
+            ram += size
+        if name.startswith(FLASH_SECTIONS):
+            flash += size
+    return flash, ram
+
+
+def pio_report(env):
+    """Build an env with PlatformIO and measure the whole firmware image."""
+    subprocess.run(["pio", "run", "-e", env], check=True, stdout=subprocess.DEVNULL)
+    return memory_use(elf_sections(os.path.join(".pio", "build", env, "firmware.elf")))
+
+
+def host_report(env):
+    """Compile just the APDS9930 driver with an env's flags on the host and measure it.
+
+    An estimate for when PlatformIO isn't installed: host code is larger than
+    AVR code, but the RAM figures and the APDS9930Mux instance size match.
+    """
+    _, flags = env_options(env)
+    flags = [flag for flag in flags if flag.startswith("-D")]
+    flash = ram = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        for source in DRIVER_SOURCES:
+            obj = os.path.join(tmp, os.path.basename(source) + ".o")
+            subprocess.run(["g++", *HOST_FLAGS, HOST_PROGMEM, *flags, "-c", source, "-o", obj], check=True)
+            obj_flash, obj_ram = memory_use(elf_sections(obj))
+            flash += obj_flash
+            ram += obj_ram
+        probe = os.path.join(tmp, "probe.cpp")
+        with open(probe, "w") as f:
+            f.write('#include <stdio.h>\n#include "APDS9930Mux.h"\n'
+                    'int main() { printf("%zu", sizeof(APDS9930Mux)); return 0; }\n')
+        subprocess.run(["g++", *HOST_FLAGS, *flags, probe, "-o", probe[:-4]], check=True)
+        instance = int(subprocess.run([probe[:-4]], check=True, capture_output=True, text=True).stdout)
+    return flash, ram, instance
+
+
+def host_bench(sweeps=BENCH_SWEEPS):
+    """Time a 16-sensor sweep with the driver built out-of-line, with LTO and header-only.
+
+    Wire answers at once, so the time is the driver's own overhead per sweep,
+    best of BENCH_RUNS. The code size is the whole program's .text, which
+    differs between builds only in the driver and the loops calling it.
+
+    Returns:
+        list: (build name, .text bytes, ns per sweep)
+    """
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        bench = os.path.join(tmp, "bench.cpp")
+        with open(bench, "w") as f:
+            f.write(BENCH_SOURCE)
+        for name, flags in BENCH_BUILDS:
+            program = os.path.join(tmp, "bench")
+            subprocess.run(["g++", *HOST_FLAGS, "-DAPDS9930_LOG_LEVEL=0", *flags, bench, *DRIVER_SOURCES,
+                            "-Wl,--gc-sections", "-o", program], check=True)
+            ns = min(float(subprocess.run([program, str(sweeps)], check=True, capture_output=True,
+                                          text=True).stdout.split()[0]) for _ in range(BENCH_RUNS))
+            results.append((name, elf_sections(program)[".text"], ns))
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flash and static RAM used by each firmware configuration")
+    parser.add_argument("envs", nargs="*", default=["uno", "uno-lean"], help="platformio.ini envs to compare")
+    parser.add_argument("--host", action="store_true",
+                        help="Measure only the APDS9930 driver, built with the host g++ (default without pio)")
+    parser.add_argument("--bench", action="store_true",
+                        help="Compare sweep code size and time with the driver out-of-line, LTO and header-only")
+    args = parser.parse_args()
+
+    if args.bench:
+        results = host_bench()
+        base = results[0][2]
+        print(f"16-sensor sweep, host g++ -Os, Wire stubbed out ({BENCH_SWEEPS} sweeps)")
+        for name, code, ns in results:
+            print(f"{name:<18} .text {code:>6} B  {ns:>7.1f} ns/sweep  ({base / ns:.2f}x)")
+        return
+
+    use_pio = shutil.which("pio") and not args.host
+    if not use_pio:
+        print("APDS9930 driver only, host g++ estimate (install PlatformIO for whole-firmware numbers)")
+    for env in args.envs:
+        board, flags = env_options(env)
+        if use_pio:
+            flash, ram = pio_report(env)
+            line = f"{env:<12} flash {flash:>6} B  RAM {ram:>5} B"
+            if board in BOARD_MEMORY:
+                _, total_ram = BOARD_MEMORY[board]
+                line += f" ({100 * ram / total_ram:.0f}% of {total_ram}, {total_ram - ram} B left for buffers and stack)"
+        else:
+            flash, ram, instance = host_report(env)
+            muxes = next((len(flag.split("=", 1)[1].split(",")) for flag in flags
+                          if flag.startswith("-DSTREAM_MUXES=")), 1)
+            line = (f"{env:<12} code+tables {flash:>5} B  static RAM {ram:>4} B  "
+                    f"APDS9930Mux {instance:>2} B x {muxes} muxes = {instance * muxes} B")
+        print(line)
+
+
+if __name__ == "__main__":
+    main()
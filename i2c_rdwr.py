@@ -0,0 +1,331 @@
+#!/usr/bin/env python3
+
+import argparse
+import ctypes
+import ctypes.util
+import errno
+import os
+import time
+
+from mux_topology import MuxRoute, MuxTopology, build_routes
+
+# linux/i2c.h and linux/i2c-dev.h
+I2C_FUNCS = 0x0705
+I2C_RDWR = 0x0707
+I2C_RDWR_IOCTL_MAX_MSGS = 42
+I2C_M_RD = 0x0001
+I2C_M_STOP = 0x8000
+I2C_FUNC_PROTOCOL_MANGLING = 0x00000004
+
+APDS9930_I2C_ADDR = 0x39
+APDS9930_STATUS = 0x13
+AUTO_INCREMENT = 0xA0
+SAMPLE_LEN = 7              # STATUS, Ch0 L/H, Ch1 L/H, PDATA L/H
+
+_libc = ctypes.CDLL(ctypes.util.find_library("c") or "libc.so.6", use_errno=True)
+
+
+class I2CMsg(ctypes.Structure):
+    _fields_ = [("addr", ctypes.c_uint16), ("flags", ctypes.c_uint16),
+                ("len", ctypes.c_uint16), ("buf", ctypes.POINTER(ctypes.c_uint8))]
+
+
+class I2CRdwrData(ctypes.Structure):
+    _fields_ = [("msgs", ctypes.POINTER(I2CMsg)), ("nmsgs", ctypes.c_uint32)]
+
+
+class LinuxI2C:
+    """/dev/i2c-N, driven with I2C_RDWR so one syscall carries a whole message list."""
+
+    def __init__(self, bus):
+        self.fd = os.open(f"/dev/i2c-{bus}", os.O_RDWR | os.O_CLOEXEC)
+        self.ioctls = 0
+
+    def functionality(self):
+        funcs = ctypes.c_ulong()
+        if _libc.ioctl(self.fd, I2C_FUNCS, ctypes.byref(funcs)) < 0:
+            return 0
+        return funcs.value
+
+    def rdwr(self, msgs, count):
+        self.ioctls += 1
+        data = I2CRdwrData(ctypes.cast(msgs, ctypes.POINTER(I2CMsg)), count)
+        if _libc.ioctl(self.fd, I2C_RDWR, ctypes.byref(data)) < 0:
+            err = ctypes.get_errno()
+            raise OSError(err, os.strerror(err))
+
+    def close(self):
+        os.close(self.fd)
+
+
+class SimulatedI2C:
+    """Runs I2C_RDWR message lists against a sim_apds9930.SimulatedI2CBus."""
+
+    def __init__(self, bus):
+        self.bus = bus
+        self.ioctls = 0
+
+    def functionality(self):
+        return I2C_FUNC_PROTOCOL_MANGLING if self.bus.protocol_mangling else 0
+
+    def rdwr(self, msgs, count):
+        self.ioctls += 1
+        messages = []
+        for i in range(count):
+            msg = msgs[i]
+            data = msg.len if msg.flags & I2C_M_RD else ctypes.string_at(msg.buf, msg.len)
+            messages.append((msg.addr, msg.flags, data))
+        results = iter(self.bus.transfer(messages))
+        for i in range(count):
+            if msgs[i].flags & I2C_M_RD:
+                ctypes.memmove(msgs[i].buf, next(results), msgs[i].len)
+
+
+class SweepPlan:
+    """A sweep over APDS-9930s behind TCA9548A muxes, compiled into I2C_RDWR message lists.
+
+    Each route needs:
+    - the mux writes MuxTopology.select() gives for it: usually just the new
+      channel, plus a deselect when the sweep moves to a sibling mux and a
+      parent channel when it enters a cascaded subtree
+    - a register pointer write
+    - a burst read of STATUS..PDATAH
+
+    Routes are swept in depth-first order, whatever order they are given
+    in. The read buffers point straight into `block` at each route's own
+    index, so every sample lands in place with no copy. The plan is cyclic,
+    since the first route follows the last.
+
+    A TCA9548A only switches on a STOP, so in one combined transfer each mux
+    write is flagged I2C_M_STOP. Adapters without protocol mangling, such as
+    the Pi's i2c-bcm2835, also take only one read, as the last message. For
+    those the plan falls back to two ioctls per route: the mux writes, then
+    pointer write plus read. It switches automatically if a combined transfer
+    is rejected.
+    """
+
+    def __init__(self, routes, address=APDS9930_I2C_ADDR, register=APDS9930_STATUS, length=SAMPLE_LEN,
+                 mangling=True):
+        """
+        Args:
+            routes: One MuxRoute (or flat (mux address, channel) pair) per sensor
+            address: Sensor address behind the mux
+            register: First register of the burst read
+            length: Bytes per burst read
+            mangling: Start with combined transfers (falls back if rejected)
+        """
+        self.routes = [MuxRoute.of(route) for route in routes]
+        self.topology = MuxTopology(self.routes)
+        self.order = sorted(range(len(self.routes)), key=self.routes.__getitem__)
+        self.address = address
+        self.length = length
+        self.block = bytearray(len(self.routes) * length)
+        self.valid = bytearray(len(self.routes))
+        self._block = (ctypes.c_uint8 * len(self.block)).from_buffer(self.block)
+        self._command = (ctypes.c_uint8 * 1)(AUTO_INCREMENT | register)
+        self._values = {value: (ctypes.c_uint8 * 1)(value) for value in range(256)}
+        self._synced = False
+        self._single = [self._build([self._absolute_select(i), self._read(i)], False)
+                        for i in range(len(self.routes))]
+        # Leave every mux, including ones cut off upstream, as a full sweep would
+        state = {}
+        self._sync = self._build([self._writes(self.topology.select(self.routes[i], state)) for i in self.order],
+                                 False)
+        self.compile(mangling)
+
+    def _read(self, index):
+        return [(self.address, 0, None), (self.address, I2C_M_RD, index)]
+
+    @staticmethod
+    def _writes(selects):
+        return [(mux, 0, value) for mux, value in selects]
+
+    def _absolute_select(self, index):
+        return self._writes(self.topology.select(self.routes[index], {}))
+
+    def _build(self, groups, mangling):
+        """Turn groups of (addr, flags, arg) into segments of at most 42 messages.
+
+        arg is a mux value for writes, None for the pointer write and a route
+        index for reads. Without mangling every group is its own segment.
+        A mux write then lands only at the end of its transfer, so the writes
+        are also cut after each channel select: a cascaded mux can't be
+        reached until its parent has switched.
+        """
+        segments = []
+        current = []
+        indices = []
+
+        def flush():
+            if current:
+                msgs = (I2CMsg * len(current))()
+                for slot, (addr, flags, arg) in enumerate(current):
+                    msgs[slot].addr = addr
+                    if flags & I2C_M_RD:
+                        msgs[slot].flags = flags
+                        msgs[slot].len = self.length
+                        msgs[slot].buf = ctypes.cast(ctypes.byref(self._block, arg * self.length),
+                                                     ctypes.POINTER(ctypes.c_uint8))
+                    else:
+                        msgs[slot].flags = flags
+                        msgs[slot].len = 1
+                        buf = self._command if arg is None else self._values[arg]
+                        msgs[slot].buf = ctypes.cast(buf, ctypes.POINTER(ctypes.c_uint8))
+                segments.append((msgs, len(current), list(indices)))
+                current.clear()
+                indices.clear()
+
+        if not mangling:
+            groups = [split for group in groups for split in self._split_levels(group)]
+        for group in groups:
+            if not group:
+                continue
+            if mangling:
+                # Mux writes must be followed by a STOP to take effect
+                group = [(addr, flags | I2C_M_STOP, arg) if addr != self.address else (addr, flags, arg)
+                         for addr, flags, arg in group]
+            if not mangling or len(current) + len(group) > I2C_RDWR_IOCTL_MAX_MSGS:
+                flush()
+            current.extend(group)
+            indices.extend(arg for addr, flags, arg in group if flags & I2C_M_RD)
+            if not mangling:
+                flush()
+        flush()
+        return segments
+
+    def _split_levels(self, group):
+        """[deselects, select, deeper writes..., reads] -> one group per mux level, then the reads."""
+        splits = [[]]
+        for msg in group:
+            if msg[0] == self.address:
+                continue
+            splits[-1].append(msg)
+            if msg[2]:
+                splits.append([])
+        splits[-1].extend(msg for msg in group if msg[0] == self.address)
+        return splits
+
+    def compile(self, mangling):
+        """(Re)build the sweep segments for combined (mangling) or per-route transfers."""
+        self.mangling = mangling
+        selects = self.topology.sweep_writes([self.routes[index] for index in self.order])
+        self.select_writes = sum(len(writes) for writes in selects)
+        groups = []
+        for index, writes in zip(self.order, selects):
+            if mangling:
+                groups.append(self._writes(writes) + self._read(index))
+            else:
+                groups.append(self._writes(writes))
+                groups.append(self._read(index))
+        self.segments = self._build(groups, mangling)
+
+    def execute(self, transport):
+        """Run one sweep. Results are in block; valid[i] is 0 for routes that failed.
+
+        Returns:
+            int: Number of ioctls issued
+        """
+        start = transport.ioctls
+        if not self._synced:
+            self._run_segments(transport, self._sync)
+            self._synced = True
+        for msgs, count, indices in self.segments:
+            try:
+                transport.rdwr(msgs, count)
+                for index in indices:
+                    self.valid[index] = 1
+            except OSError as e:
+                if self.mangling and e.errno in (errno.EOPNOTSUPP, errno.EINVAL):
+                    print(f"Combined I2C transfers not supported ({e}), using one read per ioctl")
+                    self.compile(False)
+                    self._synced = False
+                    return transport.ioctls - start + self.execute(transport)
+                # Find which route failed. Each single read selects its own route, and the
+                # last one leaves the mux where the next segment expects it
+                for index in indices:
+                    self.valid[index] = self._run_segments(transport, self._single[index])
+        return transport.ioctls - start
+
+    @staticmethod
+    def _run_segments(transport, segments):
+        try:
+            for msgs, count, _ in segments:
+                transport.rdwr(msgs, count)
+            return 1
+        except OSError:
+            return 0
+
+    def sample(self, index):
+        """(status, ch0, ch1, pdata) for one route from the last sweep."""
+        b = self.block
+        o = index * self.length
+        return b[o], b[o + 1] | b[o + 2] << 8, b[o + 3] | b[o + 4] << 8, b[o + 5] | b[o + 6] << 8
+
+
+def _simulate(num_stairs):
+    from crowd_sim import SimulatedArray, SimulatedMultiplexer
+    from sim_apds9930 import APDS9930_PDATAL
+
+    for mangling in (True, False):
+        array = SimulatedArray(num_stairs)
+        driver = SimulatedMultiplexer(array)
+        for channel in range(num_stairs):
+            driver.init_sensor(channel)
+        for sensor in array.sensors:
+            sensor.advance(0.01)
+        for bus in array.buses:
+            bus.protocol_mangling = mangling
+            bus.transactions = 0
+
+        # Per-read transport: every write and write+read is its own syscall
+        expected = [driver.read_pdata(channel, 0.01) for channel in range(num_stairs)]
+        naive = sum(bus.transactions for bus in array.buses)
+
+        plan_ioctls = 0
+        mismatches = 0
+        for bus_index, bus in enumerate(array.buses):
+            channels = [c for c, route in enumerate(array.routes) if route[0] == bus_index]
+            plan = SweepPlan([array.routes[c][1:] for c in channels])
+            transport = SimulatedI2C(bus)
+            plan.execute(transport)     # First sweep syncs the muxes (and may fall back)
+            transport.ioctls = 0
+            plan_ioctls += plan.execute(transport)
+            for slot, channel in enumerate(channels):
+                if not plan.valid[slot] or plan.sample(slot)[3] != expected[channel]:
+                    mismatches += 1
+        label = "combined (I2C_M_STOP)" if mangling else "i2c-bcm2835 fallback"
+        print(f"{num_stairs:>5} sensors  {label:<22} per-read {naive:>5} syscalls/sweep  "
+              f"plan {plan_ioctls:>5} ioctls/sweep  ({naive / max(1, plan_ioctls):.1f}x)  "
+              f"{'ok' if not mismatches else f'{mismatches} mismatches'}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Batched I2C_RDWR sweeps over an APDS-9930 array")
+    parser.add_argument("--bus", type=int, help="Run on /dev/i2c-N instead of the simulator")
+    parser.add_argument("--routes", default="0x70:0-7,0x77:0-7", help="Sensor routes as mux:channels,... with cascades as 0x70:3/0x74:0-7")
+    parser.add_argument("--sweeps", type=int, default=1000, help="Sweeps to time on hardware")
+    parser.add_argument("--stairs", type=int, nargs="+", default=[14, 64], help="Simulated array sizes")
+    args = parser.parse_args()
+
+    if args.bus is None:
+        for num_stairs in args.stairs:
+            _simulate(num_stairs)
+        return
+
+    transport = LinuxI2C(args.bus)
+    plan = SweepPlan(build_routes(args.routes),
+                     mangling=bool(transport.functionality() & I2C_FUNC_PROTOCOL_MANGLING))
+    plan.execute(transport)
+    transport.ioctls = 0
+    start = time.perf_counter()
+    for _ in range(args.sweeps):
+        plan.execute(transport)
+    elapsed = time.perf_counter() - start
+    print(f"{len(plan.routes)} sensors, {'combined' if plan.mangling else 'per-read'} transfers: "
+          f"{transport.ioctls / args.sweeps:.1f} ioctls/sweep, {elapsed / args.sweeps * 1000:.2f} ms/sweep, "
+          f"{len(plan.valid) - sum(plan.valid)} failing")
+    transport.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,62 @@
+/**
+ * @file    double_buffer.h
+ * @brief   Latest-value handoff between cores, without locks
+ *
+ * The writer fills the buffer readers aren't using and then publishes it
+ * by bumping a version. A reader copies the published buffer and retries if
+ * a newer one was started meanwhile. The writer never waits. The reader
+ * retries only when a publish lands mid-copy, which at one publish per sweep
+ * is rare.
+ */
+
+#ifndef DOUBLE_BUFFER_H
+#define DOUBLE_BUFFER_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+template<typename T>
+class DoubleBuffer {
+public:
+    DoubleBuffer() : version(0) {}
+
+    /**
+     * @brief Writer side: the buffer to fill for the next publish()
+     */
+    T &back() { return buffers[(version.load(std::memory_order_relaxed) + 1) & 1]; }
+
+    /**
+     * @brief Writer side: makes back() the current value
+     */
+    void publish()
+    {
+        std::atomic_thread_fence(std::memory_order_release);
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Reader side: copies the current value
+     * @return The version that was read, so a reader can tell if anything changed
+     */
+    uint32_t read(T &out)
+    {
+        uint32_t before;
+        uint32_t after;
+
+        do {
+            before = version.load(std::memory_order_acquire);
+            out = buffers[before & 1];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = version.load(std::memory_order_relaxed);
+        } while( before != after );
+
+        return before;
+    }
+
+private:
+    T buffers[2];
+    std::atomic<uint32_t> version;
+};
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * @file    dual_core.h
+ * @brief   Core pinning and cross-core signals for the dual-core firmware build
+ *
+ * With STREAM_DUAL_CORE set, the sweep runs in one task and the compositor
+ * and LED output in another. On the ESP32 the sweep is pinned to core 0 and
+ * the LEDs to core 1 under FreeRTOS. The native build runs them as two
+ * threads, so the same code can be exercised on Linux.
+ *
+ * Edges and the trigger bitmask cross cores through SpscRing and
+ * DoubleBuffer, and need nothing from here. This covers the rest:
+ * - starting the tasks
+ * - waking the LED task when an edge is queued (a task notification, safe
+ *   from an ISR)
+ * - a one-slot mailbox for configuration changes from the host (a FreeRTOS
+ *   queue of length 1, overwritten on every post)
+ */
+
+#ifndef DUAL_CORE_H
+#define DUAL_CORE_H
+
+#include <Arduino.h>
+
+#include "fast_path.h"
+
+#ifdef STREAM_DUAL_CORE
+
+#define DUAL_CORE_SENSOR        0
+#define DUAL_CORE_LED           1
+
+typedef void (*CoreTaskFn)();
+
+void coreBegin();
+void coreStart(CoreTaskFn sensor, CoreTaskFn led);
+void coreIdle();
+
+/* Sensor core -> LED core */
+void ledWake();
+void ledWakeFromISR();
+void ledWait(uint32_t timeout_ms);
+
+/* Host configuration mailbox, newest wins */
+void configPost(const FastPathConfig &config);
+bool configTake(FastPathConfig &config);
+
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * @file    fast_path.h
+ * @brief   On-MCU trigger filter and stair lighting, with no host round trip
+ *
+ * Every fresh PDATA reading goes through a per-channel hysteresis filter
+ * (TriggerFilter), the same test StairPipeline applies to distance on the
+ * Pi. An edge starts that stair's fade in the StairCompositor, which renders
+ * it at once, so the light follows the step within one sensor cycle plus
+ * one LED frame. The edge is also reported to the host, which still plays
+ * audio and keeps the logs.
+ *
+ * The two halves share nothing but edges and the trigger bitmask, so on a
+ * dual-core part they run on separate cores (see dual_core.h).
+ *
+ * The host sends thresholds, the stair layout and the effect (see
+ * stream_frame.h). The firmware keeps the last configuration it got and
+ * never waits on the host, so the stairs keep working while the Pi is busy
+ * or restarting.
+ */
+
+#ifndef FAST_PATH_H
+#define FAST_PATH_H
+
+#include <Arduino.h>
+
+#include "stream_frame.h"
+
+#ifdef __AVR__
+#define FAST_PATH_MAX_STAIRS    16
+#else
+#define FAST_PATH_MAX_STAIRS    64
+#endif
+#define FAST_PATH_NO_STAIR      0xFF
+
+/* A foot at 609.6 mm (24 in) reads about 58 counts at the driver defaults */
+#define FAST_PATH_DEFAULT_ON    58
+#define FAST_PATH_DEFAULT_OFF   48
+
+struct FastPathStair {
+    uint8_t channel;
+    uint8_t stair;
+    uint16_t leds;
+};
+
+struct FastPathEffect {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t fade_in;        // frames
+    uint8_t fade_out;       // frames
+    uint8_t frame_ms;
+};
+
+/* Everything the host configures; persisted as one block */
+struct FastPathConfig {
+    uint16_t on;
+    uint16_t off;
+    FastPathEffect effect;
+    uint8_t stairs;
+    FastPathStair layout[FAST_PATH_MAX_STAIRS];
+    uint8_t phases;                                             // conversion groups, 0 to free-run
+    uint8_t phase_mask[STREAM_MAX_PHASES][STREAM_MAX_MUXES];    // channels in each group, by mux
+};
+
+/* TriggerFilter Class - runs with the sweep */
+class TriggerFilter {
+public:
+    TriggerFilter();
+    void setThresholds(uint16_t on, uint16_t off) { this->on = on; this->off = off; }
+    int8_t update(uint8_t channel, uint8_t status, uint16_t pdata);
+    const uint8_t *getTriggered() { return triggered; }
+
+private:
+    uint16_t on;
+    uint16_t off;
+    uint8_t triggered[STREAM_MAX_SAMPLES / 8];
+};
+
+/* StairCompositor Class - runs with the LED output */
+class StairCompositor {
+public:
+    StairCompositor();
+    void apply(const FastPathConfig &config, const uint8_t *triggered);
+    void edge(uint8_t channel, uint8_t state);
+    void sync(const uint8_t *triggered);
+    void cycle();
+    bool render(uint32_t now_us);
+
+private:
+    void startFade(uint8_t slot, uint8_t target, uint8_t frames);
+
+    uint8_t stairs;
+    FastPathStair layout[FAST_PATH_MAX_STAIRS];
+    FastPathEffect effect;
+    uint8_t slot_of[STREAM_MAX_SAMPLES];        // channel -> layout slot
+    uint16_t start[FAST_PATH_MAX_STAIRS];       // first LED of each slot
+    uint8_t level[FAST_PATH_MAX_STAIRS];
+    uint8_t target[FAST_PATH_MAX_STAIRS];
+    uint8_t step[FAST_PATH_MAX_STAIRS];
+    bool dirty;
+    uint32_t last_frame;
+};
+
+void defaultFastPathConfig(FastPathConfig &config);
+
+#endif
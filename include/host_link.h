@@ -0,0 +1,52 @@
+/**
+ * @file    host_link.h
+ * @brief   Host -> MCU commands for the fast path, read without ever blocking
+ *
+ * poll() drains whatever Serial has buffered and returns at once, so a
+ * silent or half-sent host never holds up a sweep. Each complete command
+ * frame is CRC-checked, merged into the current configuration, handed to
+ * the apply callback and saved. The configuration then survives an MCU
+ * reset as well as a Pi restart. EEPROM is used where the core has one; the
+ * native build keeps it in RAM only.
+ */
+
+#ifndef HOST_LINK_H
+#define HOST_LINK_H
+
+#include <Arduino.h>
+
+#include "fast_path.h"
+#include "stream_frame.h"
+
+/* Longest command: a full layout, or a phase group for every channel */
+#if FAST_PATH_MAX_STAIRS * STREAM_LAYOUT_LEN > STREAM_MAX_SAMPLES * STREAM_PHASE_LEN
+#define HOST_LINK_ENTRIES       (FAST_PATH_MAX_STAIRS * STREAM_LAYOUT_LEN)
+#else
+#define HOST_LINK_ENTRIES       (STREAM_MAX_SAMPLES * STREAM_PHASE_LEN)
+#endif
+#define HOST_LINK_BUFFER        (STREAM_HEADER_LEN + HOST_LINK_ENTRIES + STREAM_CRC_LEN + 4)
+#define HOST_LINK_MAGIC         0x4353      // "CS"
+
+/* HostLink Class */
+class HostLink {
+public:
+    typedef void (*ApplyFn)(const FastPathConfig &config);
+
+    HostLink(ApplyFn apply);
+    void begin();
+    bool poll(Stream &in);
+    const FastPathConfig &getConfig() { return config; }
+
+private:
+    bool handle(const uint8_t *frame, size_t len);
+    void load();
+    void save();
+
+    ApplyFn apply;
+    FastPathConfig config;
+    uint8_t buf[HOST_LINK_BUFFER];
+    size_t len;
+    bool overflow;
+};
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file    led_output.h
+ * @brief   WS2812 output for the firmware's on-MCU fast path
+ *
+ * Built only when STREAM_LED_PIN is defined. FastLED picks the hardware
+ * driver for the board: RMT on the ESP32, PIO on the RP2040, DMA where the
+ * core has it. Without STREAM_LED_PIN these are empty inlines and the fast
+ * path only reports trigger edges to the host.
+ */
+
+#ifndef LED_OUTPUT_H
+#define LED_OUTPUT_H
+
+#include <Arduino.h>
+
+#ifndef STREAM_LED_MAX
+#define STREAM_LED_MAX          2048
+#endif
+
+#if defined(STREAM_LED_PIN) || defined(STREAM_LED_NATIVE)
+
+void ledBegin();
+void ledFill(uint16_t start, uint16_t count, uint8_t red, uint8_t green, uint8_t blue);
+void ledShow();
+uint32_t ledShows();
+
+#else
+
+inline void ledBegin() {}
+inline void ledFill(uint16_t, uint16_t, uint8_t, uint8_t, uint8_t) {}
+inline void ledShow() {}
+inline uint32_t ledShows() { return 0; }
+
+#endif
+
+#endif
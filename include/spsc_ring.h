@@ -0,0 +1,74 @@
+/**
+ * @file    spsc_ring.h
+ * @brief   Lock-free single-producer single-consumer ring
+ *
+ * One core pushes and the other pops, with no lock and no critical
+ * section. Each side writes only its own index and reads the other's with
+ * acquire ordering, so neither can ever block the other. A full ring drops
+ * the new item and counts it; the consumer recovers from the trigger
+ * bitmask (see StairCompositor::sync()).
+ *
+ * N must be a power of two. push() is also safe from an ISR, as long as
+ * the ISR is the only producer.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+template<typename T, uint16_t N>
+class SpscRing {
+public:
+    SpscRing() : head(0), tail(0), dropped(0) {}
+
+    /**
+     * @brief Producer side: adds an item unless the ring is full
+     * @return True if the item was queued
+     */
+    bool push(const T &item)
+    {
+        uint16_t h = head.load(std::memory_order_relaxed);
+
+        if( (uint16_t)(h - tail.load(std::memory_order_acquire)) == N ) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Consumer side: takes the oldest item
+     * @return True if an item was taken
+     */
+    bool pop(T &item)
+    {
+        uint16_t t = tail.load(std::memory_order_relaxed);
+
+        if( t == head.load(std::memory_order_acquire) ) {
+            return false;
+        }
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Items dropped on a full ring since the last call (consumer side)
+     */
+    uint32_t takeDropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+    static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+    T items[N];
+    std::atomic<uint16_t> head;
+    std::atomic<uint16_t> tail;
+    std::atomic<uint32_t> dropped;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/**
+ * @file    stream_frame.h
+ * @brief   Binary sample frames streamed from the aggregator MCU to the host
+ *
+ * Every frame is built in RAM, closed with a CRC-16/CCITT-FALSE (poly 0x1021,
+ * init 0xFFFF, no reflection, the same as Python's binascii.crc_hqx(data,
+ * 0xFFFF)), then COBS-encoded and terminated with a single 0x00. The host
+ * resynchronises on the next 0x00 after any corrupt or partial frame, and
+ * text the library prints to Serial on an init failure is dropped the same
+ * way.
+ *
+ * All fields are little-endian. Raw frame layout, before COBS:
+ *
+ *   u8  type       STREAM_FRAME_SAMPLES or STREAM_FRAME_INFO
+ *   u16 seq        Increments on every frame; the host counts the gaps as loss
+ *   u32 t_us       micros() at the start of the sweep (wraps every ~71 min)
+ *   u8  count      Number of entries that follow
+ *   entries        count * STREAM_SAMPLE_LEN or count * STREAM_MUX_LEN bytes
+ *   u16 crc        Over every byte above
+ *
+ * Sample entry: u8 channel (mux index * 8 + mux channel, the same numbering
+ * as VL53L0XMultiplexer), u8 STATUS register (STREAM_STATUS_ERROR if the read
+ * failed), u16 PDATA, u16 dt_us since t_us when the read finished. PDATA is
+ * on the scale of the driver defaults, whatever sensitivity the sensor runs
+ * at (see APDS9930AutoGain.h), so it can exceed 1023.
+ *
+ * Info entry, one per mux: u8 I2C address, u8 populated channel mask. The
+ * firmware sends an info frame at boot and every STREAM_INFO_INTERVAL µs,
+ * so a host that connects late still learns the layout. It also sends one
+ * after any sweep in which it applied host commands, as the acknowledgement.
+ *
+ * Edge entry, from the on-MCU trigger filter (see fast_path.h): u8 channel,
+ * u8 new state (1 = triggered), u16 dt_us since t_us. An edge frame follows
+ * the sample frame of the sweep that produced it.
+ *
+ * Stats entry, one per frame, sent about once a second: u16 sweeps and u16
+ * LED frames shown in the last second, u16 edges the LED side dropped, u16
+ * slowest sweep and u16 slowest LED frame in µs. On a dual-core build the
+ * two rates come from separate cores and should not limit each other.
+ *
+ * The host sends commands the same way, with the same header (t_us = 0):
+ *
+ *   STREAM_CMD_TRIGGER  one entry:  u16 PDATA on threshold, u16 off threshold
+ *   STREAM_CMD_LAYOUT   per stair:  u8 channel, u8 stair number, u16 LED count
+ *   STREAM_CMD_EFFECT   one entry:  u8 red, green, blue, fade-in frames,
+ *                                   fade-out frames, frame interval in ms
+ *   STREAM_CMD_PHASES   per channel: u8 channel, u8 conversion group
+ *
+ * With fewer than two phase groups (the default is none) every sensor
+ * free-runs. Otherwise each sweep converts the groups one after another, in
+ * group order, and channels the host left out join group 0. phasing.py
+ * plans the groups.
+ */
+
+#ifndef STREAM_FRAME_H
+#define STREAM_FRAME_H
+
+#include <Arduino.h>
+
+#define STREAM_VERSION          1
+#define STREAM_BAUD             1000000
+
+/* Frame types */
+#define STREAM_FRAME_SAMPLES    0x01
+#define STREAM_FRAME_INFO       0x02
+#define STREAM_FRAME_EDGES      0x03
+#define STREAM_FRAME_STATS      0x04
+
+/* Host commands */
+#define STREAM_CMD_TRIGGER      0x10
+#define STREAM_CMD_LAYOUT       0x11
+#define STREAM_CMD_EFFECT       0x12
+#define STREAM_CMD_PHASES       0x13
+
+/* Sizes */
+#define STREAM_HEADER_LEN       8
+#define STREAM_SAMPLE_LEN       6
+#define STREAM_MUX_LEN          2
+#define STREAM_EDGE_LEN         4
+#define STREAM_STATS_LEN        10
+#define STREAM_TRIGGER_LEN      4
+#define STREAM_LAYOUT_LEN       4
+#define STREAM_EFFECT_LEN       6
+#define STREAM_PHASE_LEN        2
+#define STREAM_CRC_LEN          2
+#define STREAM_MAX_MUXES        8
+#define STREAM_MAX_SAMPLES      (STREAM_MAX_MUXES * 8)
+#define STREAM_MAX_PHASES       4
+#define STREAM_MAX_FRAME        (STREAM_HEADER_LEN + STREAM_MAX_SAMPLES * STREAM_SAMPLE_LEN + STREAM_CRC_LEN)
+
+/* Sample flags, in a STATUS bit the APDS-9930 never sets */
+#define STREAM_STATUS_ERROR     0x80
+
+#define STREAM_INFO_INTERVAL    250000      // µs; by time, as sweep length differs by mode
+
+/* StreamFrame Class */
+class StreamFrame {
+public:
+    void begin(uint8_t type, uint16_t seq, uint32_t t_us);
+    void addSample(uint8_t channel, uint8_t status, uint16_t pdata, uint16_t dt_us);
+    void addMux(uint8_t address, uint8_t populated);
+    void addEdge(uint8_t channel, uint8_t state, uint16_t dt_us);
+    void addStats(uint16_t sweeps, uint16_t frames, uint16_t dropped, uint16_t sweep_us, uint16_t frame_us);
+    uint8_t count() { return buf[STREAM_HEADER_LEN - 1]; }
+    void send(Stream &out);
+
+    static uint16_t crc16(uint16_t crc, const uint8_t *data, size_t len);
+    static size_t decode(uint8_t *data, size_t len);
+
+private:
+    void put8(uint8_t value) { buf[len++] = value; }
+    void put16(uint16_t value) { put8(value & 0xFF); put8(value >> 8); }
+
+    uint8_t buf[STREAM_MAX_FRAME];
+    size_t len;
+};
+
+#endif
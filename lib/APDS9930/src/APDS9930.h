@@ -16,8 +16,55 @@
 
 #include <Arduino.h>
 
-/* Debug */
-#define DEBUG                   0
+/*
+ * Build options (set with -D in build_flags):
+ *
+ *   APDS9930_LEAN        for small AVRs: packs APDS9930Mux's per-channel
+ *                        state into a few bytes and turns logging off
+ *   APDS9930_LOG_LEVEL   0 silent, 1 errors, 2 warnings (default), 3 debug
+ *   APDS9930_HEADER_ONLY defines every member inline in the headers, so
+ *                        callers' loops can absorb the register accessors
+ *                        (the .cpp files then only hold static data)
+ *
+ * Lookup tables live in flash (PROGMEM) and nothing allocates on the heap,
+ * in every mode. Log strings above the level are compiled out.
+ */
+#define APDS9930_LOG_NONE       0
+#define APDS9930_LOG_ERRORS     1
+#define APDS9930_LOG_WARNINGS   2
+#define APDS9930_LOG_DEBUG      3
+
+#ifndef APDS9930_LOG_LEVEL
+#ifdef APDS9930_LEAN
+#define APDS9930_LOG_LEVEL      APDS9930_LOG_NONE
+#else
+#define APDS9930_LOG_LEVEL      APDS9930_LOG_WARNINGS
+#endif
+#endif
+
+#if APDS9930_LOG_LEVEL >= APDS9930_LOG_ERRORS
+#define APDS9930_ERROR(msg)             Serial.println(F(msg))
+#else
+#define APDS9930_ERROR(msg)             ((void)0)
+#endif
+#if APDS9930_LOG_LEVEL >= APDS9930_LOG_WARNINGS
+#define APDS9930_WARN(msg)              Serial.println(F(msg))
+#define APDS9930_WARN_HEX(msg, value)   (Serial.print(F(msg)), Serial.println(value, HEX))
+#else
+#define APDS9930_WARN(msg)              ((void)0)
+#define APDS9930_WARN_HEX(msg, value)   ((void)0)
+#endif
+#if APDS9930_LOG_LEVEL >= APDS9930_LOG_DEBUG
+#define APDS9930_DEBUG_DEC(msg, value)  (Serial.print(F(msg)), Serial.println(value, DEC))
+#else
+#define APDS9930_DEBUG_DEC(msg, value)  ((void)0)
+#endif
+
+#ifdef APDS9930_HEADER_ONLY
+#define APDS9930_INLINE         inline
+#else
+#define APDS9930_INLINE
+#endif
 
 /* APDS-9930 I2C address */
 #define APDS9930_I2C_ADDR       0x39
@@ -74,6 +121,15 @@
 #define APDS9930_PIEN           0b00100000
 #define APDS9930_SAI            0b01000000
 
+/* STATUS register bits */
+#define APDS9930_AVALID         0b00000001
+#define APDS9930_PVALID         0b00000010
+#define APDS9930_AINT           0b00010000
+#define APDS9930_PINT           0b00100000
+
+/* Registers covered by one STATUS..PDATAH burst read */
+#define APDS9930_SAMPLE_LEN     7
+
 /* On/Off definitions */
 #define OFF                     0
 #define ON                      1
@@ -148,6 +204,21 @@ enum {
     #define NA_STATE NOTAVAILABLE_STATE
 #endif
 
+/* One STATUS + data burst read */
+struct APDS9930Sample {
+    uint8_t status;
+    uint16_t ch0;
+    uint16_t ch1;
+    uint16_t pdata;
+};
+
+/* Register image of ENABLE through CONTROL (0x00-0x0F); applyConfig() writes ENABLE last */
+#define APDS9930_CONFIG_LEN     16
+
+struct APDS9930Config {
+    uint8_t regs[APDS9930_CONFIG_LEN];
+};
+
 /* APDS9930 Class */
 class APDS9930 {
 public:
@@ -156,8 +227,14 @@ public:
     APDS9930();
     ~APDS9930();
     bool init();
+    bool probe();
     uint8_t getMode();
     bool setMode(uint8_t mode, uint8_t enable);
+    static uint8_t modeBits(uint8_t reg_val, uint8_t mode, uint8_t enable);
+
+    /* Whole-configuration writes */
+    static void defaultConfig(APDS9930Config &config);
+    bool applyConfig(const APDS9930Config &config);
     
     /* Turn the APDS-9930 on and off */
     bool enablePower();
@@ -172,6 +249,8 @@ public:
     /* LED drive strength control */
     uint8_t getLEDDrive();
     bool setLEDDrive(uint8_t drive);
+    uint8_t getProximityPulseCount();
+    bool setProximityPulseCount(uint8_t pulses);
     // uint8_t getGestureLEDDrive();
     // bool setGestureLEDDrive(uint8_t drive);
     
@@ -201,6 +280,11 @@ public:
     bool clearProximityInt();
     bool clearAllInts();
     
+    /* Status and burst reads */
+    bool readStatus(uint8_t &status);
+    bool readSample(APDS9930Sample &sample);
+    bool readData(APDS9930Sample &sample);
+
     /* Proximity methods */
     bool readProximity(uint16_t &val);
 
@@ -223,9 +307,13 @@ public:
     /* Raw I2C Commands */
     bool wireWriteByte(uint8_t val);
     bool wireWriteDataByte(uint8_t reg, uint8_t val);
-    bool wireWriteDataBlock(uint8_t reg, uint8_t *val, unsigned int len);
+    bool wireWriteDataBlock(uint8_t reg, const uint8_t *val, unsigned int len);
     bool wireReadDataByte(uint8_t reg, uint8_t &val);
     int wireReadDataBlock(uint8_t reg, uint8_t *val, unsigned int len);
 };
 
+#ifdef APDS9930_HEADER_ONLY
+#include "APDS9930_impl.h"
+#endif
+
 #endif
@@ -0,0 +1,31 @@
+/**
+ * @file    APDS9930AutoGain.cpp
+ * @brief   Closed-loop proximity sensitivity for one APDS-9930
+ *
+ * Static data, plus the member functions unless APDS9930_HEADER_ONLY
+ * inlines them (see APDS9930AutoGain_impl.h).
+ */
+
+#include "APDS9930AutoGain.h"
+
+const APDS9930AutoGainRung APDS9930AutoGain::rungs[APDS9930_AUTO_GAIN_RUNGS] PROGMEM = {
+    { LED_DRIVE_100MA,  DEFAULT_PPULSE,     DEFAULT_PGAIN },
+    { LED_DRIVE_50MA,   DEFAULT_PPULSE,     DEFAULT_PGAIN },
+    { LED_DRIVE_25MA,   DEFAULT_PPULSE,     DEFAULT_PGAIN },
+    { LED_DRIVE_12_5MA, DEFAULT_PPULSE,     DEFAULT_PGAIN },
+    { LED_DRIVE_12_5MA, DEFAULT_PPULSE / 2, DEFAULT_PGAIN },
+    { LED_DRIVE_12_5MA, DEFAULT_PPULSE / 4, DEFAULT_PGAIN },
+    { LED_DRIVE_12_5MA, DEFAULT_PPULSE / 4, PGAIN_4X },
+};
+
+uint16_t APDS9930AutoGain::int_low = DEFAULT_PILT;
+uint16_t APDS9930AutoGain::int_high = DEFAULT_PIHT;
+
+static_assert(APDS9930_AUTO_GAIN_LOW * 2 < APDS9930_AUTO_GAIN_HIGH,
+              "a step up doubles PDATA, which must land inside the band");
+static_assert(APDS9930_AUTO_GAIN_RUNGS <= 8 && (1023ul << (APDS9930_AUTO_GAIN_RUNGS - 1)) <= 0xFFFF,
+              "rung indexes are 3 bits and rescaled PDATA must fit 16 bits");
+
+#ifndef APDS9930_HEADER_ONLY
+#include "APDS9930AutoGain_impl.h"
+#endif
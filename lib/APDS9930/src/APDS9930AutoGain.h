@@ -0,0 +1,103 @@
+/**
+ * @file    APDS9930AutoGain.h
+ * @brief   Closed-loop proximity sensitivity for one APDS-9930
+ *
+ * At the driver defaults (100 mA, 8 pulses, 8x gain) a foot close to the
+ * sensor saturates PDATA at 1023, and every sensor spends the full LED
+ * current whether it needs it or not. One APDS9930AutoGain per sensor walks
+ * it down a ladder of rungs, each half as sensitive as the one before, so
+ * raw PDATA stays below APDS9930_AUTO_GAIN_HIGH:
+ *
+ *   rung   LED drive   pulses   gain
+ *     0    100 mA        8       8x    the driver defaults
+ *     1     50 mA        8       8x
+ *     2     25 mA        8       8x
+ *     3   12.5 mA        8       8x
+ *     4   12.5 mA        4       8x
+ *     5   12.5 mA        2       8x
+ *     6   12.5 mA        2       4x
+ *
+ * LED current and pulses go first because they save supply current. Gain
+ * saves nothing, so it is the last resort. A stair that reads low stays at
+ * rung 0 and keeps its full range, while a close one drops to the rung its
+ * reflection needs.
+ *
+ * update() shifts each reading left by the rung, so PDATA always comes out
+ * on the rung 0 scale and thresholds set for the defaults still hold. Above
+ * rung 0 this goes past 1023 and resolves what used to saturate.
+ *
+ * The controller moves one rung at a time. It steps down after
+ * APDS9930_AUTO_GAIN_DOWN_HOLD fresh readings in a row above the band, and
+ * steps up after APDS9930_AUTO_GAIN_UP_HOLD in a row below
+ * APDS9930_AUTO_GAIN_LOW. LOW is under half of HIGH, so a step up can't
+ * land above the band and start a cycle. The first fresh reading after a
+ * change may come from a conversion started under the old settings, so
+ * update() clears its PVALID bit.
+ *
+ * The PILT/PIHT interrupt thresholds compare raw PDATA, so every rung
+ * change rewrites them from the rung 0 values set with setIntThresholds().
+ * applyConfig() and init() put the sensor back on rung 0; call reset()
+ * after either.
+ */
+
+#ifndef APDS9930_AUTO_GAIN_H
+#define APDS9930_AUTO_GAIN_H
+
+#include <Arduino.h>
+
+#include "APDS9930.h"
+
+/* Target band for raw PDATA */
+#ifndef APDS9930_AUTO_GAIN_HIGH
+#define APDS9930_AUTO_GAIN_HIGH         800
+#endif
+#ifndef APDS9930_AUTO_GAIN_LOW
+#define APDS9930_AUTO_GAIN_LOW          300
+#endif
+
+/* Fresh readings in a row before a rung change: down fast to get off saturation, up slowly */
+#define APDS9930_AUTO_GAIN_DOWN_HOLD    2
+#define APDS9930_AUTO_GAIN_UP_HOLD      32
+
+#define APDS9930_AUTO_GAIN_RUNGS        7
+
+/* One sensitivity setting; each rung reads half what the one before it does */
+struct APDS9930AutoGainRung {
+    uint8_t drive;
+    uint8_t pulses;
+    uint8_t gain;
+};
+
+/* APDS9930AutoGain Class */
+class APDS9930AutoGain {
+public:
+    APDS9930AutoGain();
+    void reset();
+    bool update(APDS9930 &sensor, APDS9930Sample &sample);
+    uint8_t getRung() { return rung; }
+
+    /* Interrupt thresholds on the rung 0 scale, shared by every sensor */
+    static void setIntThresholds(uint16_t low, uint16_t high);
+    bool applyIntThresholds(APDS9930 &sensor);
+
+    /* In flash, read with pgm_read_byte() */
+    static const APDS9930AutoGainRung rungs[APDS9930_AUTO_GAIN_RUNGS];
+
+private:
+    bool applyRung(APDS9930 &sensor, uint8_t from);
+
+    uint8_t rung : 3;
+    uint8_t settling : 1;                   // the next fresh reading may predate the last change
+    uint8_t pending : 1;                    // a rung write failed, retry it on the next update
+    uint8_t above : 1;                      // count is of readings above the band, not below
+    uint8_t count;                          // fresh readings in a row outside the band
+
+    static uint16_t int_low;
+    static uint16_t int_high;
+};
+
+#ifdef APDS9930_HEADER_ONLY
+#include "APDS9930AutoGain_impl.h"
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ * @file    APDS9930AutoGain_impl.h
+ * @brief   Closed-loop proximity sensitivity for one APDS-9930: member definitions
+ *
+ * Compiled once in APDS9930AutoGain.cpp, or inlined into every caller with
+ * APDS9930_HEADER_ONLY (see APDS9930_impl.h). The rung table and the shared
+ * thresholds stay in APDS9930AutoGain.cpp either way.
+ */
+
+#ifndef APDS9930_AUTO_GAIN_IMPL_H
+#define APDS9930_AUTO_GAIN_IMPL_H
+
+#include <Arduino.h>
+
+#include "APDS9930AutoGain.h"
+
+/**
+ * @brief Constructor - starts on rung 0, where init() leaves the sensor
+ */
+APDS9930_INLINE APDS9930AutoGain::APDS9930AutoGain()
+{
+    reset();
+}
+
+/**
+ * @brief Forgets the controller state after the sensor went back to its defaults
+ */
+APDS9930_INLINE void APDS9930AutoGain::reset()
+{
+    rung = 0;
+    settling = 0;
+    pending = 0;
+    above = 0;
+    count = 0;
+}
+
+/**
+ * @brief Sets the proximity interrupt thresholds every sensor should hold
+ *
+ * Takes effect on each sensor at its next rung change, or at once with
+ * applyIntThresholds().
+ *
+ * @param[in] low PILT on the rung 0 scale
+ * @param[in] high PIHT on the rung 0 scale
+ */
+APDS9930_INLINE void APDS9930AutoGain::setIntThresholds(uint16_t low, uint16_t high)
+{
+    int_low = low;
+    int_high = high;
+}
+
+/**
+ * @brief Rescales a reading and moves the sensor along the ladder if it has left the band
+ *
+ * Call with every successful read. Stale readings (no PVALID) are rescaled
+ * but don't count toward a change.
+ *
+ * @param[in] sensor the sensor this controller belongs to, selected on the bus
+ * @param[in,out] sample the reading; pdata comes back on the rung 0 scale,
+ *                and PVALID is cleared while the settings are in flux
+ * @return True if operation successful. False if a register write failed;
+ *         it is retried on the next call.
+ */
+APDS9930_INLINE bool APDS9930AutoGain::update(APDS9930 &sensor, APDS9930Sample &sample)
+{
+    uint16_t raw = sample.pdata;
+    uint8_t from = rung;
+
+    sample.pdata = raw << rung;
+    if( pending ) {
+        sample.status &= ~APDS9930_PVALID;
+        if( !applyRung(sensor, APDS9930_AUTO_GAIN_RUNGS) ) {
+            return false;
+        }
+        pending = 0;
+        return true;
+    }
+    if( !(sample.status & APDS9930_PVALID) ) {
+        return true;
+    }
+    if( settling ) {
+        settling = 0;
+        sample.status &= ~APDS9930_PVALID;
+        return true;
+    }
+
+    if( raw > APDS9930_AUTO_GAIN_HIGH && rung < APDS9930_AUTO_GAIN_RUNGS - 1 ) {
+        count = above ? count + 1 : 1;
+        above = 1;
+        if( count < APDS9930_AUTO_GAIN_DOWN_HOLD ) {
+            return true;
+        }
+        rung = rung + 1;
+    } else if( raw < APDS9930_AUTO_GAIN_LOW && rung > 0 ) {
+        count = above ? 1 : count + 1;
+        above = 0;
+        if( count < APDS9930_AUTO_GAIN_UP_HOLD ) {
+            return true;
+        }
+        rung = rung - 1;
+    } else {
+        count = 0;
+        return true;
+    }
+
+    count = 0;
+    settling = 1;
+    if( !applyRung(sensor, from) ) {
+        pending = 1;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes the settings of the current rung that differ from rung `from`
+ *
+ * The interrupt thresholds are rewritten for the new rung (see
+ * applyIntThresholds()).
+ *
+ * @param[in] sensor the sensor, selected on the bus
+ * @param[in] from the rung the sensor is on, APDS9930_AUTO_GAIN_RUNGS to write everything
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930AutoGain::applyRung(APDS9930 &sensor, uint8_t from)
+{
+    const APDS9930AutoGainRung *next = &rungs[rung];
+    const APDS9930AutoGainRung *prev = &rungs[from < APDS9930_AUTO_GAIN_RUNGS ? from : rung];
+    bool all = from >= APDS9930_AUTO_GAIN_RUNGS;
+    uint8_t drive = pgm_read_byte(&next->drive);
+    uint8_t pulses = pgm_read_byte(&next->pulses);
+    uint8_t gain = pgm_read_byte(&next->gain);
+
+    if( (all || drive != pgm_read_byte(&prev->drive)) && !sensor.setLEDDrive(drive) ) {
+        return false;
+    }
+    if( (all || pulses != pgm_read_byte(&prev->pulses)) && !sensor.setProximityPulseCount(pulses) ) {
+        return false;
+    }
+    if( (all || gain != pgm_read_byte(&prev->gain)) && !sensor.setProximityGain(gain) ) {
+        return false;
+    }
+
+    return applyIntThresholds(sensor);
+}
+
+/**
+ * @brief Writes the interrupt thresholds, scaled to the rung the sensor is on
+ *
+ * Raw PDATA crosses them exactly where the rescaled value crosses the
+ * thresholds given to setIntThresholds().
+ *
+ * @param[in] sensor the sensor, selected on the bus
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930AutoGain::applyIntThresholds(APDS9930 &sensor)
+{
+    /* raw << rung < low exactly when raw < low / 2^rung rounded up; > high when raw > high / 2^rung rounded down */
+    if( !sensor.setProximityIntLowThreshold(((uint32_t)int_low + (1 << rung) - 1) >> rung) ) {
+        return false;
+    }
+
+    return sensor.setProximityIntHighThreshold(int_high >> rung);
+}
+
+#endif
@@ -0,0 +1,23 @@
+/**
+ * @file    APDS9930Mux.cpp
+ * @brief   APDS-9930 sensors behind a TCA9548A I2C multiplexer
+ *
+ * Static data, plus the member functions unless APDS9930_HEADER_ONLY
+ * inlines them (see APDS9930Mux_impl.h).
+ */
+
+#include "APDS9930Mux.h"
+
+const uint32_t APDS9930Mux::speeds[APDS9930_MUX_SPEEDS] PROGMEM = { 400000, 200000, 100000, 50000 };
+uint8_t APDS9930Mux::bus_speed = APDS9930_MUX_SPEED_UNKNOWN;
+
+#ifdef APDS9930_LEAN
+static_assert(APDS9930_MUX_SPEEDS <= 4 && APDS9930_MUX_ERROR_LIMIT <= 4,
+              "APDS9930_LEAN packs speed indexes and error counts into 2 bits");
+
+APDS9930 APDS9930Mux::apds;
+#endif
+
+#ifndef APDS9930_HEADER_ONLY
+#include "APDS9930Mux_impl.h"
+#endif
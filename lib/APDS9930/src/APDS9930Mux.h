@@ -0,0 +1,135 @@
+/**
+ * @file    APDS9930Mux.h
+ * @brief   APDS-9930 sensors behind a TCA9548A I2C multiplexer
+ *
+ * Every APDS-9930 answers at the fixed address 0x39, so each one sits on its
+ * own TCA9548A channel. This class tracks which channels are populated and
+ * which one is selected, so repeated accesses to the same sensor cost no
+ * extra select writes.
+ *
+ * The INT pins of all sensors behind one mux can share a single wired-OR GPIO.
+ * When that line fires, serviceInterrupt() walks only this mux's sensors.
+ * Like any read, it needs every other mux on the bus deselected first.
+ *
+ * The mux can enable several channels at once, and all the sensors share
+ * 0x39, so a write reaches every enabled sensor in one transaction. Reads
+ * still need a single channel. The broadcast methods only write, and they
+ * keep a shadow copy of ENABLE so a mode change doesn't have to read it back.
+ * A broadcast whose mask has no populated channel does nothing. begin()
+ * configures every sensor it finds with one broadcastConfig().
+ *
+ * Each channel also has its own I2C clock. characterize() steps the bus
+ * through APDS9930Mux::speeds on that route, reading the ID register and a
+ * data burst, and keeps the fastest speed with no errors, down to the
+ * slowest. The failed trials at each speed tried are kept per channel.
+ * Short cables run at 400 kHz while long rails drop to what they can carry.
+ * select() switches Wire's clock along with the channel. serviceInterrupt()
+ * visits channels grouped by speed. A channel that keeps failing at runtime
+ * drops one speed: serviceInterrupt() counts its own failures, and callers
+ * that read through sensor() report theirs with reportError(). retest(),
+ * called now and then, moves a route back up once it reads cleanly one
+ * speed faster.
+ *
+ * An instance holds 61 bytes of state. With APDS9930_LEAN (see APDS9930.h)
+ * the per-channel speeds and error counts pack into 2 bits each, the
+ * per-speed error counts aren't kept, the visiting order is worked out from
+ * the speeds instead of stored, and every mux shares one APDS9930 object,
+ * which is 8 bytes per mux.
+ */
+
+#ifndef APDS9930_MUX_H
+#define APDS9930_MUX_H
+
+#include <Arduino.h>
+
+#include "APDS9930.h"
+
+/* TCA9548A addresses and channel count */
+#define TCA9548A_I2C_ADDR       0x70
+#define TCA9548A_CHANNELS       8
+#define TCA9548A_NONE           0x00
+
+/* Per-route bus speeds, fastest first (the APDS-9930 tops out at 400 kHz) */
+#define APDS9930_MUX_SPEEDS         4
+#define APDS9930_MUX_DEFAULT_SPEED  2       // 100 kHz, what Wire.begin() sets
+#define APDS9930_MUX_SPEED_UNKNOWN  0xFF
+#define APDS9930_MUX_TRIALS         16      // ID + burst reads per speed in characterize()
+#define APDS9930_MUX_ERROR_LIMIT    4       // runtime errors before a route drops a speed
+#define APDS9930_MUX_RETEST_TRIALS  8       // read pairs retest() runs one speed up
+#define APDS9930_MUX_UNTESTED       0xFF
+
+/* APDS9930Mux Class */
+class APDS9930Mux {
+public:
+
+    /* Initialization methods */
+    APDS9930Mux(uint8_t mux_addr = TCA9548A_I2C_ADDR);
+    uint8_t begin(uint8_t channel_mask = 0xFF);
+    uint8_t getAddress() { return mux_addr; }
+    uint8_t getPopulated() { return populated; }
+
+    /* Channel selection */
+    bool select(uint8_t channel);
+    bool selectMask(uint8_t mask);
+    bool deselect();
+
+    /* Access to the sensor on the selected channel */
+    APDS9930 &sensor() { return apds; }
+
+    /* Broadcast writes to the populated channels in mask */
+    bool broadcastConfig(const APDS9930Config &config, uint8_t mask = 0xFF);
+    bool broadcastMode(uint8_t mode, uint8_t enable, uint8_t mask = 0xFF);
+    bool broadcastClearAllInts(uint8_t mask = 0xFF);
+
+    /* Per-route bus speed; speeds is in flash, read it with pgm_read_dword() */
+    static const uint32_t speeds[APDS9930_MUX_SPEEDS];
+    uint8_t characterize(uint8_t channel, uint8_t trials = APDS9930_MUX_TRIALS);
+    void characterizeAll(uint8_t trials = APDS9930_MUX_TRIALS);
+    bool retest(uint8_t channel, uint8_t trials = APDS9930_MUX_RETEST_TRIALS);
+    void reportError(uint8_t channel);
+    uint32_t getSpeed(uint8_t channel) { return pgm_read_dword(&speeds[routeSpeed(channel)]); }
+#ifndef APDS9930_LEAN
+    uint8_t getSpeedErrors(uint8_t channel, uint8_t index);
+#endif
+
+    /* Shared interrupt line service; other muxes must be deselected, this one is on return */
+    uint8_t serviceInterrupt(APDS9930Sample *samples);
+
+private:
+    void setBusSpeed(uint8_t index);
+    uint8_t trialErrors(uint8_t channel, uint8_t index, uint8_t trials);
+    void sortBySpeed();
+    uint8_t routeSpeed(uint8_t channel);
+    void setRouteSpeed(uint8_t channel, uint8_t index);
+    uint8_t routeErrors(uint8_t channel);
+    void setRouteErrors(uint8_t channel, uint8_t count);
+
+#ifdef APDS9930_LEAN
+    /* APDS9930 keeps no state of its own, so one object serves every mux */
+    static APDS9930 apds;
+#else
+    APDS9930 apds;
+#endif
+    uint8_t mux_addr;
+    uint8_t populated;
+    uint8_t selected;
+    uint8_t enable_reg;
+#ifdef APDS9930_LEAN
+    uint16_t speed_bits;                    // 2 bits per channel, index into speeds
+    uint16_t error_bits;                    // 2 bits per channel, errors since the last slowdown
+#else
+    uint8_t speed[TCA9548A_CHANNELS];
+    uint8_t errors[TCA9548A_CHANNELS];
+    uint8_t order[TCA9548A_CHANNELS];
+    uint8_t speed_errors[TCA9548A_CHANNELS][APDS9930_MUX_SPEEDS];  // failed trials, last test at each speed
+#endif
+
+    /* One Wire bus is shared by every mux on it */
+    static uint8_t bus_speed;
+};
+
+#ifdef APDS9930_HEADER_ONLY
+#include "APDS9930Mux_impl.h"
+#endif
+
+#endif
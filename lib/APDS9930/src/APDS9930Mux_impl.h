@@ -0,0 +1,529 @@
+/**
+ * @file    APDS9930Mux_impl.h
+ * @brief   APDS-9930 sensors behind a TCA9548A I2C multiplexer: member definitions
+ *
+ * Compiled once in APDS9930Mux.cpp, or inlined into every caller with
+ * APDS9930_HEADER_ONLY (see APDS9930_impl.h). The static data stays in
+ * APDS9930Mux.cpp either way.
+ */
+
+#ifndef APDS9930_MUX_IMPL_H
+#define APDS9930_MUX_IMPL_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "APDS9930Mux.h"
+
+/**
+ * @brief Constructor - Instantiates APDS9930Mux object
+ *
+ * @param[in] mux_addr I2C address of the TCA9548A (0x70-0x77)
+ */
+APDS9930_INLINE APDS9930Mux::APDS9930Mux(uint8_t mux_addr) :
+    mux_addr(mux_addr),
+    populated(0),
+    selected(TCA9548A_NONE),
+    enable_reg(0)
+#ifdef APDS9930_LEAN
+    , speed_bits(0),
+    error_bits(0)
+#endif
+{
+    uint8_t channel;
+#ifndef APDS9930_LEAN
+    uint8_t index;
+#endif
+
+    for( channel = 0; channel < TCA9548A_CHANNELS; channel++ ) {
+#ifndef APDS9930_LEAN
+        order[channel] = channel;
+        for( index = 0; index < APDS9930_MUX_SPEEDS; index++ ) {
+            speed_errors[channel][index] = APDS9930_MUX_UNTESTED;
+        }
+#endif
+        setRouteSpeed(channel, APDS9930_MUX_DEFAULT_SPEED);
+        setRouteErrors(channel, 0);
+    }
+}
+
+/**
+ * @brief Finds the APDS-9930s on the channels in channel_mask and configures them
+ *
+ * Each channel is probed with one ID read. Channels that don't answer are
+ * left out of the populated set, so broadcasts and interrupt service never
+ * spend bus time on them. The populated sensors then get the driver
+ * defaults in one broadcastConfig(), two writes for the whole mux instead
+ * of an init() per sensor, and one broadcastClearAllInts() drops any
+ * interrupt still latched from before a reset, which would otherwise hold
+ * the shared INT line low. Wire must already be started.
+ *
+ * @param[in] channel_mask bit n set to probe channel n
+ * @return Mask of channels with a working sensor
+ */
+APDS9930_INLINE uint8_t APDS9930Mux::begin(uint8_t channel_mask)
+{
+    uint8_t channel;
+    APDS9930Config config;
+
+    populated = 0;
+    for( channel = 0; channel < TCA9548A_CHANNELS; channel++ ) {
+        if( !(channel_mask & (1 << channel)) ) {
+            continue;
+        }
+        if( select(channel) && apds.probe() ) {
+            populated |= (1 << channel);
+        }
+    }
+    APDS9930::defaultConfig(config);
+    broadcastConfig(config, populated);
+    broadcastClearAllInts(populated);
+    characterizeAll();
+    deselect();
+
+    return populated;
+}
+
+/**
+ * @brief Routes the bus to a single channel
+ *
+ * @param[in] channel channel number (0-7)
+ * @return True if the channel is selected. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930Mux::select(uint8_t channel)
+{
+    if( channel >= TCA9548A_CHANNELS ) {
+        return false;
+    }
+
+    return selectMask(1 << channel);
+}
+
+/**
+ * @brief Routes the bus to every channel set in mask
+ *
+ * Skips the write if the mux is already in that state.
+ *
+ * @param[in] mask bit n set to enable channel n
+ * @return True if the mask is selected. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930Mux::selectMask(uint8_t mask)
+{
+    uint8_t channel;
+    uint8_t slowest = 0;
+
+    /* The select write still goes out over the old routes, at their speed */
+    if( mask != selected ) {
+        Wire.beginTransmission(mux_addr);
+        Wire.write(mask);
+        if( Wire.endTransmission() != 0 ) {
+            selected = TCA9548A_NONE;
+            return false;
+        }
+        selected = mask;
+    }
+
+    /* Then run as fast as the slowest newly connected route allows */
+    for( channel = 0; channel < TCA9548A_CHANNELS; channel++ ) {
+        if( (mask & (1 << channel)) && routeSpeed(channel) > slowest ) {
+            slowest = routeSpeed(channel);
+        }
+    }
+    setBusSpeed(mask ? slowest : bus_speed);
+
+    return true;
+}
+
+/**
+ * @brief Disconnects all downstream channels
+ *
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930Mux::deselect()
+{
+    return selectMask(TCA9548A_NONE);
+}
+
+/**
+ * @brief Writes a full register image to every selected sensor at once
+ *
+ * A write is ACKed if any enabled sensor ACKs it, so a missing sensor doesn't
+ * show up as a failure here. Use begin() to find populated channels.
+ *
+ * @param[in] config the register image (see APDS9930::defaultConfig)
+ * @param[in] mask channels to write; limited to populated channels
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930Mux::broadcastConfig(const APDS9930Config &config, uint8_t mask)
+{
+    /* With nothing selected the write would go nowhere, or to another mux's sensors */
+    if( !(mask & populated) ) {
+        return true;
+    }
+    if( !selectMask(mask & populated) ) {
+        return false;
+    }
+    if( !apds.applyConfig(config) ) {
+        return false;
+    }
+    enable_reg = config.regs[APDS9930_ENABLE];
+
+    return true;
+}
+
+/**
+ * @brief Enables or disables a feature on every selected sensor at once
+ *
+ * With ENABLE written last, this is how a synchronized conversion start
+ * is done: broadcastMode(PROXIMITY, ON) starts every sensor's cycle in the
+ * same bus transaction.
+ *
+ * @param[in] mode which feature to enable
+ * @param[in] enable ON (1) or OFF (0)
+ * @param[in] mask channels to write; limited to populated channels
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930Mux::broadcastMode(uint8_t mode, uint8_t enable, uint8_t mask)
+{
+    uint8_t reg_val;
+
+    if( !(mask & populated) ) {
+        return true;
+    }
+    if( !selectMask(mask & populated) ) {
+        return false;
+    }
+    reg_val = APDS9930::modeBits(enable_reg, mode, enable);
+    if( !apds.wireWriteDataByte(APDS9930_ENABLE, reg_val) ) {
+        return false;
+    }
+    enable_reg = reg_val;
+
+    return true;
+}
+
+/**
+ * @brief Clears ALS and proximity interrupts on every selected sensor at once
+ *
+ * @param[in] mask channels to write; limited to populated channels
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930Mux::broadcastClearAllInts(uint8_t mask)
+{
+    if( !(mask & populated) ) {
+        return true;
+    }
+    if( !selectMask(mask & populated) ) {
+        return false;
+    }
+
+    return apds.clearAllInts();
+}
+
+/**
+ * @brief Changes Wire's clock if it isn't already at speeds[index]
+ *
+ * @param[in] index into speeds
+ */
+APDS9930_INLINE void APDS9930Mux::setBusSpeed(uint8_t index)
+{
+    if( index == bus_speed || index >= APDS9930_MUX_SPEEDS ) {
+        return;
+    }
+    Wire.setClock(pgm_read_dword(&speeds[index]));
+    bus_speed = index;
+}
+
+/**
+ * @brief Runs read trials on a route at one bus speed
+ *
+ * Each trial is an ID register read and a STATUS..PDATA burst read. A NACK
+ * or short read fails the trial. The ID value isn't checked: probe() takes
+ * parts with an unknown ID, and those would otherwise fail at every speed. The channel is selected at the
+ * slowest speed, so the select itself can't fail because of the route
+ * being tested. The route keeps its own speed afterwards.
+ *
+ * @param[in] channel channel number (0-7), populated
+ * @param[in] index into speeds
+ * @param[in] trials read pairs to run
+ * @return Number of failed trials
+ */
+APDS9930_INLINE uint8_t APDS9930Mux::trialErrors(uint8_t channel, uint8_t index, uint8_t trials)
+{
+    uint8_t speed = routeSpeed(channel);
+    uint8_t errors = 0;
+    uint8_t trial;
+    uint8_t id;
+    APDS9930Sample sample;
+
+    setRouteSpeed(channel, APDS9930_MUX_SPEEDS - 1);
+    if( select(channel) ) {
+        setBusSpeed(index);
+    } else {
+        errors = trials;
+    }
+    for( trial = 0; trial < trials && errors < trials; trial++ ) {
+        if( !apds.wireReadDataByte(APDS9930_ID, id) || !apds.readSample(sample) ) {
+            errors++;
+        }
+    }
+    setRouteSpeed(channel, speed);
+#ifndef APDS9930_LEAN
+    speed_errors[channel][index] = errors;
+#endif
+
+    return errors;
+}
+
+/**
+ * @brief Finds the fastest bus speed a route handles without errors
+ *
+ * Runs `trials` read pairs at each speed, fastest first, and keeps the
+ * first speed with no failures. The error count of every speed tried is
+ * kept (see getSpeedErrors()). If even the slowest speed fails, the route
+ * runs at the slowest speed anyway and a warning is logged.
+ *
+ * @param[in] channel channel number (0-7)
+ * @param[in] trials read pairs per speed
+ * @return Index into speeds chosen for the channel
+ */
+APDS9930_INLINE uint8_t APDS9930Mux::characterize(uint8_t channel, uint8_t trials)
+{
+    uint8_t index;
+
+    if( channel >= TCA9548A_CHANNELS || !(populated & (1 << channel)) ) {
+        return APDS9930_MUX_DEFAULT_SPEED;
+    }
+
+    for( index = 0; index < APDS9930_MUX_SPEEDS; index++ ) {
+        if( trialErrors(channel, index, trials) == 0 ) {
+            break;
+        }
+    }
+    if( index == APDS9930_MUX_SPEEDS ) {
+        index = APDS9930_MUX_SPEEDS - 1;
+        APDS9930_WARN_HEX("APDS9930Mux route fails at every speed, channel ", channel);
+    }
+    setRouteSpeed(channel, index);
+    setRouteErrors(channel, 0);
+    sortBySpeed();
+    APDS9930_DEBUG_DEC("APDS9930Mux route speed, channel ", channel);
+
+    return index;
+}
+
+/**
+ * @brief Tries a route one speed faster than it runs now, and moves it up if it is clean
+ *
+ * The runtime counterpart of characterize(): reportError() slows a route
+ * down, and this lets it recover once the fault is gone. It costs `trials`
+ * read pairs on one route, so it is cheap enough to call between sweeps,
+ * one route at a time, every few seconds.
+ *
+ * @param[in] channel channel number (0-7)
+ * @param[in] trials read pairs to run
+ * @return True if the route moved to a faster speed
+ */
+APDS9930_INLINE bool APDS9930Mux::retest(uint8_t channel, uint8_t trials)
+{
+    uint8_t index;
+
+    if( channel >= TCA9548A_CHANNELS || !(populated & (1 << channel)) || routeSpeed(channel) == 0 ) {
+        return false;
+    }
+    index = routeSpeed(channel) - 1;
+    if( trialErrors(channel, index, trials) != 0 ) {
+        return false;
+    }
+    setRouteSpeed(channel, index);
+    setRouteErrors(channel, 0);
+    sortBySpeed();
+    APDS9930_DEBUG_DEC("APDS9930Mux route sped up, channel ", channel);
+
+    return true;
+}
+
+/**
+ * @brief Characterizes every populated channel
+ *
+ * begin() calls this. Afterwards, retest() brings back speed that
+ * reportError() took away, one route at a time.
+ *
+ * @param[in] trials read pairs per speed
+ */
+APDS9930_INLINE void APDS9930Mux::characterizeAll(uint8_t trials)
+{
+    uint8_t channel;
+
+    for( channel = 0; channel < TCA9548A_CHANNELS; channel++ ) {
+        if( populated & (1 << channel) ) {
+            characterize(channel, trials);
+        }
+    }
+}
+
+/**
+ * @brief Orders channels fastest first, so a sweep changes clock at most once per speed
+ *
+ * With APDS9930_LEAN there is no stored order; serviceInterrupt() walks
+ * the channels once per speed instead.
+ */
+APDS9930_INLINE void APDS9930Mux::sortBySpeed()
+{
+#ifndef APDS9930_LEAN
+    uint8_t i;
+    uint8_t j;
+    uint8_t channel;
+
+    for( i = 1; i < TCA9548A_CHANNELS; i++ ) {
+        channel = order[i];
+        for( j = i; j > 0 && speed[order[j - 1]] > speed[channel]; j-- ) {
+            order[j] = order[j - 1];
+        }
+        order[j] = channel;
+    }
+#endif
+}
+
+/**
+ * @brief Counts a failed transfer on a route and slows it after repeated errors
+ *
+ * serviceInterrupt() calls this itself. Code that reads a sensor directly
+ * (select() and sensor()) calls it when the select or the read fails.
+ *
+ * @param[in] channel channel number (0-7)
+ */
+APDS9930_INLINE void APDS9930Mux::reportError(uint8_t channel)
+{
+    uint8_t count;
+
+    if( channel >= TCA9548A_CHANNELS ) {
+        return;
+    }
+    count = routeErrors(channel) + 1;
+    if( count < APDS9930_MUX_ERROR_LIMIT ) {
+        setRouteErrors(channel, count);
+        return;
+    }
+    setRouteErrors(channel, 0);
+    if( routeSpeed(channel) < APDS9930_MUX_SPEEDS - 1 ) {
+        setRouteSpeed(channel, routeSpeed(channel) + 1);
+        sortBySpeed();
+        APDS9930_DEBUG_DEC("APDS9930Mux route slowed, channel ", channel);
+    }
+}
+
+#ifndef APDS9930_LEAN
+/**
+ * @brief Failed trials at one speed the last time the route was tested there
+ *
+ * @param[in] channel channel number (0-7)
+ * @param[in] index into speeds
+ * @return Failed trials, or APDS9930_MUX_UNTESTED
+ */
+APDS9930_INLINE uint8_t APDS9930Mux::getSpeedErrors(uint8_t channel, uint8_t index)
+{
+    if( channel >= TCA9548A_CHANNELS || index >= APDS9930_MUX_SPEEDS ) {
+        return APDS9930_MUX_UNTESTED;
+    }
+
+    return speed_errors[channel][index];
+}
+#endif
+
+/**
+ * @brief Per-channel state accessors, packed 2 bits per channel with APDS9930_LEAN
+ */
+APDS9930_INLINE uint8_t APDS9930Mux::routeSpeed(uint8_t channel)
+{
+#ifdef APDS9930_LEAN
+    return (speed_bits >> (2 * channel)) & 0x03;
+#else
+    return speed[channel];
+#endif
+}
+
+APDS9930_INLINE void APDS9930Mux::setRouteSpeed(uint8_t channel, uint8_t index)
+{
+#ifdef APDS9930_LEAN
+    speed_bits = (speed_bits & ~(0x03 << (2 * channel))) | ((uint16_t)index << (2 * channel));
+#else
+    speed[channel] = index;
+#endif
+}
+
+APDS9930_INLINE uint8_t APDS9930Mux::routeErrors(uint8_t channel)
+{
+#ifdef APDS9930_LEAN
+    return (error_bits >> (2 * channel)) & 0x03;
+#else
+    return errors[channel];
+#endif
+}
+
+APDS9930_INLINE void APDS9930Mux::setRouteErrors(uint8_t channel, uint8_t count)
+{
+#ifdef APDS9930_LEAN
+    error_bits = (error_bits & ~(0x03 << (2 * channel))) | ((uint16_t)count << (2 * channel));
+#else
+    errors[channel] = count;
+#endif
+}
+
+/**
+ * @brief Finds, reads and clears the sensors that pulled the shared INT line
+ *
+ * For each populated channel this does one select and one STATUS..PDATA
+ * burst (readSample()), so a sensor that fired has its data in hand from
+ * the same transfer. Only those sensors then get a clearAllInts(). The cost
+ * is one burst per sensor on this mux plus one write per sensor that fired.
+ *
+ * Every sensor answers at 0x39, so every other mux on the bus must be
+ * deselected before this is called; this mux is deselected again on
+ * return, so servicing the muxes one after another is safe.
+ *
+ * @param[out] samples array of TCA9548A_CHANNELS entries, filled for fired channels
+ * @return Mask of channels whose interrupt was serviced
+ */
+APDS9930_INLINE uint8_t APDS9930Mux::serviceInterrupt(APDS9930Sample *samples)
+{
+    uint8_t i;
+    uint8_t channel;
+    APDS9930Sample sample;
+    uint8_t fired = 0;
+
+#ifdef APDS9930_LEAN
+    /* One pass per speed, fastest first */
+    for( i = 0; i < APDS9930_MUX_SPEEDS * TCA9548A_CHANNELS; i++ ) {
+        channel = i % TCA9548A_CHANNELS;
+        if( routeSpeed(channel) != i / TCA9548A_CHANNELS ) {
+            continue;
+        }
+#else
+    for( i = 0; i < TCA9548A_CHANNELS; i++ ) {
+        channel = order[i];
+#endif
+        if( !(populated & (1 << channel)) ) {
+            continue;
+        }
+        if( !select(channel) || !apds.readSample(sample) ) {
+            reportError(channel);
+            continue;
+        }
+        if( !(sample.status & (APDS9930_PINT | APDS9930_AINT)) ) {
+            continue;
+        }
+
+        samples[channel] = sample;
+        if( apds.clearAllInts() ) {
+            fired |= (1 << channel);
+        } else {
+            reportError(channel);
+        }
+    }
+    deselect();
+
+    return fired;
+}
+
+#endif
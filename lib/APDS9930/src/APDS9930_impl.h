@@ -1,6 +1,6 @@
 /**
- * @file    APDS-9930.cpp
- * @brief   Library for the SparkFun APDS-9930 breakout board
+ * @file    APDS9930_impl.h
+ * @brief   Library for the SparkFun APDS-9930 breakout board: member definitions
  * @author  Shawn Hymel (SparkFun Electronics)
  *
  * @copyright	This code is public domain but you buy me a beer if you use
@@ -14,17 +14,26 @@
  *   Off:                   1mA
  *   Waiting for gesture:   14mA
  *   Gesture in progress:   35mA
+ *
+ * APDS9930.cpp compiles these once. With APDS9930_HEADER_ONLY, APDS9930.h
+ * includes them as inline functions instead, so every caller sees them.
  */
- 
- #include <Arduino.h>
- #include <Wire.h>
- 
- #include "APDS9930.h"
+
+#ifndef APDS9930_IMPL_H
+#define APDS9930_IMPL_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "APDS9930.h"
+
+/* ALS gain multiplier for each AGAIN setting */
+static const uint8_t als_gains[4] PROGMEM = { 1, 8, 16, 120 };
  
 /**
  * @brief Constructor - Instantiates APDS9930 object
  */
-APDS9930::APDS9930()
+APDS9930_INLINE APDS9930::APDS9930()
 {
 
 }
@@ -32,7 +41,7 @@ APDS9930::APDS9930()
 /**
  * @brief Destructor
  */
-APDS9930::~APDS9930()
+APDS9930_INLINE APDS9930::~APDS9930()
 {
 
 }
@@ -42,27 +51,18 @@ APDS9930::~APDS9930()
  *
  * @return True if initialized successfully. False otherwise.
  */
-bool APDS9930::init()
+APDS9930_INLINE bool APDS9930::init()
 {
-    uint8_t id;
-
     /* Initialize I2C */
     Wire.begin();
      
-    /* Read ID register and check against known values for APDS-9930 */
-    if( !wireReadDataByte(APDS9930_ID, id) ) {
-        Serial.println(F("ID read"));
+    if( !probe() ) {
         return false;
     }
-    if( !(id == APDS9930_ID_1 || id == APDS9930_ID_2) ) {
-        Serial.println(F("ID check"));
-        Serial.println(String("ID is ") + String(id, HEX));
-        //return false;
-    }
      
     /* Set ENABLE register to 0 (disable all features) */
     if( !setMode(ALL, OFF) ) {
-        Serial.println(F("Regs off"));
+        APDS9930_ERROR("Regs off");
         return false;
     }
     
@@ -113,6 +113,31 @@ bool APDS9930::init()
     return true;
 }
 
+/**
+ * @brief Checks that a sensor answers, without touching its registers
+ *
+ * Reads the ID register. An unknown ID is only a warning.
+ * Wire must already be started.
+ *
+ * @return True if the ID register could be read. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930::probe()
+{
+    uint8_t id;
+
+    /* Read ID register and check against known values for APDS-9930 */
+    if( !wireReadDataByte(APDS9930_ID, id) ) {
+        APDS9930_ERROR("ID read");
+        return false;
+    }
+    if( !(id == APDS9930_ID_1 || id == APDS9930_ID_2) ) {
+        APDS9930_WARN_HEX("ID check, ID is ", id);
+        //return false;
+    }
+
+    return true;
+}
+
 /*******************************************************************************
  * Public methods for controlling the APDS-9930
  ******************************************************************************/
@@ -122,7 +147,7 @@ bool APDS9930::init()
  *
  * @return Contents of the ENABLE register. 0xFF if error.
  */
-uint8_t APDS9930::getMode()
+APDS9930_INLINE uint8_t APDS9930::getMode()
 {
     uint8_t enable_value;
     
@@ -141,7 +166,7 @@ uint8_t APDS9930::getMode()
  * @param[in] enable ON (1) or OFF (0)
  * @return True if operation success. False otherwise.
  */
-bool APDS9930::setMode(uint8_t mode, uint8_t enable)
+APDS9930_INLINE bool APDS9930::setMode(uint8_t mode, uint8_t enable)
 {
     uint8_t reg_val;
 
@@ -152,8 +177,28 @@ bool APDS9930::setMode(uint8_t mode, uint8_t enable)
     }
     
     /* Change bit(s) in ENABLE register */
+    reg_val = modeBits(reg_val, mode, enable);
+        
+    /* Write value back to ENABLE register */
+    if( !wireWriteDataByte(APDS9930_ENABLE, reg_val) ) {
+        return false;
+    }
+        
+    return true;
+}
+
+/**
+ * @brief Computes a new ENABLE register value without touching the device
+ *
+ * @param[in] reg_val current ENABLE register value
+ * @param[in] mode which feature to enable
+ * @param[in] enable ON (1) or OFF (0)
+ * @return The ENABLE value with the feature's bit(s) changed
+ */
+APDS9930_INLINE uint8_t APDS9930::modeBits(uint8_t reg_val, uint8_t mode, uint8_t enable)
+{
     enable = enable & 0x01;
-    if( mode >= 0 && mode <= 6 ) {
+    if( mode <= 6 ) {
         if (enable) {
             reg_val |= (1 << mode);
         } else {
@@ -166,13 +211,57 @@ bool APDS9930::setMode(uint8_t mode, uint8_t enable)
             reg_val = 0x00;
         }
     }
-        
-    /* Write value back to ENABLE register */
-    if( !wireWriteDataByte(APDS9930_ENABLE, reg_val) ) {
+
+    return reg_val;
+}
+
+/**
+ * @brief Fills a register image with the same defaults init() writes
+ *
+ * ENABLE is left at 0 (everything off).
+ *
+ * @param[out] config the register image
+ */
+APDS9930_INLINE void APDS9930::defaultConfig(APDS9930Config &config)
+{
+    config.regs[APDS9930_ENABLE] = 0;
+    config.regs[APDS9930_ATIME] = DEFAULT_ATIME;
+    config.regs[APDS9930_PTIME] = DEFAULT_PTIME;
+    config.regs[APDS9930_WTIME] = DEFAULT_WTIME;
+    config.regs[APDS9930_AILTL] = DEFAULT_AILT & 0x00FF;
+    config.regs[APDS9930_AILTH] = (DEFAULT_AILT & 0xFF00) >> 8;
+    config.regs[APDS9930_AIHTL] = DEFAULT_AIHT & 0x00FF;
+    config.regs[APDS9930_AIHTH] = (DEFAULT_AIHT & 0xFF00) >> 8;
+    config.regs[APDS9930_PILTL] = DEFAULT_PILT & 0x00FF;
+    config.regs[APDS9930_PILTH] = (DEFAULT_PILT & 0xFF00) >> 8;
+    config.regs[APDS9930_PIHTL] = DEFAULT_PIHT & 0x00FF;
+    config.regs[APDS9930_PIHTH] = (DEFAULT_PIHT & 0xFF00) >> 8;
+    config.regs[APDS9930_PERS] = DEFAULT_PERS;
+    config.regs[APDS9930_CONFIG] = DEFAULT_CONFIG;
+    config.regs[APDS9930_PPULSE] = DEFAULT_PPULSE;
+    config.regs[APDS9930_CONTROL] = (DEFAULT_PDRIVE << 6) | (DEFAULT_PDIODE << 4) |
+                                    (DEFAULT_PGAIN << 2) | DEFAULT_AGAIN;
+}
+
+/**
+ * @brief Writes ATIME through CONTROL in one auto-increment transaction, then ENABLE
+ *
+ * ENABLE goes last, in its own write, so an image with PON/PEN set starts
+ * its conversions only once the timing, thresholds and gains are in place.
+ * Nothing is read back, so this also works as a broadcast write to several
+ * sensors selected at once (see APDS9930Mux). POFFSET is per-sensor
+ * calibration and is not part of the image.
+ *
+ * @param[in] config the register image
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930::applyConfig(const APDS9930Config &config)
+{
+    if( !wireWriteDataBlock(APDS9930_ATIME, &config.regs[APDS9930_ATIME], APDS9930_CONFIG_LEN - 1) ) {
         return false;
     }
-        
-    return true;
+
+    return wireWriteDataByte(APDS9930_ENABLE, config.regs[APDS9930_ENABLE]);
 }
 
 /**
@@ -181,7 +270,7 @@ bool APDS9930::setMode(uint8_t mode, uint8_t enable)
  * @param[in] interrupts true to enable hardware interrupt on high or low light
  * @return True if sensor enabled correctly. False on error.
  */
-bool APDS9930::enableLightSensor(bool interrupts)
+APDS9930_INLINE bool APDS9930::enableLightSensor(bool interrupts)
 {
     
     /* Set default gain, interrupts, enable power, and enable sensor */
@@ -213,7 +302,7 @@ bool APDS9930::enableLightSensor(bool interrupts)
  *
  * @return True if sensor disabled correctly. False on error.
  */
-bool APDS9930::disableLightSensor()
+APDS9930_INLINE bool APDS9930::disableLightSensor()
 {
     if( !setAmbientLightIntEnable(0) ) {
         return false;
@@ -231,7 +320,7 @@ bool APDS9930::disableLightSensor()
  * @param[in] interrupts true to enable hardware external interrupt on proximity
  * @return True if sensor enabled correctly. False on error.
  */
-bool APDS9930::enableProximitySensor(bool interrupts)
+APDS9930_INLINE bool APDS9930::enableProximitySensor(bool interrupts)
 {
     /* Set default gain, LED, interrupts, enable power, and enable sensor */
     if( !setProximityGain(DEFAULT_PGAIN) ) {
@@ -264,7 +353,7 @@ bool APDS9930::enableProximitySensor(bool interrupts)
  *
  * @return True if sensor disabled correctly. False on error.
  */
-bool APDS9930::disableProximitySensor()
+APDS9930_INLINE bool APDS9930::disableProximitySensor()
 {
 	if( !setProximityIntEnable(0) ) {
 		return false;
@@ -281,7 +370,7 @@ bool APDS9930::disableProximitySensor()
  *
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::enablePower()
+APDS9930_INLINE bool APDS9930::enablePower()
 {
     if( !setMode(POWER, 1) ) {
         return false;
@@ -295,7 +384,7 @@ bool APDS9930::enablePower()
  *
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::disablePower()
+APDS9930_INLINE bool APDS9930::disablePower()
 {
     if( !setMode(POWER, 0) ) {
         return false;
@@ -314,7 +403,7 @@ bool APDS9930::disablePower()
  * @param[out] val value of the light sensor.
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::readAmbientLightLux(float &val)
+APDS9930_INLINE bool APDS9930::readAmbientLightLux(float &val)
 {
     uint16_t Ch0;
     uint16_t Ch1;
@@ -333,7 +422,7 @@ bool APDS9930::readAmbientLightLux(float &val)
     return true;
 }
 
-bool APDS9930::readAmbientLightLux(unsigned long &val)
+APDS9930_INLINE bool APDS9930::readAmbientLightLux(unsigned long &val)
 {
     uint16_t Ch0;
     uint16_t Ch1;
@@ -352,27 +441,33 @@ bool APDS9930::readAmbientLightLux(unsigned long &val)
     return true;
 }
 
-float APDS9930::floatAmbientToLux(uint16_t Ch0, uint16_t Ch1)
+APDS9930_INLINE float APDS9930::floatAmbientToLux(uint16_t Ch0, uint16_t Ch1)
 {
-	uint8_t x[4]={1,8,16,120};
+    uint8_t gain = getAmbientLightGain();
+    if( gain >= sizeof(als_gains) ) {
+        return 0;
+    }
     float ALSIT = 2.73 * (256 - DEFAULT_ATIME);
     float iac  = max(Ch0 - ALS_B * Ch1, ALS_C * Ch0 - ALS_D * Ch1);
     if (iac < 0) iac = 0;
-	float lpc  = GA * DF / (ALSIT * x[getAmbientLightGain()]);
+	float lpc  = GA * DF / (ALSIT * pgm_read_byte(&als_gains[gain]));
     return iac * lpc;
 }
 
-unsigned long APDS9930::ulongAmbientToLux(uint16_t Ch0, uint16_t Ch1)
+APDS9930_INLINE unsigned long APDS9930::ulongAmbientToLux(uint16_t Ch0, uint16_t Ch1)
 {
-	uint8_t x[4]={1,8,16,120};
+    uint8_t gain = getAmbientLightGain();
+    if( gain >= sizeof(als_gains) ) {
+        return 0;
+    }
     unsigned long ALSIT = 2.73 * (256 - DEFAULT_ATIME);
-    unsigned long iac  = max(Ch0 - ALS_B * Ch1, ALS_C * Ch0 - ALS_D * Ch1);
+    long iac  = max(Ch0 - ALS_B * Ch1, ALS_C * Ch0 - ALS_D * Ch1);
 	if (iac < 0) iac = 0;
-    unsigned long lpc  = GA * DF / (ALSIT * x[getAmbientLightGain()]);
+    unsigned long lpc  = GA * DF / (ALSIT * pgm_read_byte(&als_gains[gain]));
     return iac * lpc;
 }
 
-bool APDS9930::readCh0Light(uint16_t &val)
+APDS9930_INLINE bool APDS9930::readCh0Light(uint16_t &val)
 {
     uint8_t val_byte;
     val = 0;
@@ -389,7 +484,7 @@ bool APDS9930::readCh0Light(uint16_t &val)
     return true;
 }
 
-bool APDS9930::readCh1Light(uint16_t &val)
+APDS9930_INLINE bool APDS9930::readCh1Light(uint16_t &val)
 {
     uint8_t val_byte;
     val = 0;
@@ -406,6 +501,65 @@ bool APDS9930::readCh1Light(uint16_t &val)
     return true;
 }
 
+/*******************************************************************************
+ * Status and burst reads
+ ******************************************************************************/
+
+/**
+ * @brief Reads the STATUS register
+ *
+ * @param[out] status contents of STATUS (AVALID, PVALID, AINT, PINT bits)
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930::readStatus(uint8_t &status)
+{
+    return wireReadDataByte(APDS9930_STATUS, status);
+}
+
+/**
+ * @brief Reads STATUS, both ALS channels and PDATA in one I2C transaction
+ *
+ * @param[out] sample the register values
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930::readSample(APDS9930Sample &sample)
+{
+    uint8_t buf[APDS9930_SAMPLE_LEN];
+
+    if( wireReadDataBlock(APDS9930_STATUS, buf, APDS9930_SAMPLE_LEN) != APDS9930_SAMPLE_LEN ) {
+        return false;
+    }
+    sample.status = buf[0];
+    sample.ch0 = buf[1] | ((uint16_t)buf[2] << 8);
+    sample.ch1 = buf[3] | ((uint16_t)buf[4] << 8);
+    sample.pdata = buf[5] | ((uint16_t)buf[6] << 8);
+
+    return true;
+}
+
+/**
+ * @brief Reads both ALS channels and PDATA in one I2C transaction
+ *
+ * Use after readStatus() when the status byte is already known; sample.status
+ * is left untouched.
+ *
+ * @param[out] sample the register values
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930::readData(APDS9930Sample &sample)
+{
+    uint8_t buf[APDS9930_SAMPLE_LEN - 1];
+
+    if( wireReadDataBlock(APDS9930_Ch0DATAL, buf, sizeof(buf)) != (int)sizeof(buf) ) {
+        return false;
+    }
+    sample.ch0 = buf[0] | ((uint16_t)buf[1] << 8);
+    sample.ch1 = buf[2] | ((uint16_t)buf[3] << 8);
+    sample.pdata = buf[4] | ((uint16_t)buf[5] << 8);
+
+    return true;
+}
+
 /*******************************************************************************
  * Proximity sensor controls
  ******************************************************************************/
@@ -416,7 +570,7 @@ bool APDS9930::readCh1Light(uint16_t &val)
  * @param[out] val value of the proximity sensor.
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::readProximity(uint16_t &val)
+APDS9930_INLINE bool APDS9930::readProximity(uint16_t &val)
 {
     val = 0;
     uint8_t val_byte;
@@ -443,7 +597,7 @@ bool APDS9930::readProximity(uint16_t &val)
  *
  * @return lower threshold
  */
-uint16_t APDS9930::getProximityIntLowThreshold()
+APDS9930_INLINE uint16_t APDS9930::getProximityIntLowThreshold()
 {
     uint16_t val;
     uint8_t val_byte;
@@ -467,7 +621,7 @@ uint16_t APDS9930::getProximityIntLowThreshold()
  * @param[in] threshold the lower proximity threshold
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setProximityIntLowThreshold(uint16_t threshold)
+APDS9930_INLINE bool APDS9930::setProximityIntLowThreshold(uint16_t threshold)
 {
     uint8_t lo;
     uint8_t hi;
@@ -489,7 +643,7 @@ bool APDS9930::setProximityIntLowThreshold(uint16_t threshold)
  *
  * @return high threshold
  */
-uint16_t APDS9930::getProximityIntHighThreshold()
+APDS9930_INLINE uint16_t APDS9930::getProximityIntHighThreshold()
 {
     uint16_t val;
     uint8_t val_byte;
@@ -513,7 +667,7 @@ uint16_t APDS9930::getProximityIntHighThreshold()
  * @param[in] threshold the high proximity threshold
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setProximityIntHighThreshold(uint16_t threshold)
+APDS9930_INLINE bool APDS9930::setProximityIntHighThreshold(uint16_t threshold)
 {
     uint8_t lo;
     uint8_t hi;
@@ -541,7 +695,7 @@ bool APDS9930::setProximityIntHighThreshold(uint16_t threshold)
  *
  * @return the value of the LED drive strength. 0xFF on failure.
  */
-uint8_t APDS9930::getLEDDrive()
+APDS9930_INLINE uint8_t APDS9930::getLEDDrive()
 {
     uint8_t val;
     
@@ -568,7 +722,7 @@ uint8_t APDS9930::getLEDDrive()
  * @param[in] drive the value (0-3) for the LED drive strength
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setLEDDrive(uint8_t drive)
+APDS9930_INLINE bool APDS9930::setLEDDrive(uint8_t drive)
 {
     uint8_t val;
     
@@ -591,6 +745,37 @@ bool APDS9930::setLEDDrive(uint8_t drive)
     return true;
 }
 
+/**
+ * @brief Returns the number of LED pulses per proximity conversion
+ *
+ * @return The PPULSE register (0-255). 0xFF if error.
+ */
+APDS9930_INLINE uint8_t APDS9930::getProximityPulseCount()
+{
+    uint8_t val;
+
+    /* Read value from PPULSE register */
+    if( !wireReadDataByte(APDS9930_PPULSE, val) ) {
+        return ERROR;
+    }
+
+    return val;
+}
+
+/**
+ * @brief Sets the number of LED pulses per proximity conversion
+ *
+ * PDATA and the LED's share of the supply current both scale with the
+ * pulse count.
+ *
+ * @param[in] pulses the pulse count (DEFAULT_PPULSE at init)
+ * @return True if operation successful. False otherwise.
+ */
+APDS9930_INLINE bool APDS9930::setProximityPulseCount(uint8_t pulses)
+{
+    return wireWriteDataByte(APDS9930_PPULSE, pulses);
+}
+
 /**
  * @brief Returns receiver gain for proximity detection
  *
@@ -602,7 +787,7 @@ bool APDS9930::setLEDDrive(uint8_t drive)
  *
  * @return the value of the proximity gain. 0xFF on failure.
  */
-uint8_t APDS9930::getProximityGain()
+APDS9930_INLINE uint8_t APDS9930::getProximityGain()
 {
     uint8_t val;
     
@@ -629,7 +814,7 @@ uint8_t APDS9930::getProximityGain()
  * @param[in] drive the value (0-3) for the gain
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setProximityGain(uint8_t drive)
+APDS9930_INLINE bool APDS9930::setProximityGain(uint8_t drive)
 {
     uint8_t val;
     
@@ -663,7 +848,7 @@ bool APDS9930::setProximityGain(uint8_t drive)
  *
  * @return the selected diode. 0xFF on failure.
  */
-uint8_t APDS9930::getProximityDiode()
+APDS9930_INLINE uint8_t APDS9930::getProximityDiode()
 {
     uint8_t val;
     
@@ -690,7 +875,7 @@ uint8_t APDS9930::getProximityDiode()
  * @param[in] drive the value (0-3) for the diode
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setProximityDiode(uint8_t drive)
+APDS9930_INLINE bool APDS9930::setProximityDiode(uint8_t drive)
 {
     uint8_t val;
     
@@ -724,7 +909,7 @@ bool APDS9930::setProximityDiode(uint8_t drive)
  *
  * @return the value of the ALS gain. 0xFF on failure.
  */
-uint8_t APDS9930::getAmbientLightGain()
+APDS9930_INLINE uint8_t APDS9930::getAmbientLightGain()
 {
     uint8_t val;
     
@@ -751,7 +936,7 @@ uint8_t APDS9930::getAmbientLightGain()
  * @param[in] drive the value (0-3) for the gain
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setAmbientLightGain(uint8_t drive)
+APDS9930_INLINE bool APDS9930::setAmbientLightGain(uint8_t drive)
 {
     uint8_t val;
     
@@ -779,7 +964,7 @@ bool APDS9930::setAmbientLightGain(uint8_t drive)
  * @param[out] threshold current low threshold stored on the APDS-9930
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::getLightIntLowThreshold(uint16_t &threshold)
+APDS9930_INLINE bool APDS9930::getLightIntLowThreshold(uint16_t &threshold)
 {
     uint8_t val_byte;
     threshold = 0;
@@ -805,7 +990,7 @@ bool APDS9930::getLightIntLowThreshold(uint16_t &threshold)
  * @param[in] threshold low threshold value for interrupt to trigger
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setLightIntLowThreshold(uint16_t threshold)
+APDS9930_INLINE bool APDS9930::setLightIntLowThreshold(uint16_t threshold)
 {
     uint8_t val_low;
     uint8_t val_high;
@@ -833,7 +1018,7 @@ bool APDS9930::setLightIntLowThreshold(uint16_t threshold)
  * @param[out] threshold current low threshold stored on the APDS-9930
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::getLightIntHighThreshold(uint16_t &threshold)
+APDS9930_INLINE bool APDS9930::getLightIntHighThreshold(uint16_t &threshold)
 {
     uint8_t val_byte;
     threshold = 0;
@@ -859,7 +1044,7 @@ bool APDS9930::getLightIntHighThreshold(uint16_t &threshold)
  * @param[in] threshold high threshold value for interrupt to trigger
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setLightIntHighThreshold(uint16_t threshold)
+APDS9930_INLINE bool APDS9930::setLightIntHighThreshold(uint16_t threshold)
 {
     uint8_t val_low;
     uint8_t val_high;
@@ -887,7 +1072,7 @@ bool APDS9930::setLightIntHighThreshold(uint16_t threshold)
  *
  * @return 1 if interrupts are enabled, 0 if not. 0xFF on error.
  */
-uint8_t APDS9930::getAmbientLightIntEnable()
+APDS9930_INLINE uint8_t APDS9930::getAmbientLightIntEnable()
 {
     uint8_t val;
     
@@ -908,7 +1093,7 @@ uint8_t APDS9930::getAmbientLightIntEnable()
  * @param[in] enable 1 to enable interrupts, 0 to turn them off
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setAmbientLightIntEnable(uint8_t enable)
+APDS9930_INLINE bool APDS9930::setAmbientLightIntEnable(uint8_t enable)
 {
     uint8_t val;
     
@@ -936,7 +1121,7 @@ bool APDS9930::setAmbientLightIntEnable(uint8_t enable)
  *
  * @return 1 if interrupts are enabled, 0 if not. 0xFF on error.
  */
-uint8_t APDS9930::getProximityIntEnable()
+APDS9930_INLINE uint8_t APDS9930::getProximityIntEnable()
 {
     uint8_t val;
     
@@ -957,7 +1142,7 @@ uint8_t APDS9930::getProximityIntEnable()
  * @param[in] enable 1 to enable interrupts, 0 to turn them off
  * @return True if operation successful. False otherwise.
  */
-bool APDS9930::setProximityIntEnable(uint8_t enable)
+APDS9930_INLINE bool APDS9930::setProximityIntEnable(uint8_t enable)
 {
     uint8_t val;
     
@@ -985,7 +1170,7 @@ bool APDS9930::setProximityIntEnable(uint8_t enable)
  *
  * @return True if operation completed successfully. False otherwise.
  */
-bool APDS9930::clearAmbientLightInt()
+APDS9930_INLINE bool APDS9930::clearAmbientLightInt()
 {
     if( !wireWriteByte(CLEAR_ALS_INT) ) {
         return false;
@@ -999,7 +1184,7 @@ bool APDS9930::clearAmbientLightInt()
  *
  * @return True if operation completed successfully. False otherwise.
  */
-bool APDS9930::clearProximityInt()
+APDS9930_INLINE bool APDS9930::clearProximityInt()
 {
     if( !wireWriteByte(CLEAR_PROX_INT) ) {
         return false;
@@ -1013,7 +1198,7 @@ bool APDS9930::clearProximityInt()
  *
  * @return True if operation completed successfully. False otherwise.
  */
-bool APDS9930::clearAllInts()
+APDS9930_INLINE bool APDS9930::clearAllInts()
 {
     if( !wireWriteByte(CLEAR_ALL_INTS) ) {
         return false;
@@ -1032,7 +1217,7 @@ bool APDS9930::clearAllInts()
  * @param[in] val the 1-byte value to write to the I2C device
  * @return True if successful write operation. False otherwise.
  */
-bool APDS9930::wireWriteByte(uint8_t val)
+APDS9930_INLINE bool APDS9930::wireWriteByte(uint8_t val)
 {
     Wire.beginTransmission(APDS9930_I2C_ADDR);
     Wire.write(val);
@@ -1050,7 +1235,7 @@ bool APDS9930::wireWriteByte(uint8_t val)
  * @param[in] val the 1-byte value to write to the I2C device
  * @return True if successful write operation. False otherwise.
  */
-bool APDS9930::wireWriteDataByte(uint8_t reg, uint8_t val)
+APDS9930_INLINE bool APDS9930::wireWriteDataByte(uint8_t reg, uint8_t val)
 {
     Wire.beginTransmission(APDS9930_I2C_ADDR);
     Wire.write(reg | AUTO_INCREMENT);
@@ -1070,8 +1255,8 @@ bool APDS9930::wireWriteDataByte(uint8_t reg, uint8_t val)
  * @param[in] len the length (in bytes) of the data to write
  * @return True if successful write operation. False otherwise.
  */
-bool APDS9930::wireWriteDataBlock(  uint8_t reg, 
-                                        uint8_t *val, 
+APDS9930_INLINE bool APDS9930::wireWriteDataBlock(  uint8_t reg, 
+                                        const uint8_t *val, 
                                         unsigned int len)
 {
     unsigned int i;
@@ -1079,7 +1264,6 @@ bool APDS9930::wireWriteDataBlock(  uint8_t reg,
     Wire.beginTransmission(APDS9930_I2C_ADDR);
     Wire.write(reg | AUTO_INCREMENT);
     for(i = 0; i < len; i++) {
-        Wire.beginTransmission(APDS9930_I2C_ADDR);
         Wire.write(val[i]);
     }
     if( Wire.endTransmission() != 0 ) {
@@ -1096,7 +1280,7 @@ bool APDS9930::wireWriteDataBlock(  uint8_t reg,
  * @param[out] the value returned from the register
  * @return True if successful read operation. False otherwise.
  */
-bool APDS9930::wireReadDataByte(uint8_t reg, uint8_t &val)
+APDS9930_INLINE bool APDS9930::wireReadDataByte(uint8_t reg, uint8_t &val)
 {
     
     /* Indicate which register we want to read from */
@@ -1104,11 +1288,11 @@ bool APDS9930::wireReadDataByte(uint8_t reg, uint8_t &val)
         return false;
     }
     
-    /* Read from register */
-    Wire.requestFrom(APDS9930_I2C_ADDR, 1);
-    while (Wire.available()) {
-        val = Wire.read();
+    /* Read from register; a NACK or short read leaves val untouched */
+    if( Wire.requestFrom(APDS9930_I2C_ADDR, 1) != 1 || !Wire.available() ) {
+        return false;
     }
+    val = Wire.read();
 
     return true;
 }
@@ -1122,7 +1306,7 @@ bool APDS9930::wireReadDataByte(uint8_t reg, uint8_t &val)
  * @param[in] len number of bytes to read
  * @return Number of bytes read. -1 on read error.
  */
-int APDS9930::wireReadDataBlock(   uint8_t reg, 
+APDS9930_INLINE int APDS9930::wireReadDataBlock(   uint8_t reg, 
                                         uint8_t *val, 
                                         unsigned int len)
 {
@@ -1144,4 +1328,6 @@ int APDS9930::wireReadDataBlock(   uint8_t reg,
     }
 
     return i;
-}
\ No newline at end of file
+}
+
+#endif
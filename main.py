@@ -3,13 +3,24 @@
 import time
 from vl53l0x_multiplexer import VL53L0XMultiplexer
 from rpi_ws281x import PixelStrip, Color
-from bluetooth_audio import setup_bluetooth_audio
+from bluetooth_audio import AudioWorker, setup_bluetooth_audio
+from sample_log import SampleLogWriter
+from stair_pipeline import (StairPipeline, TRIGGER_DISTANCE, STAIR_MAPPING, STAIR_LED_COUNTS,
+                            LED_COUNT, get_led_count_for_stair, fade_stair_leds)
 import os
 import colorsys
 import numpy as np
 from scipy.io import wavfile
 import json
+import signal
 import subprocess
+import tracing
+from realtime import configure_thread, lock_memory
+from event_loop import EventLoop
+from stair_bus import StairBus, STAIR_BUS_GROUP
+from sensor_prober import SensorProber
+from sensor_health import HealthMonitor
+from device_inventory import DeviceInventory
 
 # LED strip configuration
 LED_PIN = 18          # GPIO18 (PWM0) - DO NOT use TXD/GPIO14
@@ -22,62 +33,49 @@ LED_INVERT = False    # True to invert the signal
 # Distance configuration (in millimeters)
 MAX_DISTANCE = 2000.0  # Distance at which LED starts to change color (2 meters)
 MIN_DISTANCE = 200.0   # Distance at which LED reaches maximum intensity
-TRIGGER_DISTANCE = 609.6  # 24 inches in mm - when to consider "triggered"
-
-# Mapping of multiplexer channels to stair numbers
-# Format: {global_channel: stair_number}
-# Use None for unconnected channels
-STAIR_MAPPING = {
-    0: 9,    # Multiplexer 1, Channel 0 -> Stair 9
-    1: 10,    # Multiplexer 1, Channel 1 -> Stair 10
-    2: None,    # Multiplexer 1, Channel 2 -> NOT CONNECTED
-    3: None,    # Multiplexer 1, Channel 3 -> NOT CONNECTED
-    4: 11,    # Multiplexer 1, Channel 4 -> Stair 11
-    5: 12,    # Multiplexer 1, Channel 5 -> Stair 12
-    6: 13,    # Multiplexer 1, Channel 6 -> Stair 13
-    7: 14,    # Multiplexer 1, Channel 7 -> Stair 14
-
-    8: 1,    # Multiplexer 2, Channel 0 -> Stair 1
-    9: 2,   # Multiplexer 2, Channel 1 -> Stair 2
-    10: 3,  # Multiplexer 2, Channel 2 -> Stair 3
-    11: 4,  # Multiplexer 2, Channel 3 -> Stair 4
-    12: 5,  # Multiplexer 2, Channel 4 -> Stair 5
-    13: 6,  # Multiplexer 2, Channel 5 -> Stair 6
-    14: 7,  # Multiplexer 2, Channel 6 -> Stair 7
-    15: 8,  # Multiplexer 2, Channel 7 -> Stair 8
-}
+# TRIGGER_DISTANCE and the stair layout live in stair_pipeline.py
 
-# Mapping of stair numbers to their LED counts
-# Format: {stair_number: led_count}
-# Default is 114 LEDs per stair if not specified
-STAIR_LED_COUNTS = {
-    1: 114,   # Stair 1: 
-    2: 114,   # Stair 2: 
-    3: 114,   # Stair 3: 
-    4: 114,   # Stair 4: 
-    5: 114,   # Stair 5: 
-    6: 112,   # Stair 6: 
-    7: 112,   # Stair 7: 
-    8: 114,   # Stair 8: 
-    9: 112,   # Stair 9: 
-    10: 114,  # Stair 10:
-    11: 114,  # Stair 11:
-    12: 114,  # Stair 12:
-    13: 114,  # Stair 13:
-    14: 114,  # Stair 14:
-}
-LED_COUNT = sum(STAIR_LED_COUNTS.values())
+# TCA9548A muxes on the bus (up to 8, 0x70-0x77), and muxes cascaded behind a
+# mux channel: {"parent route": [mux addresses]}, e.g. {"0x70:7": [0x74]}.
+# Cascaded channels are numbered after the bus-level ones, 8 per mux.
+TCA_ADDRESSES = [0x70, 0x77]
+MUX_CASCADES = {}
 
-def get_led_count_for_stair(stair_number):
-    """Get the number of LEDs for a given stair number.
-    
-    Args:
-        stair_number: The stair number to look up
-        
-    Returns:
-        int: Number of LEDs for the stair (defaults to 130 if not specified)
-    """
-    return STAIR_LED_COUNTS.get(stair_number, 130)
+# Binary sample log (render it with view_samples.py)
+SAMPLE_LOG_PATH = "logs/samples.bin"
+
+# Optional VL53L0X GPIO1 (data ready) lines, one per channel: {global_channel: GPIO line offset}
+# Channels listed here run in continuous mode and are read when their line
+# falls; all other channels are polled round-robin from the sweep timer.
+# None are wired on the current install, so every sensor is polled.
+SENSOR_INT_PINS = {}
+GPIO_CHIP = "/dev/gpiochip0"
+
+# LED fades advance one step per frame. show() starts a DMA transfer and returns, but first
+# waits for the previous one; a full strip is ~48ms of wire time (LED_COUNT * 24 bits at 800kHz).
+# Frames no faster than that never block the event loop in show()
+LED_FRAME_INTERVAL = 0.05
+
+# Which channels hold sensors, and their settings; speeds up startup after the first run
+INVENTORY_PATH = "logs/inventory.json"
+
+# Per-sensor health counters, rewritten every HEALTH_INTERVAL seconds
+HEALTH_PATH = "logs/health.json"
+HEALTH_INTERVAL = 10.0
+
+# Latency trace: recording starts with TRACE_ENABLED or on SIGUSR2 (kill -USR2 <pid>),
+# which also stops it. SIGUSR1 writes the rings to TRACE_PATH; open it in chrome://tracing
+TRACE_PATH = "logs/trace.json"
+TRACE_ENABLED = False
+
+# Controllers sharing one staircase exchange stair edges over UDP multicast
+# (stair_bus.py). Give each controller a unique node id 0-255, or None to run
+# standalone. Remote edges drive this controller's LED segments and audio.
+STAIR_BUS_NODE = None
+STAIR_BUS_INTERFACE = "0.0.0.0"  # Local address of the network the controllers share
+
+# Bluetooth speaker for the stair sounds, or None to run without audio
+AUDIO_DEVICE = "JBL GO 2+"
 
 def test_led_strip(strip):
     """Test the LED strip by fading in each stair sequentially with a cold-to-hot color gradient.
@@ -289,80 +287,6 @@ def cycle_all_leds(strip, hue):
         strip.setPixelColor(i, Color(r, g, b))
     strip.show()
 
-def print_sensor_status_table(active_sensors, sensor_states, current_distances):
-    """Print a formatted table of all sensor statuses."""
-    print("\033[2J\033[H")  # Clear screen and move cursor to top
-    print("Sensor Status Table:")
-    print("┌─────────────┬─────────────┬────────────┬──────────┬───────────┬──────────┐")
-    print("│ Multiplexer │   Channel   │ Connected  │ Distance │ Triggered │   Stair  │")
-    print("├─────────────┼─────────────┼────────────┼──────────┼───────────┼──────────┤")
-    
-    # Create a list of channels with their stair numbers for sorting
-    channels_with_stairs = []
-    for channel in range(16):
-        mux_num = channel // 8 + 1
-        local_channel = channel % 8
-        is_active = channel in active_sensors
-        distance = current_distances.get(channel, None)
-        is_triggered = sensor_states.get(channel, False)
-        stair_num = STAIR_MAPPING.get(channel, None)
-        
-        # Add to list with stair number for sorting
-        channels_with_stairs.append((channel, mux_num, local_channel, is_active, distance, is_triggered, stair_num))
-    
-    # Sort by stair number (descending), with None values at the end
-    channels_with_stairs.sort(key=lambda x: (x[6] is None, -x[6] if x[6] is not None else 0))
-    
-    # Print sorted rows
-    for channel, mux_num, local_channel, is_active, distance, is_triggered, stair_num in channels_with_stairs:
-        status = "Yes" if is_active else "No "
-        distance_str = f"{distance:.1f}mm" if distance is not None else "---"
-        triggered_str = "Yes" if is_triggered else "No "
-        stair_str = str(stair_num) if stair_num is not None else "---"
-        
-        print(f"│     {mux_num}       │     {local_channel}       │    {status}    │ {distance_str:>8} │    {triggered_str}    │   {stair_str:>4}   │")
-    
-    print("└─────────────┴─────────────┴────────────┴──────────┴───────────┴──────────┘")
-    print(f"\nTrigger threshold: {TRIGGER_DISTANCE:.1f}mm")
-
-def fade_stair_leds(strip, stair_num, target_brightness, fade_steps=10, fade_delay=0.001):
-    """Fade a stair's LEDs to a target brightness level.
-    
-    Args:
-        strip: LED strip object
-        stair_num: Stair number to fade
-        target_brightness: Target brightness (0-255)
-        fade_steps: Number of steps for fade
-        fade_delay: Delay between steps in seconds
-    """
-    if strip is None or stair_num not in STAIR_LED_COUNTS:
-        return
-        
-    # Calculate LED range for this stair
-    start_led = sum(STAIR_LED_COUNTS[i] for i in range(1, stair_num))
-    end_led = start_led + STAIR_LED_COUNTS[stair_num] - 1
-    
-    # Get current brightness of first LED in stair (assuming all LEDs in stair have same brightness)
-    current_color = strip.getPixelColor(start_led)
-    current_brightness = max(
-        (current_color >> 16) & 0xFF,  # Red
-        (current_color >> 8) & 0xFF,   # Green
-        current_color & 0xFF           # Blue
-    )
-    
-    # Calculate step size
-    step_size = (target_brightness - current_brightness) / fade_steps
-    
-    # Fade to target brightness
-    for step in range(fade_steps):
-        brightness = int(current_brightness + (step_size * (step + 1)))
-        color = Color(brightness, 0, brightness)  # Purple color with current brightness
-        
-        for i in range(start_led, end_led + 1):
-            strip.setPixelColor(i, color)
-        strip.show()
-        time.sleep(fade_delay)
-
 def set_volume_to_max():
     """Set the Raspberry Pi's volume to maximum."""
     try:
@@ -380,114 +304,216 @@ def get_sound_file_for_stair(stair_num):
     """Get the path to the harp sound file for a given stair number."""
     return f"stair_sounds/harp/harp{stair_num:02d}.wav"
 
+def toggle_tracing(signum):
+    """Start or stop recording trace points; the rings keep what was recorded."""
+    tracing.enabled = not tracing.enabled
+    print(f"Latency tracing {'on' if tracing.enabled else 'off'}")
+
 def main():
     
     # Create multiplexer instance
     print("Initializing VL53L0X multiplexer...")
-    multiplexer = VL53L0XMultiplexer()
+    multiplexer = VL53L0XMultiplexer(tca_addresses=TCA_ADDRESSES, cascades=MUX_CASCADES)
+    inventory = DeviceInventory(INVENTORY_PATH)
+    gone = inventory.prune(multiplexer.channels())
+    if gone:
+        print(f"Dropped channels {gone} from the device inventory: no mux route reaches them")
+    multiplexer.calibration.update(inventory.calibration())
     
     # Initialize LED strip
     print("Initializing LED strip...")
     strip = init_led_strip()
     
-    # Test LED strip if initialized successfully
-    if strip is not None:
-        test_led_strip(strip)
+    # The test pattern and settle wait are for checking wiring on a fresh
+    # install; once an inventory exists the known sensors come straight up
+    if inventory:
+        print(f"Device inventory lists channels {inventory.known_channels()}, skipping test pattern")
     else:
-        print("Skipping LED initialization and test pattern")
-    
-    print("Waiting 5 seconds to start the main loop")
-    time.sleep(5)
-    last_update = time.time()
-    last_table_update = 0  # Track when we last updated the table
-    table_update_interval = 0.05  # Update table 20 times per second
+        if strip is not None:
+            test_led_strip(strip)
+        else:
+            print("Skipping LED initialization and test pattern")
+        print("Waiting 5 seconds to start the main loop")
+        time.sleep(5)
+
+    # All waiting happens in one epoll set: sweep and LED frame timers, sensor
+    # interrupt lines, cross-thread wakeups and shutdown signals
+    loop = EventLoop()
+    tracing.enabled = TRACE_ENABLED
+    loop.add_signal_handlers({
+        signal.SIGINT: loop.stop,
+        signal.SIGTERM: loop.stop,
+        signal.SIGUSR1: lambda signum: print(
+            f"Wrote {tracing.dump_chrome_trace(TRACE_PATH)} trace events to {TRACE_PATH}"),
+        signal.SIGUSR2: toggle_tracing,
+    })
+
+    # Lock memory before the logging thread starts so its stack is locked and prefaulted too
+    lock_memory()
+    sample_log = SampleLogWriter(SAMPLE_LOG_PATH, STAIR_MAPPING, TRIGGER_DISTANCE, multiplexer.num_channels)
     update_interval = 0.01  # 10ms refresh rate (100Hz)
-    sensor_retry_interval = 5.0  # How often to retry initializing sensors
-    last_sensor_init = 0
     active_sensors = []  # List of working sensor channel numbers
-    current_sensor_idx = 0  # Index into active_sensors for round-robin reading
-    
-    # Dictionaries to track sensor states and current distances
-    sensor_states = {}  # channel -> triggered state
+    polled_sensors = []  # Active sensors without an interrupt line, read round-robin
+    current_sensor_idx = 0  # Index into polled_sensors for round-robin reading
+    
+    # Sounds play on the audio thread; results come back through the loop's eventfd.
+    # Started after the signal handlers, so SDL's threads inherit the blocked mask too
+    audio = None
+    if AUDIO_DEVICE is not None:
+        audio = AudioWorker(setup_bluetooth_audio(AUDIO_DEVICE), loop)
+
+    # Trigger filter, LED fades and audio for each sample
+    pipeline = StairPipeline(strip, audio, frame_driven=True)
     current_distances = {}  # channel -> current distance
-    
+    health = HealthMonitor()  # Per-sensor error, NACK, stuck and bus time stats
+
+    def handle_reading(channel):
+        nonlocal current_sensor_idx
+        start = time.monotonic()
+        distance = multiplexer.read_range(channel)
+        quarantine = health.record(channel, distance, multiplexer.last_error.pop(channel, None),
+                                   time.monotonic() - start)
+
+        # Update distance in tracking dictionary
+        current_distances[channel] = distance
+        sample_log.record(channel, distance, distance is not None and distance < TRIGGER_DISTANCE)
+
+        if distance is not None and not quarantine:
+            state = pipeline.process_sample(channel, distance)
+            if state is not None:
+                if not frame_timer.armed:
+                    frame_timer.arm()
+                # Landing sensors and spare channels map to no stair and have nothing to share
+                stair = pipeline.stair_mapping.get(channel)
+                if bus is not None and stair is not None:
+                    bus.edge(stair, state)
+        elif quarantine:
+            # Take the sensor out of the sweep; the prober brings it back after the quarantine
+            print(f"Quarantining sensor on channel {channel} for {quarantine:.0f}s")
+            active_sensors.remove(channel)
+            if channel in polled_sensors:
+                polled_sensors.remove(channel)
+            pipeline.remove_sensor(channel)
+            current_distances.pop(channel, None)
+            if len(polled_sensors) > 0:
+                current_sensor_idx = current_sensor_idx % len(polled_sensors)
+            else:
+                sweep_timer.disarm()
+            prober.mark_missing(channel, quarantine)
+
+    def on_sweep_tick(expirations):
+        nonlocal current_sensor_idx
+        # One read per tick: slots lost to a long read or a sensor init are counted, not caught up
+        health.record_tick(expirations)
+        if len(polled_sensors) == 0:
+            return
+        # Read from next sensor in round-robin fashion
+        channel = polled_sensors[current_sensor_idx]
+        current_sensor_idx = (current_sensor_idx + 1) % len(polled_sensors)
+        handle_reading(channel)
+
+    def on_frame_tick(expirations):
+        if not pipeline.render_frame():
+            frame_timer.disarm()
+
+    def on_remote_edge(node, stair, state, t_us):
+        # t_us is on the sender's clock, so it is not used here.
+        # A stair seen by more than one controller stays lit until all release it
+        if not state and bus.triggered(stair):
+            return
+        pipeline.apply_edge(stair, state)
+        if not frame_timer.armed:
+            frame_timer.arm()
+
+    def on_sensor_interrupt():
+        for event in int_request.read_edge_events():
+            channel = int_pin_channels.get(event.line_offset)
+            if channel in active_sensors:
+                handle_reading(channel)
+
+    def bring_online(channel):
+        model_id = multiplexer.read_model_id(channel)
+        entry = inventory.channels.get(channel)
+        if entry is not None and model_id is not None and model_id != entry["id"]:
+            # A different part on a known channel: the saved settings were the old one's
+            print(f"Sensor on channel {channel} reports ID {model_id}, inventory has {entry['id']}; "
+                  f"re-initializing with default settings")
+            multiplexer.calibration.pop(channel, None)
+            if not multiplexer.init_sensor(channel):
+                prober.mark_missing(channel)
+                return
+        if entry is None or model_id is not None:
+            # Saves only if the route, ID or settings changed
+            inventory.record(channel, multiplexer.route(channel), "VL53L0X", model_id,
+                             multiplexer.calibration.get(channel))
+        active_sensors.append(channel)
+        health.mark_online(channel)
+        pipeline.add_sensor(channel)
+        if channel in SENSOR_INT_PINS and multiplexer.start_continuous(channel):
+            return
+        polled_sensors.append(channel)
+        # Interrupt-driven sensors need no polling, so with none to poll the sweep timer stays off
+        if not sweep_timer.armed:
+            sweep_timer.arm()
+
+    def init_all_sensors():
+        print("\nTrying to initialize sensors...")
+        known = inventory.known_channels()
+        for channel in multiplexer.channels():
+            if known and channel not in known:
+                # Not in the inventory: verified lazily by the background prober
+                prober.mark_missing(channel)
+            elif multiplexer.init_sensor(channel):
+                bring_online(channel)
+            else:
+                prober.mark_missing(channel)
+        if len(active_sensors) == 0:
+            print("\nNo working sensors found. Probing in the background...")
+
+    sweep_timer = loop.add_timer(update_interval, on_sweep_tick, start=False)
+    frame_timer = loop.add_timer(LED_FRAME_INTERVAL, on_frame_tick, start=False)
+    # Missing or dropped sensors are re-probed in the gaps between sweep reads
+    prober = SensorProber(multiplexer, loop, sweep_timer, bring_online)
+    loop.add_timer(HEALTH_INTERVAL, lambda expirations: health.write(HEALTH_PATH))
+
+    bus = None
+    if STAIR_BUS_NODE is not None:
+        # Room for two edges per local stair between flushes
+        bus = StairBus(STAIR_BUS_NODE, on_remote_edge, group=STAIR_BUS_GROUP, interface=STAIR_BUS_INTERFACE,
+                       max_pending=2 * len(STAIR_LED_COUNTS))
+        loop.add_reader(bus.fd, bus.poll)
+        # Local edges leave once per LED frame, batched into one datagram
+        loop.add_timer(LED_FRAME_INTERVAL, lambda expirations: bus.flush())
+        print(f"Sharing stair edges as node {STAIR_BUS_NODE} on {STAIR_BUS_GROUP}")
+
+    int_request = None
+    int_pin_channels = {pin: channel for channel, pin in SENSOR_INT_PINS.items()}
+    if SENSOR_INT_PINS:
+        import gpiod
+        from gpiod.line import Bias, Edge
+        int_request = gpiod.request_lines(GPIO_CHIP, consumer="crazy-stairs", config={
+            tuple(int_pin_channels): gpiod.LineSettings(edge_detection=Edge.FALLING, bias=Bias.PULL_UP)})
+        loop.add_reader(int_request.fd, on_sensor_interrupt)
+
     print("\nInitializing sensors...")
-    
+    configure_thread("sensor")
+    init_all_sensors()
+
     try:
-        while True:
-            current_time = time.time()
-            
-            # Try to initialize sensors if we don't have any working ones
-            if len(active_sensors) == 0 and current_time - last_sensor_init >= sensor_retry_interval:
-                print("\nTrying to initialize sensors...")
-                
-                # Try each channel one at a time
-                for channel in range(16):
-                    mux_num = channel // 8 + 1
-                    local_channel = channel % 8
-                    if multiplexer.init_sensor(channel):
-                        active_sensors.append(channel)
-                        sensor_states[channel] = False
-                
-                if len(active_sensors) == 0:
-                    print("\nNo working sensors found. Will retry in 5 seconds...")
-                
-                last_sensor_init = current_time
-                continue
-            
-            # Only update if we have working sensors and enough time has passed
-            if len(active_sensors) > 0 and current_time - last_update >= update_interval:
-                # Read from next sensor in round-robin fashion
-                channel = active_sensors[current_sensor_idx]
-                distance = multiplexer.read_range(channel)
-                
-                # Update distance in tracking dictionary
-                current_distances[channel] = distance
-                
-                if distance is not None:
-                    # Update trigger state
-                    was_triggered = sensor_states[channel]
-                    is_triggered = distance < TRIGGER_DISTANCE
-                    
-                    # If state changed, update LED and play sound
-                    if is_triggered != was_triggered:
-                        sensor_states[channel] = is_triggered
-                        
-                        # Get corresponding stair number
-                        stair_num = STAIR_MAPPING.get(channel)
-                        if stair_num is not None and strip is not None:
-                            if is_triggered:
-                                # Fade in over 0.5 seconds (50 steps, 10ms delay)
-                                fade_stair_leds(strip, stair_num, 255, fade_steps=5, fade_delay=0.01)
-                            else:
-                                # Fade out slowly (20 steps, 2ms delay)
-                                fade_stair_leds(strip, stair_num, 0, fade_steps=5, fade_delay=0.002)
-                else:
-                    # If we got an invalid reading, remove this sensor from active list
-                    active_sensors.remove(channel)
-                    sensor_states.pop(channel, None)
-                    current_distances.pop(channel, None)
-                    if len(active_sensors) > 0:
-                        current_sensor_idx = current_sensor_idx % len(active_sensors)
-                    continue
-                
-                # Move to next sensor
-                current_sensor_idx = (current_sensor_idx + 1) % len(active_sensors)
-                last_update = current_time
-                
-                # Update status table at regular intervals
-                if current_time - last_table_update >= table_update_interval:
-                    print_sensor_status_table(active_sensors, sensor_states, current_distances)
-                    last_table_update = current_time
-            else:
-                # Small sleep to prevent CPU hogging
-                time.sleep(0.001)  # 1ms sleep
-            
-    except KeyboardInterrupt:
+        loop.run()
         print("\nExiting...")
         if strip is not None:
             clear_all_lights(strip)
             strip.show()
+    finally:
+        if int_request is not None:
+            int_request.release()
+        if audio is not None:
+            audio.close()
+        loop.close()
+        if bus is not None:
+            bus.close()
+        sample_log.close()
 
 if __name__ == "__main__":
     main() 
\ No newline at end of file
@@ -0,0 +1,415 @@
+#!/usr/bin/env python3
+
+import argparse
+import binascii
+import errno
+import math
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import threading
+import time
+import tty
+
+import avr_bench
+from crowd_sim import Crowd, SimulatedArray, SimulatedMultiplexer
+from phasing import measure_interference, plan_groups
+from sim_apds9930 import (APDS9930_ATIME, APDS9930_CONTROL, APDS9930_I2C_ADDR, APDS9930_PERS, APDS9930_PIHTL,
+                          APDS9930_PPULSE, NO_TARGET, PON, PROX_K, SPECIAL_FN, proximity_scale)
+from stair_pipeline import TRIGGER_DISTANCE
+from stream_decoder import (STREAM_FRAME_SAMPLES, STREAM_FRAME_INFO, STREAM_FRAME_EDGES, STREAM_FRAME_STATS,
+                            STREAM_HEADER_FORMAT, STREAM_HEADER_LEN, STREAM_SAMPLE_FORMAT, STREAM_MUX_FORMAT,
+                            STREAM_EDGE_FORMAT, STREAM_STATS_FORMAT, STREAM_STATUS_ERROR, config_commands)
+
+LEDS_PER_STAIR = 114
+
+NATIVE_PROGRAM = ".pio/build/{env}/program"
+NATIVE_SOURCES = ["src", "src/native", "lib/APDS9930/src"]
+NATIVE_FLAGS = ["-O2", "-pthread", "-Iinclude", "-Isrc/native", "-Ilib/APDS9930/src", "-DSTREAM_LED_NATIVE",
+                "-DSTREAM_DUAL_CORE", "-DSTREAM_MUXES=0x70,0x71,0x72,0x73,0x74,0x75,0x76,0x77"]
+NATIVE_INT_PINS = (2, 3, 4, 5, 6, 7, 8, 9)  # one INT line per mux in STREAM_MUXES, as in the native-int env
+NATIVE_ENV_FLAGS = {"native": [], "native-bench": ["-DSTREAM_BENCH"], "native-lean": ["-DAPDS9930_LEAN"],
+                    "native-inline": ["-DAPDS9930_HEADER_ONLY"],
+                    "native-int": [f"-DSTREAM_INT_PINS={','.join(map(str, NATIVE_INT_PINS))}"]}
+ADVANCE_INTERVAL = 0.0005           # seconds between device model updates; well under one conversion
+FAULT_ONSET = 1.0                   # seconds before an injected route fault starts, so boot characterizes it clean
+# Driver defaults that begin()'s broadcastConfig() writes and nothing changes later (not the power-on values)
+CONFIG_DEFAULTS = {APDS9930_ATIME: 0xED, APDS9930_PERS: 0x22}
+
+
+def build_native(program=None, env="native"):
+    """Build a native env of the firmware: with PlatformIO if it is installed, else with g++ directly."""
+    program = program or NATIVE_PROGRAM.format(env=env)
+    if shutil.which("pio"):
+        subprocess.run(["pio", "run", "-e", env], check=True)
+        return program
+    sources = [os.path.join(d, f) for d in NATIVE_SOURCES for f in sorted(os.listdir(d)) if f.endswith(".cpp")]
+    os.makedirs(os.path.dirname(program), exist_ok=True)
+    subprocess.run(["g++", *NATIVE_FLAGS, *NATIVE_ENV_FLAGS[env], *sources, "-o", program], check=True)
+    return program
+
+
+def cobs_decode(data):
+    """Reference COBS decoder for one frame, without the 0x00 delimiter.
+
+    Returns:
+        bytes: Decoded frame, or None if the encoding is broken
+    """
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        code = data[pos]
+        if code == 0 or pos + code > len(data) + (code == 1):
+            return None
+        out += data[pos + 1:pos + code]
+        pos += code
+        if code < 0xFF and pos < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def parse_frame(raw):
+    """Split a decoded frame into its header and entries after checking the CRC.
+
+    Returns:
+        tuple: (type, seq, t_us, entries) or None if the frame is corrupt. For
+        sample frames entries are (channel, status, pdata, dt_us) tuples, for
+        edge frames (channel, state, dt_us), for stats frames (sweeps, LED
+        frames, dropped edges, worst sweep us, worst frame us), and for info
+        frames (mux address, populated mask).
+    """
+    if raw is None or len(raw) < STREAM_HEADER_LEN + 2:
+        return None
+    crc, = struct.unpack_from("<H", raw, len(raw) - 2)
+    if binascii.crc_hqx(raw[:-2], 0xFFFF) != crc:
+        return None
+    frame_type, seq, t_us, count = struct.unpack_from(STREAM_HEADER_FORMAT, raw)
+    entry = {STREAM_FRAME_SAMPLES: STREAM_SAMPLE_FORMAT, STREAM_FRAME_EDGES: STREAM_EDGE_FORMAT,
+             STREAM_FRAME_STATS: STREAM_STATS_FORMAT}.get(frame_type, STREAM_MUX_FORMAT)
+    if STREAM_HEADER_LEN + count * struct.calcsize(entry) + 2 != len(raw):
+        return None
+    return frame_type, seq, t_us, list(struct.iter_unpack(entry, raw[STREAM_HEADER_LEN:-2]))
+
+
+class DeviceServer:
+    """Answers the native firmware's Wire requests from a simulated APDS-9930 array.
+
+    The firmware runs in real time, so the device model is advanced on the
+    wall clock. A Crowd walks the stairs so proximity readings actually move.
+
+    A fault makes reads of one sensor fail whenever the bus clock is above
+    a limit, from FAULT_ONSET seconds in, like a rail that goes marginal
+    after boot. The firmware has to find that out at runtime.
+
+    Each mux's sensors share a wired-OR INT line, read on NATIVE_INT_PINS.
+    Interrupt clears sent to a single sensor are counted by whether that
+    sensor had actually fired.
+    """
+
+    def __init__(self, proc, array, crowd, fault=None):
+        self.proc = proc
+        self.array = array
+        self.bus = array.buses[0]
+        self.crowd = crowd
+        self.start = time.monotonic()
+        self.advanced = -1.0
+        self.transactions = 0
+        self.fault = fault          # (sensor, highest clock it still reads at) or None
+        self.fault_errors = 0
+        self.fault_clock = None     # clock of the faulty sensor's last good read
+        self.int_cleared = 0        # clears of a sensor that had fired
+        self.int_spurious = 0       # clears of a sensor that hadn't
+
+    def _advance(self):
+        now = time.monotonic() - self.start
+        if now - self.advanced < ADVANCE_INTERVAL:
+            return
+        self.advanced = now
+        if self.crowd is not None:
+            self.crowd.update(now)
+            occupied = self.crowd.distances(now)
+            for index, sensor in enumerate(self.array.sensors):
+                sensor.target_distance = occupied.get(index, NO_TARGET)
+        for sensor in self.array.sensors:
+            sensor.advance(now)
+
+    def _faulted(self, address):
+        """True if this read hits the faulty sensor too fast. Counts failed and good reads."""
+        sensor, limit_hz = self.fault
+        if sensor not in self.bus._targets(self.bus.devices, address, []):
+            return False
+        if self.bus.clock_hz <= limit_hz or time.monotonic() - self.start < FAULT_ONSET:
+            self.fault_clock = self.bus.clock_hz
+            return False
+        self.fault_errors += 1
+        return True
+
+    def _int_line(self, pin):
+        """Level of a mux's shared INT line: low while any of its sensors holds an interrupt."""
+        mux = self.bus.devices.get(0x70 + NATIVE_INT_PINS.index(pin)) if pin in NATIVE_INT_PINS else None
+        if mux is None:
+            return 1
+        return 0 if any(channel[APDS9930_I2C_ADDR].interrupt for channel in mux.channels if channel) else 1
+
+    def _count_clear(self, address, data):
+        # A broadcast clear (begin() after a reset) reaches every sensor on purpose; only single clears count
+        targets = self.bus._targets(self.bus.devices, address, [])
+        if len(targets) != 1:
+            return
+        if targets[0].interrupt:
+            self.int_cleared += 1
+        else:
+            self.int_spurious += 1
+
+    def serve(self):
+        requests = self.proc.stdout
+        replies = self.proc.stdin
+        while True:
+            op = requests.read(1)
+            if not op:
+                return
+            self._advance()
+            self.transactions += 1
+            if op == b"C":
+                self.bus.clock_hz, = struct.unpack("<I", requests.read(4))
+                continue
+            if op == b"I":
+                replies.write(bytes([self._int_line(requests.read(1)[0])]))
+                replies.flush()
+                continue
+            address, length = requests.read(2)
+            if op == b"W":
+                data = requests.read(length)
+                if address == APDS9930_I2C_ADDR and data and data[0] & SPECIAL_FN == SPECIAL_FN:
+                    self._count_clear(address, data)
+                try:
+                    self.bus.write(address, data)
+                    replies.write(b"\x00")
+                except OSError:
+                    replies.write(b"\x02")
+            else:
+                try:
+                    if self.fault is not None and self._faulted(address):
+                        raise OSError(errno.EIO, "Injected route fault")
+                    data = self.bus.read(address, length)
+                except OSError:
+                    data = b""
+                replies.write(bytes([len(data)]) + data)
+            replies.flush()
+
+
+def start(program, num_stairs, people_per_minute, drift_ppm=0.0, seed=1, crosstalk=0.0, fault=None):
+    """Start the native firmware on a fresh pty with a simulated array behind it.
+
+    Args:
+        fault: (channel, highest clock in Hz) to make that sensor's route fail
+            faster than the clock after FAULT_ONSET, or None
+
+    Returns:
+        tuple: (process, DeviceServer, slave fd, slave path). The host reads
+        frames from the slave path like it would from /dev/ttyACM0.
+    """
+    master, slave = os.openpty()
+    # Raw, so the line discipline neither edits the binary stream nor echoes it back
+    tty.setraw(slave)
+    proc = subprocess.Popen([program, f"fd:{master}", str(drift_ppm)], stdin=subprocess.PIPE,
+                            stdout=subprocess.PIPE, pass_fds=(master,))
+    os.close(master)
+    array = SimulatedArray(num_stairs, seed=seed, crosstalk=crosstalk)
+    crowd = Crowd(num_stairs, people_per_minute, random.Random(seed)) if people_per_minute else None
+    if fault is not None:
+        fault = (array.sensors[fault[0]], fault[1])
+    server = DeviceServer(proc, array, crowd, fault)
+    threading.Thread(target=server.serve, name="mcu-sim-i2c", daemon=True).start()
+    return proc, server, slave, os.ttyname(slave)
+
+
+def plan_phases(num_stairs, crosstalk, seed=1):
+    """Plan phase groups for the firmware from a twin of its simulated array.
+
+    The twin is built from the same seed, so it has the same coupling. It is
+    measured with the stairs empty, as phasing.measure_interference()
+    expects; the firmware's own array is already free-running by then.
+    """
+    array = SimulatedArray(num_stairs, seed=seed, crosstalk=crosstalk)
+    driver = SimulatedMultiplexer(array)
+    channels = [channel for channel in range(num_stairs) if driver.init_sensor(channel, PON)]
+    return plan_groups(channels, measure_interference(driver, channels, array.neighbours()))
+
+
+def check(fd, duration, num_stairs, groups=()):
+    """Configure the fast path, then read the stream for `duration` seconds.
+
+    Counts frames, CRC failures, sequence gaps, trigger edges and how many
+    info frames acknowledged the configuration commands. Stats frames are
+    collected as they arrive; the first one covers boot and is skipped.
+    """
+    commands = config_commands({channel: channel + 1 for channel in range(num_stairs)},
+                               {stair: LEDS_PER_STAIR for stair in range(1, num_stairs + 1)}, TRIGGER_DISTANCE,
+                               groups=groups)
+    for command in commands:
+        os.write(fd, command)
+    report = {"frames": 0, "samples": 0, "fresh": 0, "errors": 0, "corrupt": 0, "lost": 0, "muxes": None,
+              "edges": 0, "info": 0, "stats": []}
+    pending = b""
+    last_seq = None
+    end = time.monotonic() + duration
+    while time.monotonic() < end:
+        pending += os.read(fd, 65536)
+        *frames, pending = pending.split(b"\x00")
+        for encoded in frames:
+            frame = parse_frame(cobs_decode(encoded))
+            if frame is None:
+                # Boot text from the library is expected before the first frame
+                if last_seq is not None:
+                    report["corrupt"] += 1
+                continue
+            frame_type, seq, t_us, entries = frame
+            if last_seq is not None:
+                report["lost"] += (seq - last_seq - 1) & 0xFFFF
+            last_seq = seq
+            report["frames"] += 1
+            if frame_type == STREAM_FRAME_INFO:
+                report["muxes"] = {address: mask for address, mask in entries if mask}
+                report["info"] += 1
+                continue
+            if frame_type == STREAM_FRAME_EDGES:
+                report["edges"] += len(entries)
+                continue
+            if frame_type == STREAM_FRAME_STATS:
+                report["stats"].append(entries[0])
+                continue
+            for channel, status, pdata, dt_us in entries:
+                report["samples"] += 1
+                if status & STREAM_STATUS_ERROR:
+                    report["errors"] += 1
+                elif status & 0x02:
+                    report["fresh"] += 1
+    return report
+
+
+def unconfigured(array):
+    """Sensors that did not get the driver defaults at boot."""
+    return sum(any(sensor.regs[reg] != value for reg, value in CONFIG_DEFAULTS.items())
+               for sensor in array.sensors)
+
+
+def gain_rungs(array):
+    """Each sensor's sensitivity step below the driver defaults: 0 at the defaults, 1 at half, and so on."""
+    rungs = []
+    for sensor in array.sensors:
+        control = sensor.regs[APDS9930_CONTROL]
+        scale = proximity_scale(sensor.regs[APDS9930_PPULSE], control >> 6, (control >> 2) & 0x03)
+        rungs.append(round(-math.log2(scale)))
+    return rungs
+
+
+def misarmed(array, trigger_distance):
+    """Sensors whose PIHT isn't the trigger threshold scaled to their gain rung."""
+    high = int(PROX_K / trigger_distance ** 2) - 1
+    return sum(sensor.regs[APDS9930_PIHTL] | (sensor.regs[APDS9930_PIHTL + 1] << 8) != high >> rung
+               for sensor, rung in zip(array.sensors, gain_rungs(array)))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run the aggregator firmware natively on a pty against simulated APDS-9930s")
+    parser.add_argument("--stairs", type=int, default=14, help="Simulated sensors (up to 64)")
+    parser.add_argument("--people", type=float, default=20.0, help="Arrivals per minute, 0 for empty stairs")
+    parser.add_argument("--drift-ppm", type=float, default=0.0, help="MCU clock error in ppm")
+    parser.add_argument("--crosstalk", type=float, default=0.0,
+                        help="Counts a sensor's LED adds to the next stair when pulses coincide")
+    parser.add_argument("--phased", action="store_true",
+                        help="With --check, send the firmware phase groups planned from the measured crosstalk")
+    parser.add_argument("--program", help="Native firmware binary (default: the env's build output)")
+    parser.add_argument("--build", action="store_true", help="Build the native firmware first")
+    parser.add_argument("--bench", action="store_true",
+                        help="Use the native-bench env, which keeps every stair fading")
+    parser.add_argument("--lean", action="store_true",
+                        help="Use the native-lean env, with the APDS9930 driver's APDS9930_LEAN mode")
+    parser.add_argument("--inline", action="store_true",
+                        help="Use the native-inline env, with the APDS9930 driver built header-only")
+    parser.add_argument("--fault", type=int, metavar="CHANNEL",
+                        help="With --check, make this sensor's reads fail above --fault-hz after boot")
+    parser.add_argument("--fault-hz", type=int, default=100000,
+                        help="Fastest clock the --fault route still reads at")
+    parser.add_argument("--int", action="store_true",
+                        help="Use the native-int env, which only reads muxes whose simulated INT line is low")
+    parser.add_argument("--link", help="Symlink to create pointing at the pty, e.g. /tmp/crazy-stairs-mcu")
+    parser.add_argument("--check", type=float, metavar="SECONDS",
+                        help="Read and verify the stream for this long instead of serving a host")
+    args = parser.parse_args()
+
+    env = ("native-bench" if args.bench else "native-lean" if args.lean else
+           "native-inline" if args.inline else "native-int" if args.int else "native")
+    args.program = args.program or NATIVE_PROGRAM.format(env=env)
+    if args.build or not os.path.exists(args.program):
+        build_native(args.program, env)
+    groups = plan_phases(args.stairs, args.crosstalk) if args.phased else ()
+    fault = (args.fault, args.fault_hz) if args.fault is not None else None
+    proc, server, slave, path = start(args.program, args.stairs, args.people, args.drift_ppm,
+                                      crosstalk=args.crosstalk, fault=fault)
+    try:
+        if args.check:
+            report = check(slave, args.check, args.stairs, groups)
+            rate = report["samples"] / args.check
+            print(f"frames {report['frames']}  samples {report['samples']} ({rate:.0f}/s, "
+                  f"{report['fresh']} fresh)  read errors {report['errors']}  corrupt {report['corrupt']}  "
+                  f"lost {report['lost']}  I2C transactions {server.transactions}")
+            print(f"fast path edges {report['edges']} ({server.crowd.arrived if server.crowd else 0} people)  "
+                  f"info frames {report['info']}  phase groups {len(groups) if len(groups) > 1 else 'none'}")
+            for sweeps, frames, dropped, sweep_us, frame_us in report["stats"][1:]:
+                print(f"sweep {sweeps} Hz (worst {sweep_us} us)  LED frames {frames} Hz (worst {frame_us} us)  "
+                      f"dropped edges {dropped}")
+            print(f"muxes: {', '.join(f'0x{a:02x}={m:08b}' for a, m in sorted((report['muxes'] or {}).items()))}")
+            missed = unconfigured(server.array)
+            print(f"sensors without the default config: {missed}")
+            slowed = True
+            if fault is not None:
+                # The route must have dropped to a clock it reads at, and kept reading there
+                slowed = server.fault_errors and (server.fault_clock or 0) <= args.fault_hz
+                print(f"fault on channel {args.fault}: {server.fault_errors} failed reads, last good read at "
+                      f"{(server.fault_clock or 0) / 1000:.0f} kHz (limit {args.fault_hz / 1000:.0f} kHz)")
+            serviced = True
+            if args.int:
+                # Every single-sensor clear must hit a sensor that fired, and people must still trigger stairs
+                # and every sensor's threshold must match the gain rung auto-gain has it on
+                wrong = misarmed(server.array, TRIGGER_DISTANCE)
+                serviced = (not server.int_spurious and not wrong and
+                            (not args.people or (server.int_cleared and report["edges"])))
+                print(f"interrupts cleared {server.int_cleared}  clears of sensors that hadn't fired "
+                      f"{server.int_spurious}  sensors off rung 0 {sum(map(bool, gain_rungs(server.array)))}  "
+                      f"thresholds not matching the rung {wrong}")
+            regressed = []
+            if not avr_bench.available():
+                print("avr_bench: skipped, needs PlatformIO and libsimavr")
+            elif not os.path.exists(avr_bench.BASELINE):
+                print(f"avr_bench: skipped, no baseline; run avr_bench.py --save {avr_bench.BASELINE}")
+            else:
+                regressed = avr_bench.compare()
+                for message in regressed:
+                    print(f"avr_bench regression: {message}")
+                print(f"avr_bench: {len(regressed)} regressions against {avr_bench.BASELINE}")
+            ok = (report["frames"] and not report["corrupt"] and not report["lost"] and not missed and slowed
+                  and serviced and not regressed)
+            return 0 if ok else 1
+        if args.link:
+            if os.path.lexists(args.link):
+                os.unlink(args.link)
+            os.symlink(path, args.link)
+        print(f"Firmware streaming on {args.link or path}, Ctrl-C to stop")
+        proc.wait()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        proc.kill()
+        if args.link and os.path.islink(args.link):
+            os.unlink(args.link)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
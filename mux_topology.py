@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+
+import argparse
+import random
+
+TCA9548A_BASE = 0x70
+TCA9548A_ADDRESSES = range(TCA9548A_BASE, TCA9548A_BASE + 8)
+TCA9548A_CHANNELS = 8
+
+
+class MuxRoute(tuple):
+    """Full path from the bus to one mux channel: a tuple of (mux address, channel) hops.
+
+    A flat install has one hop per route, e.g. ((0x70, 3),). A sensor behind
+    a cascaded mux has one hop per level, e.g. ((0x70, 3), (0x74, 5)), written
+    "0x70:3/0x74:5". Sorting routes gives depth-first order, which is the
+    order that needs the fewest select writes.
+    """
+
+    def __new__(cls, hops):
+        return super().__new__(cls, ((int(address), int(channel)) for address, channel in hops))
+
+    @classmethod
+    def parse(cls, text):
+        """"0x70:3/0x74:5" -> MuxRoute(((0x70, 3), (0x74, 5)))"""
+        return cls(tuple(int(part, 0) for part in hop.split(":")) for hop in text.split("/"))
+
+    @classmethod
+    def of(cls, route):
+        """Accept a MuxRoute, its string form, or a flat (mux address, channel) pair."""
+        if isinstance(route, MuxRoute):
+            return route
+        if isinstance(route, str):
+            return cls.parse(route)
+        if len(route) == 2 and isinstance(route[0], int):
+            return cls((route,))
+        return cls(route)
+
+    @property
+    def mux(self):
+        """Address of the mux the sensor sits behind."""
+        return self[-1][0]
+
+    @property
+    def channel(self):
+        """Channel of that mux."""
+        return self[-1][1]
+
+    def __str__(self):
+        return "/".join(f"0x{address:02x}:{channel}" for address, channel in self)
+
+
+class MuxTopology:
+    """A tree of TCA9548A muxes and the select writes needed to reach each route.
+
+    A segment is the bus itself, or whatever hangs off one mux channel. It is
+    keyed by the route prefix leading to it, () for the bus. Every mux in a
+    segment is visible while that segment is connected. Sensors share one
+    address, so at most one mux per segment may have a channel enabled.
+
+    The state of every mux is tracked, including muxes whose segment is
+    currently cut off upstream. A cut-off mux keeps its channel, so returning
+    to it needs no write. Routes at the same mux cost one write each, a
+    sibling mux costs one more to deselect the old one, and a cascaded subtree
+    costs its parent channel only when the sweep enters it. select() returns
+    the writes, so callers can issue them, batch them, or count them.
+    """
+
+    def __init__(self, routes=()):
+        self.segments = {}      # route prefix -> sorted mux addresses in that segment
+        self.state = {}         # (route prefix, mux address) -> enabled mask; missing means unknown
+        for route in routes:
+            self.add(route)
+
+    def add(self, route):
+        """Register a route, checking it against the muxes already known.
+
+        Raises:
+            ValueError: For a bad address or channel, or a mux that would
+                answer alongside another mux at the same address on the
+                same path
+        """
+        route = MuxRoute.of(route)
+        if not route:
+            raise ValueError("empty mux route")
+        upstream = set()
+        for depth, (address, channel) in enumerate(route):
+            if address not in TCA9548A_ADDRESSES or not 0 <= channel < TCA9548A_CHANNELS:
+                raise ValueError(f"bad mux hop 0x{address:02x}:{channel} in {route}")
+            segment = route[:depth]
+            muxes = self.segments.setdefault(segment, [])
+            if address not in muxes:
+                downstream = any(address in others for below, others in self.segments.items()
+                                 if len(below) > depth and below[:depth] == segment)
+                if address in upstream or downstream:
+                    raise ValueError(f"mux 0x{address:02x} behind {MuxRoute(segment) or 'the bus'} clashes "
+                                     f"with another mux at the same address on its path")
+                muxes.append(address)
+                muxes.sort()
+            upstream.update(muxes)
+        return route
+
+    def select(self, route, state=None):
+        """Writes that connect `route`, given what each mux currently holds.
+
+        Args:
+            route: MuxRoute to connect
+            state: Mux state to work from and update; defaults to the topology's
+                own. Pass {} to get the writes from an unknown state.
+
+        Returns:
+            list: (mux address, value) writes, in bus order
+        """
+        state = self.state if state is None else state
+        writes = []
+        for depth, (address, channel) in enumerate(route):
+            segment = route[:depth]
+            for other in self.segments[segment]:
+                if other != address and state.get((segment, other)) != 0:
+                    writes.append((other, 0))
+                    state[(segment, other)] = 0
+            if state.get((segment, address)) != 1 << channel:
+                writes.append((address, 1 << channel))
+                state[(segment, address)] = 1 << channel
+        return writes
+
+    def invalidate(self):
+        """Forget every mux's state, e.g. after a failed write; the next select rewrites the path."""
+        self.state.clear()
+
+    @staticmethod
+    def order(routes):
+        """Routes in depth-first order, the sweep order with the fewest select writes."""
+        return sorted(MuxRoute.of(route) for route in routes)
+
+    def sweep_writes(self, routes):
+        """Select writes for each route of a repeating sweep, once the muxes are in step.
+
+        The first pass brings every mux from an unknown state to the one the
+        sweep leaves behind. The second pass, measured here, is what every
+        later sweep costs.
+
+        Returns:
+            list: One list of (mux address, value) writes per route, in the given order
+        """
+        state = {}
+        for route in routes:
+            self.select(route, state)
+        return [self.select(route, state) for route in routes]
+
+
+def build_routes(text):
+    """"0x70:0-2,0x70:3/0x74:0-7" -> routes, with a channel range allowed on the last hop."""
+    routes = []
+    for part in text.split(","):
+        *prefix, last = part.split("/")
+        address, channels = last.split(":")
+        lo, _, hi = channels.partition("-")
+        routes.extend(MuxRoute.parse("/".join(prefix + [f"{address}:{channel}"]))
+                      for channel in range(int(lo), int(hi or lo) + 1))
+    return routes
+
+
+def cascaded_routes(num_sensors, root=TCA9548A_BASE):
+    """Routes for one root mux with a child mux on each channel, filled child by child.
+
+    The root takes 0x70 and the children use 0x71-0x77, so one bus reaches up
+    to 8 * 7 * 8 = 448 sensors.
+    """
+    children = [address for address in TCA9548A_ADDRESSES if address != root]
+    routes = []
+    for index in range(num_sensors):
+        child, channel = divmod(index, TCA9548A_CHANNELS)
+        parent, slot = divmod(child, len(children))
+        routes.append(MuxRoute(((root, parent), (children[slot], channel))))
+    return routes
+
+
+def _simulate(routes, seed=1):
+    """Sweep simulated APDS-9930s at `routes` and check every reading arrives from the right sensor."""
+    from i2c_rdwr import SweepPlan, SimulatedI2C
+    from sim_apds9930 import (SimulatedI2CBus, SimulatedTCA9548A, SimulatedAPDS9930, APDS9930_I2C_ADDR,
+                              APDS9930_ENABLE, APDS9930_PDATAL, AUTO_INCREMENT, PON, PEN)
+
+    rng = random.Random(seed)
+    bus = SimulatedI2CBus()
+    sensors = []
+    for route in routes:
+        devices = bus.devices
+        for address, channel in route:
+            if address not in devices:
+                devices[address] = SimulatedTCA9548A()
+            devices = devices[address].channels[channel]
+        sensor = SimulatedAPDS9930(rng)
+        sensor.i2c_write(bytes([AUTO_INCREMENT | APDS9930_ENABLE, PON | PEN]))
+        sensor.target_distance = rng.uniform(100, 600)
+        devices[APDS9930_I2C_ADDR] = sensor
+        sensors.append(sensor)
+    for sensor in sensors:
+        sensor.advance(0.01)
+
+    topology = MuxTopology(routes)
+    naive = sum(len(topology.select(route, {})) for route in routes)
+    for mangling in (True, False):
+        bus.protocol_mangling = mangling
+        plan = SweepPlan(routes, mangling=mangling)
+        transport = SimulatedI2C(bus)
+        plan.execute(transport)
+        transport.ioctls = 0
+        bus.transactions = 0
+        plan.execute(transport)
+        mismatches = sum(1 for index, sensor in enumerate(sensors)
+                         if not plan.valid[index] or
+                         plan.sample(index)[3] != sensor.regs[APDS9930_PDATAL] | sensor.regs[APDS9930_PDATAL + 1] << 8)
+        label = "combined (I2C_M_STOP)" if mangling else "i2c-bcm2835 fallback"
+        print(f"{len(routes):>5} sensors, depth {max(len(route) for route in routes)}  {label:<22} "
+              f"select writes/sweep {plan.select_writes:>5} (absolute {naive})  "
+              f"ioctls/sweep {transport.ioctls:>5}  {'ok' if not mismatches else f'{mismatches} mismatches'}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Select writes per sweep over a tree of TCA9548A muxes")
+    parser.add_argument("--routes", help="Sensor routes, e.g. 0x70:0-2,0x70:3/0x74:0-7 (default: --sensors "
+                                         "behind one root mux with cascaded children)")
+    parser.add_argument("--sensors", type=int, nargs="+", default=[14, 64, 128, 448], help="Cascaded array sizes")
+    args = parser.parse_args()
+
+    if args.routes:
+        _simulate(build_routes(args.routes))
+        return
+    for num_sensors in args.sensors:
+        _simulate(cascaded_routes(num_sensors))
+
+
+if __name__ == "__main__":
+    main()
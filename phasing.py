@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+
+from sim_apds9930 import PON, PEN
+
+NOISE_LIMIT = 6             # counts; a rise above ~3 sigma of read noise counts as interference
+SETTLE = 1.25               # wait this many conversion times so one full cycle lands, despite oscillator spread
+
+
+def _convert(driver, group, victim, now):
+    """Start `group` together, let one conversion finish, read `victim`, stop the group."""
+    driver.set_enable(group, PON | PEN, now)
+    driver.wait(driver.conversion_time * SETTLE)
+    value = driver.read_pdata(victim, now)
+    driver.set_enable(group, PON, now)
+    return value
+
+
+def measure_interference(driver, channels, neighbours, now=0.0, repeats=4):
+    """Measure how much each sensor's LED raises its neighbours' PDATA.
+
+    Run with the stairs empty. For each sensor this measures a baseline with
+    only that sensor converting, then measures again with each candidate
+    neighbour started in the same write. The difference is the coupling.
+    Neighbours behind the same mux start in one broadcast write and overlap
+    fully. Across muxes the second write lands a few tens of µs later, so the
+    coupling is a lower bound there.
+
+    Args:
+        driver: Needs set_enable(channels, value, now), read_pdata(channel, now),
+            wait(seconds) and conversion_time
+        channels: Channels to measure
+        neighbours: Dict of channel -> channels that might interfere with it
+        now: Simulation/start time passed through to the driver
+        repeats: Conversions averaged per measurement
+
+    Returns:
+        dict: {(victim, aggressor): extra counts}
+    """
+    driver.set_enable(channels, PON, now)
+    coupling = {}
+    for victim in channels:
+        readings = [_convert(driver, [victim], victim, now) for _ in range(repeats)]
+        baseline = sum(r for r in readings if r is not None) / max(1, len(readings))
+        for aggressor in neighbours.get(victim, ()):
+            if aggressor not in channels:
+                continue
+            readings = [_convert(driver, [victim, aggressor], victim, now) for _ in range(repeats)]
+            coupling[(victim, aggressor)] = sum(r for r in readings if r is not None) / repeats - baseline
+    return coupling
+
+
+def plan_groups(channels, coupling, limit=NOISE_LIMIT):
+    """Split channels into conversion groups whose members never interfere.
+
+    Greedy colouring in channel order. On a staircase, where only nearby
+    stairs couple, this gives as many groups as the interference reach plus
+    one.
+
+    Returns:
+        list: Lists of channels, one per group, in start order
+    """
+    conflicts = {channel: set() for channel in channels}
+    for (victim, aggressor), counts in coupling.items():
+        if counts > limit and victim in conflicts and aggressor in conflicts:
+            conflicts[victim].add(aggressor)
+            conflicts[aggressor].add(victim)
+    groups = []
+    for channel in channels:
+        for group in groups:
+            if not conflicts[channel] & set(group):
+                group.append(channel)
+                break
+        else:
+            groups.append([channel])
+    return groups
+
+
+class PhasedSweep:
+    """Runs proximity conversions group by group so interfering sensors never pulse together.
+
+    Sensors sit idle (PON only) between sweeps. Each group is started with one
+    ENABLE write per mux, read once its conversion has landed, and stopped
+    again before the next group starts. Separation comes from the host's start
+    order rather than from each part's free-running oscillator. Per-device
+    WTIME offsets would give each sensor a different period, and the phases
+    would slide through each other. The firmware's sweepPhased() does the
+    same with the groups sent by stream_decoder.config_commands().
+    """
+
+    def __init__(self, driver, groups):
+        self.driver = driver
+        self.groups = groups
+
+    def run(self, now, on_sample):
+        """Convert and read every group once. Calls on_sample(channel, pdata)."""
+        driver = self.driver
+        for group in self.groups:
+            driver.set_enable(group, PON | PEN, now)
+            driver.wait(driver.conversion_time * SETTLE)
+            for channel in group:
+                on_sample(channel, driver.read_pdata(channel, now))
+            driver.set_enable(group, PON, now)
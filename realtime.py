@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+
+import ctypes
+import ctypes.util
+import os
+import threading
+import time
+
+CLOCK_MONOTONIC = 1
+TIMER_ABSTIME = 1
+MCL_CURRENT = 1
+MCL_FUTURE = 2
+
+# Per-thread scheduling. The sensor loop also composes and shows LED frames, so
+# it gets an isolated core and a FIFO priority above the kernel's default
+# threaded IRQ handlers (50). Logging and other housekeeping share the
+# remaining cores with Bluetooth and pm2 at normal priority.
+THREAD_CONFIG = {
+    "sensor": {"cpus": {3}, "policy": "fifo", "priority": 60},
+    "audio": {"cpus": {2}, "policy": "fifo", "priority": 55},
+    "background": {"cpus": {0, 1}, "policy": "other", "priority": 0},
+}
+
+THREAD_STACK_SIZE = 512 * 1024  # Keeps mlockall(MCL_FUTURE) from pinning 8 MB per thread
+
+_libc = ctypes.CDLL(ctypes.util.find_library("c") or "libc.so.6", use_errno=True)
+
+
+class _Timespec(ctypes.Structure):
+    _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+
+def configure_thread(role, config=THREAD_CONFIG):
+    """Apply the scheduling policy, priority and CPU affinity for `role` to the calling thread.
+
+    Args:
+        role: Key into config ("sensor", "audio", "background")
+        config: Dict of role -> {"cpus", "policy", "priority"}
+
+    Returns:
+        bool: True if everything was applied, False if something needs more privileges
+    """
+    settings = config[role]
+    ok = True
+    cpus = settings.get("cpus")
+    if cpus:
+        available = os.sched_getaffinity(0)
+        cpus = set(cpus) & available or available
+        try:
+            os.sched_setaffinity(0, cpus)
+        except OSError as e:
+            print(f"Could not pin {role} thread to CPUs {sorted(cpus)}: {e}")
+            ok = False
+    try:
+        if settings.get("policy") == "fifo":
+            os.sched_setscheduler(0, os.SCHED_FIFO, os.sched_param(settings.get("priority", 50)))
+        else:
+            os.sched_setscheduler(0, os.SCHED_OTHER, os.sched_param(0))
+    except (OSError, AttributeError) as e:
+        print(f"Could not set {settings.get('policy')} scheduling for {role} thread: {e}")
+        ok = False
+    return ok
+
+
+def lock_memory():
+    """Lock current and future pages into RAM and size new thread stacks so locking them is cheap.
+
+    Returns:
+        bool: True if memory was locked
+    """
+    threading.stack_size(THREAD_STACK_SIZE)
+    if _libc.mlockall(MCL_CURRENT | MCL_FUTURE) != 0:
+        err = ctypes.get_errno()
+        print(f"mlockall failed: {os.strerror(err)}")
+        return False
+    return True
+
+
+def prefault(*buffers):
+    """Touch every page of the given writable buffers so the hot path never page-faults on them."""
+    page = os.sysconf("SC_PAGE_SIZE")
+    for buf in buffers:
+        view = memoryview(buf).cast("B")
+        for offset in range(0, len(view), page):
+            view[offset] = view[offset]
+
+
+def clock_nanosleep_until(deadline_ns):
+    """Sleep until an absolute CLOCK_MONOTONIC time (same clock as time.monotonic_ns())."""
+    ts = _Timespec(deadline_ns // 1_000_000_000, deadline_ns % 1_000_000_000)
+    while True:
+        err = _libc.clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ctypes.byref(ts), None)
+        if err != 4:  # Retry on EINTR, the deadline is absolute
+            return
+
+
+class DeadlineTimer:
+    """Fixed-period ticker using absolute deadlines, so wake-up error never accumulates.
+
+    If the caller overruns one or more periods, the missed deadlines are
+    skipped and counted instead of being run back to back.
+    """
+
+    def __init__(self, period):
+        """Create the timer. The first deadline is one period from now.
+
+        Args:
+            period: Period in seconds
+        """
+        self.period_ns = int(period * 1_000_000_000)
+        self.deadline_ns = time.monotonic_ns() + self.period_ns
+        self.overruns = 0
+
+    def wait(self):
+        """Sleep until the next deadline.
+
+        Returns:
+            int: The deadline that was waited for, in ns on the monotonic clock
+        """
+        now = time.monotonic_ns()
+        if now > self.deadline_ns:
+            missed = (now - self.deadline_ns) // self.period_ns
+            if missed:
+                self.overruns += missed
+                self.deadline_ns += missed * self.period_ns
+        else:
+            clock_nanosleep_until(self.deadline_ns)
+        deadline = self.deadline_ns
+        self.deadline_ns += self.period_ns
+        return deadline
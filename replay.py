@@ -0,0 +1,499 @@
+#!/usr/bin/env python3
+
+import argparse
+from array import array
+import gc
+import os
+import random
+import sys
+import tempfile
+import time
+import tracemalloc
+
+import tracing
+from event_loop import EventLoop
+from sample_log import SampleLogReader, SampleLogWriter
+from sensor_health import HealthMonitor
+from stair_bus import StairBus
+from stair_pipeline import StairPipeline, STAIR_MAPPING, STAIR_LED_COUNTS, LED_COUNT, TRIGGER_DISTANCE
+
+WS2812_BIT_TIME = 1.25e-6     # 800 kHz
+MAX_LAG = 0.05                # In 1x mode, samples later than this are dropped like a missed poll
+
+# --alloc-check: the daemon's steady-state path under tracemalloc
+FRAME_INTERVAL = 0.05         # main.LED_FRAME_INTERVAL
+ALLOC_WARMUP = 10.0           # Scenario seconds before allocations count; every stair has fired by then
+TRANSIENT_LIMIT = 512         # Bytes a typical step may hold at once: a few ints, floats and tuples, never a buffer
+TRANSIENT_PERCENTILE = 99     # Step peak held to TRANSIENT_LIMIT; rarer peaks are reported, not failed
+ALLOC_TICK = 0.0001           # Sweep timer period; each sample step waits for one tick
+HOT_PATH_FILES = ("stair_pipeline.py", "sample_log.py", "sensor_health.py", "stair_bus.py", "tracing.py",
+                  "event_loop.py")
+
+# --health-check: VL53L0X read times on the daemon's back-to-back round robin
+READ_TIME = (0.033, 0.045)    # Seconds a successful single-shot read holds the bus
+READ_TIMEOUT = 0.1            # vl53l0x_multiplexer's data-ready deadline
+FLAKY_TIMEOUTS = 0.4          # Share of the flaky sensor's reads that time out; under SCORE_LIMIT
+
+
+class ReplayMultiplexer:
+    """Stands in for VL53L0XMultiplexer, serving readings fed from a recording."""
+
+    def __init__(self, channels):
+        self.channels = set(channels)
+        self.pending = {}
+        self.last_error = {}
+
+    def init_sensor(self, global_channel):
+        return global_channel in self.channels
+
+    def feed(self, global_channel, distance):
+        self.pending[global_channel] = distance
+
+    def read_range(self, global_channel):
+        return self.pending.pop(global_channel, None)
+
+
+class NullStrip:
+    """LED strip stand-in. Optionally blocks in show() for the WS2812 wire time."""
+
+    def __init__(self, num_pixels, show_time=0.0):
+        self._pixels = [0] * num_pixels
+        self.show_time = show_time
+        self.shows = 0
+
+    def begin(self):
+        pass
+
+    def numPixels(self):
+        return len(self._pixels)
+
+    def setPixelColor(self, n, color):
+        self._pixels[n] = color
+
+    def getPixelColor(self, n):
+        return self._pixels[n]
+
+    def show(self):
+        self.shows += 1
+        if self.show_time:
+            time.sleep(self.show_time)
+
+
+class NullAudio:
+    """Audio stand-in that counts submitted sounds."""
+
+    def __init__(self):
+        self.played = 0
+
+    def play_sound(self, stair_num=None):
+        self.played += 1
+        return True
+
+
+class StageStats:
+    """Collects per-stage durations in nanoseconds."""
+
+    def __init__(self):
+        self.samples = {}
+
+    def add(self, stage, ns):
+        self.samples.setdefault(stage, []).append(ns)
+
+    def percentiles(self, stage, points=(50, 90, 99, 100)):
+        values = sorted(self.samples.get(stage, []))
+        if not values:
+            return None
+        return [values[min(len(values) - 1, (len(values) * p) // 100)] for p in points]
+
+
+def synthetic_walk(duration=60.0, walkers=10, stair_time=0.5, poll_interval=0.01, seed=1, landings=False):
+    """Generate a time-ordered stream of samples for people walking the stairs.
+
+    Each walker starts at a random time, goes up or down, and stands on each
+    stair for stair_time seconds. Sensors are polled round-robin every
+    poll_interval seconds, like the main loop does. With `landings`, the
+    channels mapped to no stair are polled too, as landing sensors that see
+    each walker for the stair_time before their first stair.
+
+    Yields:
+        tuple: (t_us, channel, distance, triggered)
+    """
+    rng = random.Random(seed)
+    stair_to_channel = {stair: channel for channel, stair in STAIR_MAPPING.items() if stair is not None}
+    stairs = sorted(stair_to_channel)
+    channels = [stair_to_channel[stair] for stair in stairs]
+    unmapped = [channel for channel, stair in STAIR_MAPPING.items() if stair is None] if landings else []
+    channels += unmapped
+
+    visits = {channel: [] for channel in channels}  # channel -> [(start, end)]
+    for _ in range(walkers):
+        start = rng.uniform(0, max(0.0, duration - stair_time * len(stairs)))
+        for channel in unmapped:
+            visits[channel].append((start - stair_time, start - stair_time * 0.2))
+        order = stairs if rng.random() < 0.5 else list(reversed(stairs))
+        for i, stair in enumerate(order):
+            t = start + i * stair_time
+            visits[stair_to_channel[stair]].append((t, t + stair_time * 0.8))
+
+    t = 0.0
+    idx = 0
+    while t < duration:
+        channel = channels[idx]
+        occupied = any(start <= t < end for start, end in visits[channel])
+        distance = rng.randint(150, 450) if occupied else rng.randint(1200, 2000)
+        yield int(t * 1_000_000), channel, distance, distance < TRIGGER_DISTANCE
+        idx = (idx + 1) % len(channels)
+        t += poll_interval
+
+
+def run_replay(source, realtime=True, show_time=0.0):
+    """Push a sample stream through the production pipeline.
+
+    Args:
+        source: Iterable of (t_us, channel, distance_or_None, triggered)
+        realtime: Pace samples at their recorded times (1x). If False, run as fast as possible
+        show_time: Seconds each strip.show() blocks for, to emulate the WS2812 wire time
+
+    Returns:
+        dict: Run report
+    """
+    stats = StageStats()
+    strip = NullStrip(LED_COUNT, show_time)
+    audio = NullAudio()
+    if realtime:
+        pipeline = StairPipeline(strip, audio, stats=stats)
+    else:
+        pipeline = StairPipeline(strip, audio, fade_in_delay=0, fade_out_delay=0, stats=stats)
+    transport = ReplayMultiplexer(ch for ch, stair in STAIR_MAPPING.items() if stair is not None)
+    for channel in transport.channels:
+        pipeline.add_sensor(channel)
+
+    processed = dropped = invalid = 0
+    expected_edges = produced_edges = 0
+    recorded_state = {}
+    first_us = None
+    start = time.perf_counter()
+
+    for t_us, channel, distance, triggered in source:
+        if distance is not None:
+            if recorded_state.get(channel, False) != triggered:
+                expected_edges += 1
+            recorded_state[channel] = triggered
+
+        if first_us is None:
+            first_us = t_us
+        if realtime:
+            lag = (time.perf_counter() - start) - (t_us - first_us) / 1_000_000
+            if lag < 0:
+                time.sleep(-lag)
+            elif lag > MAX_LAG:
+                dropped += 1
+                continue
+
+        t0 = time.perf_counter_ns()
+        transport.feed(channel, distance)
+        reading = transport.read_range(channel)
+        t1 = time.perf_counter_ns()
+        stats.add("read", t1 - t0)
+        if reading is None:
+            invalid += 1
+            continue
+        if pipeline.process_sample(channel, reading) is not None:
+            produced_edges += 1
+        stats.add("total", time.perf_counter_ns() - t0)
+        processed += 1
+
+    elapsed = time.perf_counter() - start
+    return {
+        "elapsed": elapsed,
+        "processed": processed,
+        "dropped": dropped,
+        "invalid": invalid,
+        "expected_edges": expected_edges,
+        "produced_edges": produced_edges,
+        "shows": strip.shows,
+        "sounds": audio.played,
+        "stats": stats,
+    }
+
+
+def run_alloc_check(source, warmup=ALLOC_WARMUP):
+    """Run the daemon's steady-state path under tracemalloc and report what allocates after warm-up.
+
+    Each sample is fed to a ReplayMultiplexer and read back from a sweep
+    timer callback that EventLoop dispatches, the way main.on_sweep_tick()
+    reads VL53L0XMultiplexer. It then goes through health scoring, the sample
+    log, the trigger filter and stair bus publication like
+    main.handle_reading(). The synthetic walk includes the channels mapped
+    to no stair, whose edges must stay off the bus. Every FRAME_INTERVAL of
+    scenario time the LED fades step and the bus flushes and polls. Pools
+    and dicts fill during warm-up. After that, each step is measured on its
+    own:
+
+    - retained: objects still held after the step, per source line. A
+      counter or timestamp that was replaced is held once per sensor at
+      most; anything kept per sample, edge or frame grows far past that
+    - transient: the most a step held at once, which catches buffers built
+      and freed inside a call; the interpreter's short-lived ints, floats and
+      tuples stay under TRANSIENT_LIMIT. A single step's peak also depends
+      on interpreter free lists and on when a looped-back datagram arrives,
+      so it varies from run to run by a few objects. The limit applies to
+      the TRANSIENT_PERCENTILE step of each kind. A buffer built on every
+      step, or on anything as common as an edge, moves that percentile; a
+      one-off free-list refill does not. The highest peak is reported too
+    - gc: collections, which only run when container objects pile up
+
+    The check passes when nothing is retained, the percentile step stays
+    under the limit and the collector never runs.
+
+    Returns:
+        dict: Check report
+    """
+    strip = NullStrip(LED_COUNT)
+    pipeline = StairPipeline(strip, NullAudio(), frame_driven=True)
+    # Unmapped channels too: main.py sweeps every sensor it finds, stair or not
+    channels = list(STAIR_MAPPING)
+    for channel in channels:
+        pipeline.add_sensor(channel)
+    health = HealthMonitor()
+    for channel in channels:
+        health.mark_online(channel)
+    tmp = tempfile.TemporaryDirectory()
+    sample_log = SampleLogWriter(os.path.join(tmp.name, "samples.bin"), STAIR_MAPPING, TRIGGER_DISTANCE)
+    try:
+        bus = StairBus(0, interface="127.0.0.1", max_pending=2 * len(STAIR_LED_COUNTS))
+    except OSError as e:
+        print(f"No multicast on loopback ({e}), checking without the stair bus")
+        bus = None
+
+    transport = ReplayMultiplexer(channels)
+    loop = EventLoop()
+    fed = [None]    # Channel the next tick reads
+
+    def on_sweep_tick(expirations):
+        channel = fed[0]
+        start = time.monotonic()
+        distance = transport.read_range(channel)
+        health.record(channel, distance, transport.last_error.pop(channel, None), time.monotonic() - start)
+        sample_log.record(channel, distance, distance is not None and distance < TRIGGER_DISTANCE)
+        if distance is not None:
+            state = pipeline.process_sample(channel, distance)
+            stair = STAIR_MAPPING[channel]
+            if state is not None and bus is not None and stair is not None:
+                bus.edge(stair, state)
+
+    loop.add_timer(ALLOC_TICK, on_sweep_tick)
+
+    def sample_step(channel, distance):
+        transport.feed(channel, distance)
+        fed[0] = channel
+        loop.run_once()
+
+    sent = 0
+
+    def frame_step():
+        nonlocal sent
+        pipeline.render_frame()
+        if bus is not None:
+            # Our own datagrams loop back; read exactly those, as the EventLoop would
+            for _ in range(sent):
+                bus.poll()
+            sent = bus.flush()
+
+    collections = [0]
+    gc.callbacks.append(lambda phase, info: collections.__setitem__(0, collections[0] + (phase == "start")))
+    # Step peaks go into arrays, which the collector does not track
+    peaks = {"sample": array("I"), "frame": array("I")}
+    report = {"samples": 0, "frames": 0}
+    frame_us = int(FRAME_INTERVAL * 1_000_000)
+    warmup_us = int(warmup * 1_000_000)
+    next_frame_us = frame_us
+    measuring = False
+    tracemalloc.start(1)
+    try:
+        for t_us, channel, distance, _ in source:
+            if not measuring and t_us >= warmup_us:
+                base = tracemalloc.take_snapshot()
+                gc.collect()
+                collections[0] = 0
+                measuring = True
+            while t_us >= next_frame_us:
+                next_frame_us += frame_us
+                if not measuring:
+                    frame_step()
+                    continue
+                before = tracemalloc.get_traced_memory()[0]
+                tracemalloc.reset_peak()
+                frame_step()
+                peaks["frame"].append(tracemalloc.get_traced_memory()[1] - before)
+            if not measuring:
+                sample_step(channel, distance)
+                continue
+            before = tracemalloc.get_traced_memory()[0]
+            tracemalloc.reset_peak()
+            sample_step(channel, distance)
+            peaks["sample"].append(tracemalloc.get_traced_memory()[1] - before)
+        if not measuring:
+            raise ValueError(f"scenario is shorter than the {warmup:.0f}s warm-up")
+        end = tracemalloc.take_snapshot()
+    finally:
+        tracemalloc.stop()
+        gc.callbacks.pop()
+        sample_log.close()
+        loop.close()
+        if bus is not None:
+            bus.close()
+        tmp.cleanup()
+
+    report["samples"] = len(peaks["sample"])
+    report["frames"] = len(peaks["frame"])
+    report["transient"] = {}
+    report["highest"] = {}
+    report["over"] = {}
+    for step, values in peaks.items():
+        values = sorted(values)
+        report["transient"][step] = values[len(values) * TRANSIENT_PERCENTILE // 100] if values else 0
+        report["highest"][step] = values[-1] if values else 0
+        report["over"][step] = sum(1 for peak in values if peak > TRANSIENT_LIMIT)
+
+    filters = [tracemalloc.Filter(True, f"*{os.sep}{name}") for name in HOT_PATH_FILES]
+    report["retained_limit"] = len(channels)
+    report["retained"] = [stat for stat in end.filter_traces(filters).compare_to(base.filter_traces(filters), "lineno")
+                          if stat.count_diff > len(channels)]
+    report["collections"] = collections[0]
+    report["bus"] = bus is not None
+    report["ok"] = (not report["retained"] and not report["collections"]
+                    and all(peak <= TRANSIENT_LIMIT for peak in report["transient"].values()))
+    return report
+
+
+def run_health_check(sensors, duration=120.0, flaky=False, seed=1):
+    """Run HealthMonitor on a simulated clock against a small install.
+
+    Each read holds the bus for a VL53L0X single-shot time. The 10ms sweep
+    tick is shorter than any read, so the daemon reads back to back and each
+    sensor gets 1/sensors of the bus. With `flaky`, one more sensor times out
+    on FLAKY_TIMEOUTS of its reads: too few for the failure score, so only
+    its wasted bus time can take it out of the sweep.
+
+    Returns:
+        dict: channel -> (reads, share of the bus, quarantines)
+    """
+    rng = random.Random(seed)
+    health = HealthMonitor()
+    channels = list(range(sensors + flaky))
+    back = {}                   # channel -> time it rejoins the sweep
+    reads = {channel: 0 for channel in channels}
+    bus_time = {channel: 0.0 for channel in channels}
+    quarantines = {channel: 0 for channel in channels}
+    for channel in channels:
+        health.mark_online(channel, 0.0)
+    t = 0.0
+    turn = 0
+    while t < duration:
+        active = [channel for channel in channels if back.get(channel, 0.0) <= t]
+        if not active:
+            t = min(back.values())
+            continue
+        channel = active[turn % len(active)]
+        turn += 1
+        if channel == sensors and rng.random() < FLAKY_TIMEOUTS:
+            elapsed, distance, error = READ_TIMEOUT, None, RuntimeError("Timeout waiting for VL53L0X!")
+        else:
+            elapsed, distance, error = rng.uniform(*READ_TIME), rng.randint(1200, 2000), None
+        t += elapsed
+        reads[channel] += 1
+        bus_time[channel] += elapsed
+        quarantine = health.record(channel, distance, error, elapsed, now=t)
+        if quarantine:
+            quarantines[channel] += 1
+            back[channel] = t + quarantine
+            health.mark_online(channel, back[channel])
+    return {channel: (reads[channel], bus_time[channel] / t, quarantines[channel]) for channel in channels}
+
+
+def print_health_report(report, sensors):
+    for channel, (reads, share, quarantines) in report.items():
+        label = f"{channel} (flaky)" if channel == sensors else str(channel)
+        print(f"channel {label:<10} reads {reads:>6}  "
+              f"bus {share:>4.0%}  quarantines {quarantines}")
+
+
+def print_alloc_report(report):
+    print(f"Checked {report['samples']} samples and {report['frames']} frames after warm-up"
+          f"{'' if report['bus'] else ' (no stair bus)'}")
+    for step in ("sample", "frame"):
+        print(f"{step:<7} p{TRANSIENT_PERCENTILE} held at once {report['transient'][step]:>6} B "
+              f"(limit {TRANSIENT_LIMIT} B)  highest {report['highest'][step]:>6} B  "
+              f"steps over the limit: {report['over'][step]}")
+    print(f"gc collections: {report['collections']}")
+    print(f"lines holding more than {report['retained_limit']} new objects (one per sensor): "
+          f"{len(report['retained'])}")
+    for stat in report["retained"]:
+        frame = stat.traceback[0]
+        print(f"retained {stat.size_diff:>7} B in {stat.count_diff:>5} blocks  "
+              f"{os.path.basename(frame.filename)}:{frame.lineno}")
+    print("Allocation check " + ("passed" if report["ok"] else "FAILED"))
+
+
+def print_report(report):
+    elapsed = report["elapsed"]
+    print(f"Processed {report['processed']} samples in {elapsed:.2f}s "
+          f"({report['processed'] / elapsed if elapsed else 0:.0f} samples/s)")
+    print(f"Dropped samples: {report['dropped']}   Invalid readings: {report['invalid']}")
+    print(f"Trigger edges: {report['produced_edges']} produced / {report['expected_edges']} recorded "
+          f"({max(0, report['expected_edges'] - report['produced_edges'])} missed)")
+    print(f"strip.show() calls: {report['shows']}   Sounds submitted: {report['sounds']}")
+    print()
+    print(f"{'Stage':<8} {'count':>8} {'p50 us':>10} {'p90 us':>10} {'p99 us':>10} {'max us':>10}")
+    stats = report["stats"]
+    for stage in ("read", "filter", "led", "audio", "total"):
+        values = stats.percentiles(stage)
+        if values is None:
+            continue
+        count = len(stats.samples[stage])
+        print(f"{stage:<8} {count:>8} " + " ".join(f"{v / 1000:>10.1f}" for v in values))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay recorded or synthetic sensor traffic through the pipeline")
+    parser.add_argument("log", nargs="?", help="Sample log to replay (default: synthetic walk scenario)")
+    parser.add_argument("--fast", action="store_true", help="Run as fast as possible instead of 1x")
+    parser.add_argument("--show-time", action="store_true",
+                        help="Block in strip.show() for the WS2812 wire time of the whole strip")
+    parser.add_argument("--duration", type=float, default=60.0, help="Synthetic scenario length in seconds")
+    parser.add_argument("--walkers", type=int, default=10, help="Synthetic scenario walker count")
+    parser.add_argument("--trace", metavar="PATH", help="Write a Chrome trace of the run to PATH")
+    parser.add_argument("--alloc-check", action="store_true",
+                        help="Run the steady-state path under tracemalloc; exit 1 if it allocates after warm-up")
+    parser.add_argument("--health-check", type=int, metavar="SENSORS",
+                        help="Score this many healthy sensors, read back to back, on a simulated clock; "
+                             "exit 1 if any is quarantined")
+    parser.add_argument("--flaky", action="store_true",
+                        help="With --health-check, add a sensor that times out on some reads")
+    args = parser.parse_args()
+
+    if args.health_check:
+        report = run_health_check(args.health_check, args.duration, args.flaky)
+        print_health_report(report, args.health_check)
+        sys.exit(1 if any(report[channel][2] for channel in range(args.health_check)) else 0)
+
+    if args.log:
+        source = SampleLogReader(args.log).samples()
+    else:
+        source = synthetic_walk(args.duration, args.walkers, landings=args.alloc_check)
+    show_time = LED_COUNT * 24 * WS2812_BIT_TIME if args.show_time else 0.0
+
+    if args.alloc_check:
+        report = run_alloc_check(source)
+        print_alloc_report(report)
+        sys.exit(0 if report["ok"] else 1)
+
+    tracing.enabled = args.trace is not None
+    print_report(run_replay(source, realtime=not args.fast, show_time=show_time))
+    if args.trace:
+        print(f"\nWrote {tracing.dump_chrome_trace(args.trace)} trace events to {args.trace}")
+
+
+if __name__ == "__main__":
+    main()
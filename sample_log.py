@@ -0,0 +1,352 @@
+#!/usr/bin/env python3
+
+import os
+import queue
+import struct
+import threading
+import time
+from bisect import bisect_right
+
+from realtime import configure_thread, prefault
+
+# File layout
+#
+#   [file header: HEADER_FORMAT, then one u16 stair number per channel (NO_STAIR
+#    if none), zero-padded to a multiple of HEADER_SIZE bytes]
+#   [block 0, BLOCK_SIZE bytes][block 1, BLOCK_SIZE bytes] ...
+#
+# Every block is self-contained: the delta state is reset at the start of a
+# block, so a reader can seek straight to any block (see the .idx sidecar)
+# and decode from there.
+#
+# Record encoding inside a block (all fields unsigned LEB128 varints):
+#   tag       = (channel << 2) | (valid << 1) | triggered
+#   dt_us     = microseconds since the previous record in this block
+#   reading   = zigzag(distance - previous distance of this channel), only if valid
+LOG_MAGIC = b"CSLG"
+LOG_VERSION = 2
+HEADER_SIZE = 256
+HEADER_FORMAT = "<4sBxHfQH"         # magic, version, block_size, trigger, start epoch us, n_channels
+CHANNEL_FORMAT = "<H"               # stair number
+V1_HEADER_FORMAT = "<4sBBHfQ"       # magic, version, n_channels, block_size, trigger, start epoch us
+BLOCK_SIZE = 4096
+BLOCK_MAGIC = b"SBLK"
+BLOCK_HEADER_FORMAT = "<4sHHIQ"     # magic, payload length, record count, block seq, base us
+BLOCK_HEADER_SIZE = struct.calcsize(BLOCK_HEADER_FORMAT)
+INDEX_FORMAT = "<IQQH"              # block seq, first us, last us, record count
+INDEX_SIZE = struct.calcsize(INDEX_FORMAT)
+MAX_RECORD_SIZE = 16                # 3 varints, worst case for our value ranges
+NO_STAIR = 0xFFFF
+V1_NO_STAIR = 0xFF
+_ZEROS = memoryview(bytes(BLOCK_SIZE))
+
+
+def _header_size(num_channels):
+    """Bytes before the first block for a log of num_channels."""
+    size = struct.calcsize(HEADER_FORMAT) + num_channels * struct.calcsize(CHANNEL_FORMAT)
+    return -(-size // HEADER_SIZE) * HEADER_SIZE
+
+
+def _put_varint(buf, pos, value):
+    """Write an unsigned LEB128 varint into buf at pos.
+
+    Returns:
+        int: Position just past the encoded value
+    """
+    while value >= 0x80:
+        buf[pos] = (value & 0x7F) | 0x80
+        value >>= 7
+        pos += 1
+    buf[pos] = value
+    return pos + 1
+
+
+def _get_varint(buf, pos):
+    """Read an unsigned LEB128 varint from buf at pos.
+
+    Returns:
+        tuple: (value, position just past the encoded value)
+    """
+    result = 0
+    shift = 0
+    while True:
+        byte = buf[pos]
+        pos += 1
+        result |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return result, pos
+        shift += 7
+
+
+def _zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def _unzigzag(value):
+    return (value >> 1) if not value & 1 else -((value + 1) >> 1)
+
+
+class SampleLogWriter:
+    """Compact binary log of sensor samples, written by a background thread.
+
+    The sensor loop encodes straight into one of a small pool of preallocated
+    block buffers; full blocks are handed to a writer thread so the loop never
+    touches the SD card. If the writer falls behind and the pool runs dry,
+    samples are counted as dropped instead of stalling the loop.
+    """
+
+    def __init__(self, path, stair_mapping, trigger_distance, num_channels=None, num_blocks=4,
+                 flush_interval=10.0, max_bytes=64 * 1024 * 1024):
+        """Create the log and start the writer thread.
+
+        Args:
+            path: Output file path. An index is kept next to it at path + ".idx"
+            stair_mapping: Dict of {global_channel: stair_number or None}
+            trigger_distance: Trigger threshold in mm, stored for the viewer
+            num_channels: Global channels that can be recorded, e.g. the multiplexer's
+                num_channels. Defaults to the highest channel in stair_mapping plus one
+            num_blocks: Number of preallocated block buffers
+            flush_interval: Seconds after which a partly filled block is written anyway
+            max_bytes: Size at which the log is rotated to path + ".1"
+        """
+        self.path = path
+        self.index_path = path + ".idx"
+        if num_channels is None:
+            num_channels = max(stair_mapping.keys()) + 1 if stair_mapping else 0
+        self.num_channels = num_channels
+        self.header_size = _header_size(num_channels)
+        self.stair_mapping = stair_mapping
+        self.trigger_distance = trigger_distance
+        self.flush_interval = flush_interval
+        self.max_bytes = max_bytes
+        self.dropped = 0
+
+        # Per-channel delta state, reset at every block boundary
+        self._last_value = [0] * self.num_channels
+
+        self._free = queue.Queue()
+        self._full = queue.Queue()
+        for _ in range(num_blocks):
+            block = bytearray(BLOCK_SIZE)
+            prefault(block)
+            self._free.put(block)
+
+        self._seq = 0
+        self._start_us = time.monotonic_ns() // 1000
+        self._start_epoch_us = time.time_ns() // 1000
+        self._block = None
+        self._open_block()
+
+        os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+        self._file = None
+        self._index = None
+        self._open_files()
+
+        self._thread = threading.Thread(target=self._writer_loop, name="sample-log", daemon=True)
+        self._thread.start()
+
+    def _open_files(self):
+        self._file = open(self.path, "wb")
+        self._index = open(self.index_path, "wb")
+        header = bytearray(self.header_size)
+        struct.pack_into(HEADER_FORMAT, header, 0, LOG_MAGIC, LOG_VERSION, BLOCK_SIZE,
+                         self.trigger_distance, self._start_epoch_us, self.num_channels)
+        offset = struct.calcsize(HEADER_FORMAT)
+        for channel in range(self.num_channels):
+            stair_num = self.stair_mapping.get(channel)
+            struct.pack_into(CHANNEL_FORMAT, header, offset, NO_STAIR if stair_num is None else stair_num)
+            offset += struct.calcsize(CHANNEL_FORMAT)
+        self._file.write(header)
+        self._file.flush()
+        self._bytes_written = self.header_size
+
+    def _open_block(self):
+        """Take a free buffer and start a new block. Leaves _block as None if none are free."""
+        try:
+            self._block = self._free.get_nowait()
+        except queue.Empty:
+            self._block = None
+            return
+        self._pos = BLOCK_HEADER_SIZE
+        self._count = 0
+        self._first_us = 0
+        self._prev_us = 0
+        self._opened_at = time.monotonic()
+        for channel in range(self.num_channels):
+            self._last_value[channel] = 0
+
+    def _seal_block(self):
+        """Finish the current block and queue it for the writer thread."""
+        block = self._block
+        struct.pack_into(BLOCK_HEADER_FORMAT, block, 0, BLOCK_MAGIC, self._pos - BLOCK_HEADER_SIZE,
+                         self._count, self._seq, self._first_us)
+        # Zero the unused tail so stale data from a recycled buffer never reaches disk
+        block[self._pos:] = _ZEROS[self._pos:]
+        self._full.put((self._seq, self._first_us, self._prev_us, self._count, block))
+        self._seq += 1
+        self._open_block()
+
+    def record(self, channel, distance, triggered):
+        """Append one sample.
+
+        Args:
+            channel: Global channel number
+            distance: Distance in mm, or None if the read failed
+            triggered: Current trigger state of the channel
+        """
+        now_us = time.monotonic_ns() // 1000 - self._start_us
+
+        if self._block is None:
+            self._open_block()
+            if self._block is None:
+                self.dropped += 1
+                return
+        elif self._pos + MAX_RECORD_SIZE > BLOCK_SIZE or \
+                (self._count and time.monotonic() - self._opened_at >= self.flush_interval):
+            self._seal_block()
+            if self._block is None:
+                self.dropped += 1
+                return
+
+        if self._count == 0:
+            self._first_us = now_us
+            self._prev_us = now_us
+
+        block = self._block
+        valid = distance is not None
+        pos = _put_varint(block, self._pos, (channel << 2) | (valid << 1) | bool(triggered))
+        pos = _put_varint(block, pos, now_us - self._prev_us)
+        if valid:
+            value = int(distance)
+            pos = _put_varint(block, pos, _zigzag(value - self._last_value[channel]))
+            self._last_value[channel] = value
+        self._pos = pos
+        self._prev_us = now_us
+        self._count += 1
+
+    def flush(self):
+        """Queue the current partial block for writing."""
+        if self._block is not None and self._count:
+            self._seal_block()
+
+    def close(self):
+        """Flush outstanding samples and stop the writer thread."""
+        self.flush()
+        self._full.put(None)
+        self._thread.join()
+        self._file.close()
+        self._index.close()
+
+    def _rotate(self):
+        self._file.close()
+        self._index.close()
+        os.replace(self.path, self.path + ".1")
+        os.replace(self.index_path, self.index_path + ".1")
+        self._open_files()
+
+    def _writer_loop(self):
+        configure_thread("background")
+        while True:
+            item = self._full.get()
+            if item is None:
+                return
+            seq, first_us, last_us, count, block = item
+            try:
+                if self._bytes_written + BLOCK_SIZE > self.max_bytes:
+                    self._rotate()
+                self._file.write(block)
+                self._file.flush()
+                self._index.write(struct.pack(INDEX_FORMAT, seq, first_us, last_us, count))
+                self._index.flush()
+                self._bytes_written += BLOCK_SIZE
+            except OSError as e:
+                print(f"Sample log write failed: {e}")
+            finally:
+                self._free.put(block)
+
+
+class SampleLogReader:
+    """Reads logs produced by SampleLogWriter."""
+
+    def __init__(self, path):
+        """Open a sample log and its block index.
+
+        Args:
+            path: Log file path
+        """
+        self.path = path
+        with open(path, "rb") as f:
+            header = f.read(HEADER_SIZE)
+            magic, version = struct.unpack_from("<4sB", header, 0)
+            if magic != LOG_MAGIC or version not in (1, LOG_VERSION):
+                raise ValueError(f"{path} is not a sample log")
+            self.stair_mapping = {}
+            if version == 1:
+                # One-byte channel count and stair numbers, all inside the first HEADER_SIZE bytes
+                _, _, num_channels, block_size, trigger, start_epoch_us = \
+                    struct.unpack_from(V1_HEADER_FORMAT, header, 0)
+                offset = struct.calcsize(V1_HEADER_FORMAT)
+                for channel in range(num_channels):
+                    stair_num = header[offset + channel]
+                    self.stair_mapping[channel] = None if stair_num == V1_NO_STAIR else stair_num
+                self.header_size = HEADER_SIZE
+            else:
+                _, _, block_size, trigger, start_epoch_us, num_channels = \
+                    struct.unpack_from(HEADER_FORMAT, header, 0)
+                self.header_size = _header_size(num_channels)
+                f.seek(0)
+                header = f.read(self.header_size)
+                offset = struct.calcsize(HEADER_FORMAT)
+                for channel in range(num_channels):
+                    stair_num = struct.unpack_from(CHANNEL_FORMAT, header, offset)[0]
+                    offset += struct.calcsize(CHANNEL_FORMAT)
+                    self.stair_mapping[channel] = None if stair_num == NO_STAIR else stair_num
+        self.num_channels = num_channels
+        self.block_size = block_size
+        self.trigger_distance = trigger
+        self.start_epoch_us = start_epoch_us
+
+        self.index = []
+        index_path = path + ".idx"
+        if os.path.exists(index_path):
+            with open(index_path, "rb") as f:
+                data = f.read()
+            for pos in range(0, len(data) - INDEX_SIZE + 1, INDEX_SIZE):
+                self.index.append(struct.unpack_from(INDEX_FORMAT, data, pos))
+
+    def num_blocks(self):
+        size = os.path.getsize(self.path)
+        return (size - self.header_size) // self.block_size
+
+    def find_block(self, t_us):
+        """Return the number of the block containing time t_us (relative to log start)."""
+        if not self.index:
+            return 0
+        firsts = [entry[1] for entry in self.index]
+        return max(0, bisect_right(firsts, t_us) - 1)
+
+    def samples(self, first_block=0):
+        """Yield (t_us, channel, distance_or_None, triggered) from first_block onwards."""
+        with open(self.path, "rb") as f:
+            f.seek(self.header_size + first_block * self.block_size)
+            while True:
+                block = f.read(self.block_size)
+                if len(block) < self.block_size:
+                    return
+                magic, length, count, _seq, base_us = struct.unpack_from(BLOCK_HEADER_FORMAT, block, 0)
+                if magic != BLOCK_MAGIC:
+                    return
+                last_value = [0] * self.num_channels
+                t_us = base_us
+                pos = BLOCK_HEADER_SIZE
+                for _ in range(count):
+                    tag, pos = _get_varint(block, pos)
+                    dt, pos = _get_varint(block, pos)
+                    t_us += dt
+                    channel = tag >> 2
+                    distance = None
+                    if tag & 0b10:
+                        delta, pos = _get_varint(block, pos)
+                        distance = last_value[channel] + _unzigzag(delta)
+                        last_value[channel] = distance
+                    yield t_us, channel, distance, bool(tag & 0b01)
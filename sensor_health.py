@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+
+import errno
+import json
+import os
+import time
+
+# VL53L0X reports 8190/8191 mm when nothing is in range; that is a normal empty stair
+OUT_OF_RANGE_MM = 8190
+# A real sensor jitters by a few mm. The same in-range value this many times in a row means it is wedged
+STUCK_LIMIT = 200
+
+SCORE_ALPHA = 0.1           # EWMA weight of the newest read in the failure score
+SCORE_LIMIT = 0.5           # Quarantine when more than half of recent reads fail
+CONSECUTIVE_LIMIT = 3       # ...or after this many failures in a row
+BUS_WINDOW = 1.0            # Seconds of bus time accounting per window
+BUS_SHARE_LIMIT = 0.2       # ...and quarantine a sensor that wastes more than this share of it
+READ_COST_INITIAL = 0.045   # Expected seconds per read until successful reads have been timed
+READ_COST_ALPHA = 0.05      # EWMA weight of the newest successful read in the expected cost
+READ_COST_MARGIN = 1.5      # A successful read wastes whatever it takes beyond this multiple of the expected cost
+
+QUARANTINE_MIN = 1.0        # First quarantine; doubles on each repeat
+QUARANTINE_MAX = 300.0
+STABLE_TIME = 60.0          # Healthy this long in the sweep and the backoff resets
+
+
+class SensorHealth:
+    """Counters and failure score for one sensor channel."""
+
+    def __init__(self, channel):
+        self.channel = channel
+        self.reads = 0
+        self.errors = 0
+        self.nacks = 0
+        self.timeouts = 0
+        self.stuck = 0
+        self.out_of_range = 0
+        self.score = 0.0
+        self.consecutive = 0
+        self.bus_time = 0.0
+        self.window_start = 0.0
+        self.window_wasted = 0.0
+        self.last_value = None
+        self.same_count = 0
+        self.quarantines = 0
+        self.quarantined_until = 0.0
+        self.online_since = 0.0
+
+    def as_dict(self, now):
+        return {
+            "reads": self.reads,
+            "errors": self.errors,
+            "nacks": self.nacks,
+            "timeouts": self.timeouts,
+            "stuck": self.stuck,
+            "out_of_range": self.out_of_range,
+            "score": round(self.score, 3),
+            "bus_time_s": round(self.bus_time, 3),
+            "quarantines": self.quarantines,
+            "quarantined_for_s": round(max(0.0, self.quarantined_until - now), 1),
+        }
+
+
+class HealthMonitor:
+    """Scores every read and decides when a sensor should leave the sweep.
+
+    A single failed read is dropped and the sensor stays in the sweep. A
+    sensor is quarantined when its failure score or run of consecutive
+    failures crosses a limit, when its value is stuck, or when it wastes more
+    than BUS_SHARE_LIMIT of the bus (a sensor that times out on most reads
+    would otherwise hold the bus for 100ms per turn). Only wasted bus time
+    counts: all of a failed read's, and whatever a successful read takes
+    beyond READ_COST_MARGIN times the expected cost. The expected cost is the
+    running average of successful reads on every sensor. A healthy sensor's
+    plain share of the bus, half of it with two sensors, never counts.
+    Quarantine length doubles on each repeat, so a dying sensor's re-init
+    attempts take a shrinking share of bus time.
+    """
+
+    def __init__(self):
+        self.sensors = {}
+        self.read_cost = READ_COST_INITIAL
+        self.slots = 0
+        self.missed_slots = 0
+
+    def get(self, channel):
+        health = self.sensors.get(channel)
+        if health is None:
+            health = self.sensors[channel] = SensorHealth(channel)
+        return health
+
+    def record(self, channel, distance, error=None, elapsed=0.0, now=None):
+        """Account one read.
+
+        Args:
+            channel: Global channel number
+            distance: Reading in mm, or None if the read failed
+            error: The exception behind a failed read, if known
+            elapsed: Seconds the read held the bus
+            now: Current time.monotonic(), for simulated clocks
+
+        Returns:
+            float: Quarantine length in seconds if the sensor should leave the sweep, else 0
+        """
+        now = time.monotonic() if now is None else now
+        health = self.get(channel)
+        health.reads += 1
+        health.bus_time += elapsed
+        if now - health.window_start >= BUS_WINDOW:
+            health.window_start = now
+            health.window_wasted = 0.0
+        if distance is None:
+            health.window_wasted += elapsed
+        else:
+            health.window_wasted += max(0.0, elapsed - READ_COST_MARGIN * self.read_cost)
+
+        failed = distance is None
+        if failed:
+            health.errors += 1
+            if isinstance(error, OSError) and error.errno == errno.EREMOTEIO:
+                health.nacks += 1
+            elif isinstance(error, RuntimeError) and "Timeout" in str(error):
+                health.timeouts += 1
+        elif distance >= OUT_OF_RANGE_MM:
+            health.out_of_range += 1
+            health.same_count = 0
+        else:
+            if distance == health.last_value:
+                health.same_count += 1
+                if health.same_count >= STUCK_LIMIT:
+                    health.stuck += 1
+                    failed = True
+            else:
+                health.same_count = 0
+            health.last_value = distance
+
+        health.consecutive = health.consecutive + 1 if failed else 0
+        health.score += SCORE_ALPHA * ((1.0 if failed else 0.0) - health.score)
+        if distance is not None and elapsed:
+            self.read_cost += READ_COST_ALPHA * (elapsed - self.read_cost)
+
+        if health.online_since and now - health.online_since >= STABLE_TIME:
+            health.quarantines = 0
+
+        if (health.consecutive >= CONSECUTIVE_LIMIT or health.score > SCORE_LIMIT
+                or health.same_count >= STUCK_LIMIT
+                or health.window_wasted > BUS_WINDOW * BUS_SHARE_LIMIT):
+            return self._quarantine(health, now)
+        return 0.0
+
+    def _quarantine(self, health, now):
+        duration = min(QUARANTINE_MIN * 2 ** health.quarantines, QUARANTINE_MAX)
+        health.quarantines += 1
+        health.quarantined_until = now + duration
+        health.online_since = 0.0
+        # Start clean when it comes back so old failures don't re-quarantine it at once
+        health.score = 0.0
+        health.consecutive = 0
+        health.same_count = 0
+        health.last_value = None
+        health.window_wasted = 0.0
+        return duration
+
+    def record_tick(self, expirations):
+        """Account one sweep timer tick.
+
+        Args:
+            expirations: Periods since the last tick. Above 1, a read or a
+                sensor init ran past the slot; the extra ones are counted as
+                missed, not replayed
+        """
+        self.slots += expirations
+        self.missed_slots += expirations - 1
+
+    def mark_online(self, channel, now=None):
+        self.get(channel).online_since = time.monotonic() if now is None else now
+
+    def snapshot(self):
+        now = time.monotonic()
+        snapshot = {str(channel): health.as_dict(now) for channel, health in sorted(self.sensors.items())}
+        snapshot["sweep"] = {"slots": self.slots, "missed_slots": self.missed_slots}
+        return snapshot
+
+    def write(self, path):
+        """Write snapshot() as JSON, replacing the file atomically."""
+        os.makedirs(os.path.dirname(path) or ".", exist_ok=True)
+        tmp = path + ".tmp"
+        with open(tmp, "w") as f:
+            json.dump(self.snapshot(), f, indent=1)
+        os.replace(tmp, path)
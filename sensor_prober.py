@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+
+import math
+import time
+
+# Initial guesses for how long each probe step holds the bus, refined as steps run
+PRESENCE_COST = 0.001   # mux select + zero-length write to the sensor address
+INIT_COST = 0.06        # full VL53L0X init (SPAD and reference calibration)
+COST_ALPHA = 0.25       # EWMA weight of the newest measurement
+
+# Retry backoff per channel: a connector glitch is retried within ~100ms, an
+# empty channel settles at one presence check every BACKOFF_MAX seconds
+BACKOFF_MIN = 0.1
+BACKOFF_MAX = 5.0
+
+
+class SensorProber:
+    """Re-probes missing sensor channels in the idle time between sweep reads.
+
+    Runs on its own low-rate timer in the main event loop, so it never
+    contends with a sweep read for the bus. Before each step it checks how
+    long until the next sweep tick (Timer.remaining()) and only runs the step
+    if its measured cost fits in that gap. Each missing channel goes through
+    two steps:
+    1. a cheap presence check (does anything ACK at the sensor address?)
+    2. once present, a full init with the channel's cached calibration
+
+    A full VL53L0X init takes about 60ms, six 10ms sweep slots, and can't be
+    split: the driver does all of it in its constructor. When it doesn't fit
+    in the gap, it waits for the start of a slot and then holds the bus for
+    ceil(init_cost / period) slots. Inits are spaced so they take at most
+    slot_share of the sweep's slots, and slots_taken counts them. The sweep
+    timer's deadlines don't move: the slots an init took arrive as extra
+    expirations on the next sweep tick, which counts them as missed
+    (HealthMonitor.record_tick) instead of replaying them.
+    """
+
+    def __init__(self, multiplexer, loop, sweep_timer, on_online, interval=0.02, slot_share=0.1):
+        """
+        Args:
+            multiplexer: VL53L0XMultiplexer (needs probe_channel and init_sensor)
+            loop: EventLoop to run the probe timer on
+            sweep_timer: The sweep Timer whose slots must not be stretched
+            on_online: Called as on_online(channel) when a channel comes back
+            interval: Seconds between probe attempts while channels are missing
+            slot_share: Largest share of sweep slots that inits longer than a slot may take
+        """
+        self.multiplexer = multiplexer
+        self.sweep_timer = sweep_timer
+        self.on_online = on_online
+        self.slot_share = slot_share
+        self.presence_cost = PRESENCE_COST
+        self.init_cost = INIT_COST
+        self.missing = {}  # channel -> [present, next_try, backoff]
+        self._order = []
+        self._cursor = 0
+        self._last_slot_init = 0.0
+        self.skipped = 0
+        self.slots_taken = 0
+        self.timer = loop.add_timer(interval, self._tick, start=False)
+
+    def mark_missing(self, channel, delay=BACKOFF_MIN):
+        """Hand a channel that stopped answering to the prober.
+
+        Args:
+            channel: Global channel number
+            delay: Seconds before the first probe (a quarantine holds it off longer)
+        """
+        if channel in self.missing:
+            return
+        self.missing[channel] = [False, time.monotonic() + delay, BACKOFF_MIN]
+        self._order.append(channel)
+        if not self.timer.armed:
+            self.timer.arm()
+
+    def _slack(self):
+        remaining = self.sweep_timer.remaining()
+        return float("inf") if remaining is None else remaining
+
+    def _next_due(self, now):
+        for _ in range(len(self._order)):
+            channel = self._order[self._cursor % len(self._order)]
+            self._cursor = (self._cursor + 1) % len(self._order)
+            if self.missing[channel][1] <= now:
+                return channel
+        return None
+
+    def _tick(self, expirations):
+        now = time.monotonic()
+        channel = self._next_due(now)
+        if channel is None:
+            return
+        state = self.missing[channel]
+        slack = self._slack()
+
+        if not state[0]:
+            if slack < self.presence_cost:
+                self.skipped += 1
+                self._cursor -= 1  # Same channel gets the next tick
+                return
+            start = time.monotonic()
+            state[0] = self.multiplexer.probe_channel(channel)
+            self.presence_cost += COST_ALPHA * (time.monotonic() - start - self.presence_cost)
+            if not state[0]:
+                self._back_off(state, now)
+            return
+
+        if slack < self.init_cost:
+            period = self.sweep_timer.interval
+            slots = math.ceil(self.init_cost / period)
+            slot_start = slack > period / 2
+            if not (slots > 1 and slot_start
+                    and now - self._last_slot_init >= slots * period / self.slot_share):
+                self.skipped += 1
+                self._cursor -= 1
+                return
+            self._last_slot_init = now
+            self.slots_taken += slots
+
+        start = time.monotonic()
+        ok = self.multiplexer.init_sensor(channel)
+        self.init_cost += COST_ALPHA * (time.monotonic() - start - self.init_cost)
+        if ok:
+            del self.missing[channel]
+            self._order.remove(channel)
+            self._cursor = 0
+            if not self._order:
+                self.timer.disarm()
+            self.on_online(channel)
+        else:
+            state[0] = False
+            self._back_off(state, now)
+
+    def _back_off(self, state, now):
+        state[1] = now + state[2]
+        state[2] = min(state[2] * 2, BACKOFF_MAX)
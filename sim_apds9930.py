@@ -0,0 +1,367 @@
+#!/usr/bin/env python3
+
+import errno
+import math
+import random
+
+# APDS-9930 registers and bit fields (see lib/APDS9930/src/APDS9930.h)
+APDS9930_I2C_ADDR = 0x39
+APDS9930_ID_VALUE = 0x39
+REPEATED_BYTE = 0x80
+AUTO_INCREMENT = 0xA0
+SPECIAL_FN = 0xE0
+
+APDS9930_ENABLE = 0x00
+APDS9930_ATIME = 0x01
+APDS9930_PTIME = 0x02
+APDS9930_WTIME = 0x03
+APDS9930_PILTL = 0x08
+APDS9930_PIHTL = 0x0A
+APDS9930_PERS = 0x0C
+APDS9930_CONFIG = 0x0D
+APDS9930_PPULSE = 0x0E
+APDS9930_CONTROL = 0x0F
+APDS9930_ID = 0x12
+APDS9930_STATUS = 0x13
+APDS9930_Ch0DATAL = 0x14
+APDS9930_PDATAL = 0x18
+APDS9930_POFFSET = 0x1E
+
+PON = 0x01
+AEN = 0x02
+PEN = 0x04
+WEN = 0x08
+AIEN = 0x10
+PIEN = 0x20
+
+STATUS_AVALID = 0x01
+STATUS_PVALID = 0x02
+STATUS_AINT = 0x10
+STATUS_PINT = 0x20
+
+INTEGRATION_STEP = 0.00273      # seconds per ATIME/PTIME/WTIME step
+PULSE_TIME = 0.000016           # seconds per proximity LED pulse
+PDATA_MAX = 1023
+
+# Proximity model: counts = PROX_K * scale / d^2, where scale is 1.0 at the
+# driver defaults (8 pulses, 100 mA, 8x gain). Calibrated so a foot at 600 mm
+# reads about 60 counts and anything closer than ~145 mm saturates.
+PROX_K = 60.0 * 600.0 ** 2
+LED_DRIVE_MA = (100.0, 50.0, 25.0, 12.5)
+PGAIN = (1.0, 2.0, 4.0, 8.0)
+AGAIN = (1.0, 8.0, 16.0, 120.0)
+NO_TARGET = 5000.0              # mm, what the sensor sees with nobody on the stair
+
+TCA9548A_ADDRESSES = range(0x70, 0x78)
+
+# Linux i2c_msg flags, for SimulatedI2CBus.transfer()
+I2C_M_RD = 0x0001
+I2C_M_STOP = 0x8000
+
+
+def proximity_scale(ppulse, drive, pgain):
+    """Relative proximity sensitivity versus the driver defaults."""
+    return (ppulse / 8.0) * (LED_DRIVE_MA[drive] / 100.0) * (PGAIN[pgain] / 8.0)
+
+
+def proximity_to_distance(pdata, scale=1.0):
+    """Invert the proximity model. Returns distance in mm."""
+    if pdata <= 0:
+        return NO_TARGET
+    return min(NO_TARGET, (PROX_K * scale / pdata) ** 0.5)
+
+
+class SimulatedAPDS9930:
+    """Register-level model of one APDS-9930.
+
+    The device runs its own conversion cycle against the simulation clock:
+    advance(now) completes every cycle that has finished by `now` and latches
+    a new PDATA from the current target distance.
+    """
+
+    def __init__(self, rng=None, noise=2.0, ambient_lux=50.0, osc=1.0):
+        self.rng = rng or random.Random()
+        self.noise = noise
+        self.ambient_lux = ambient_lux
+        self.osc = osc          # Internal oscillator period relative to nominal
+        self.target_distance = NO_TARGET
+        self.extra_ir = 0.0     # Constant stray IR in counts at the driver defaults
+        self.neighbours = []    # (device, counts at defaults when both pulse together)
+        self.regs = bytearray(0x20)
+        self.regs[APDS9930_ID] = APDS9930_ID_VALUE
+        self.regs[APDS9930_ATIME] = 0xFF
+        self.regs[APDS9930_PTIME] = 0xFF
+        self.regs[APDS9930_WTIME] = 0xFF
+        self.address = 0
+        self.auto_increment = True
+        self.cycle_start = 0.0
+        self.now = 0.0
+        self.prox_persist = 0
+
+    # -- Conversion model --------------------------------------------------
+
+    def cycle_time(self):
+        """Length of one full ALS/prox/wait cycle in seconds, per the datasheet state machine."""
+        enable = self.regs[APDS9930_ENABLE]
+        t = 0.0
+        if enable & PEN:
+            t += INTEGRATION_STEP * (256 - self.regs[APDS9930_PTIME]) + PULSE_TIME * self.regs[APDS9930_PPULSE]
+        if enable & WEN:
+            t += INTEGRATION_STEP * (256 - self.regs[APDS9930_WTIME])
+        if enable & AEN:
+            t += INTEGRATION_STEP * (256 - self.regs[APDS9930_ATIME])
+        return max(t, INTEGRATION_STEP) * self.osc
+
+    def proximity_window(self):
+        """Offset and length (seconds) of the LED pulse train within a cycle."""
+        return 0.0, PULSE_TIME * self.regs[APDS9930_PPULSE]
+
+    def led_intensity(self):
+        """This device's LED current relative to the driver default (100 mA)."""
+        return LED_DRIVE_MA[self.regs[APDS9930_CONTROL] >> 6] / 100.0
+
+    def pulse_overlap(self, t0, t1):
+        """Seconds of this device's LED pulses that fall within [t0, t1)."""
+        enable = self.regs[APDS9930_ENABLE]
+        if not enable & PON or not enable & PEN:
+            return 0.0
+        period = self.cycle_time()
+        offset, length = self.proximity_window()
+        start = self.cycle_start + offset + period * math.floor((t0 - self.cycle_start - offset) / period)
+        total = 0.0
+        while start < t1:
+            total += max(0.0, min(t1, start + length) - max(t0, start))
+            start += period
+        return total
+
+    def advance(self, now):
+        """Run the conversion state machine up to time `now` (seconds)."""
+        self.now = now
+        enable = self.regs[APDS9930_ENABLE]
+        if not enable & PON or not enable & (PEN | AEN):
+            self.cycle_start = now
+            return
+        period = self.cycle_time()
+        if now - self.cycle_start < period:
+            return
+        self.cycle_start += period * int((now - self.cycle_start) / period)
+        if enable & PEN:
+            self._convert_proximity(self.cycle_start - period)
+        if enable & AEN:
+            self._convert_als()
+
+    def _convert_proximity(self, cycle_start):
+        control = self.regs[APDS9930_CONTROL]
+        scale = proximity_scale(self.regs[APDS9930_PPULSE], control >> 6, (control >> 2) & 0x03)
+        counts = PROX_K * scale / max(self.target_distance, 1.0) ** 2
+        counts += self.extra_ir * scale + self.rng.gauss(0.0, self.noise)
+
+        # Neighbouring LEDs only add counts during the part of our pulse train they overlap
+        offset, length = self.proximity_window()
+        t0 = cycle_start + offset
+        receiver = (self.regs[APDS9930_PPULSE] / 8.0) * (PGAIN[(control >> 2) & 0x03] / 8.0)
+        for device, coupling in self.neighbours:
+            overlap = device.pulse_overlap(t0, t0 + length)
+            if overlap:
+                counts += coupling * device.led_intensity() * receiver * overlap / length
+        pdata = max(0, min(PDATA_MAX, int(counts)))
+        self.regs[APDS9930_PDATAL] = pdata & 0xFF
+        self.regs[APDS9930_PDATAL + 1] = pdata >> 8
+        status = self.regs[APDS9930_STATUS] | STATUS_PVALID
+
+        low = self.regs[APDS9930_PILTL] | (self.regs[APDS9930_PILTL + 1] << 8)
+        high = self.regs[APDS9930_PIHTL] | (self.regs[APDS9930_PIHTL + 1] << 8)
+        if pdata < low or pdata > high:
+            self.prox_persist += 1
+        else:
+            self.prox_persist = 0
+        if self.prox_persist >= max(1, self.regs[APDS9930_PERS] >> 4) and \
+                self.regs[APDS9930_ENABLE] & PIEN:
+            status |= STATUS_PINT
+        self.regs[APDS9930_STATUS] = status
+
+    def _convert_als(self):
+        atime = 256 - self.regs[APDS9930_ATIME]
+        gain = AGAIN[self.regs[APDS9930_CONTROL] & 0x03]
+        # A foot over the sensor shades it
+        shade = min(1.0, self.target_distance / 600.0)
+        ch0 = min(0xFFFF, int(self.ambient_lux * shade * atime * gain * 0.3))
+        ch1 = min(0xFFFF, int(ch0 * 0.25))
+        self.regs[APDS9930_Ch0DATAL:APDS9930_Ch0DATAL + 4] = bytes(
+            (ch0 & 0xFF, ch0 >> 8, ch1 & 0xFF, ch1 >> 8))
+        self.regs[APDS9930_STATUS] |= STATUS_AVALID
+
+    @property
+    def interrupt(self):
+        """State of the (active low) INT pin, True when asserted."""
+        return bool(self.regs[APDS9930_STATUS] & (STATUS_PINT | STATUS_AINT))
+
+    # -- I2C interface ------------------------------------------------------
+
+    def i2c_write(self, data):
+        if not data:
+            return
+        command = data[0]
+        if command & 0x80:
+            kind = command & 0xE0
+            if kind == SPECIAL_FN:
+                function = command & 0x1F
+                if function in (0x05, 0x07):
+                    self.regs[APDS9930_STATUS] &= ~STATUS_PINT & 0xFF
+                    self.prox_persist = 0
+                if function in (0x06, 0x07):
+                    self.regs[APDS9930_STATUS] &= ~STATUS_AINT & 0xFF
+                return
+            self.address = command & 0x1F
+            self.auto_increment = kind == AUTO_INCREMENT
+        for value in data[1:]:
+            if self.address not in (APDS9930_ID, APDS9930_STATUS):
+                if self.address == APDS9930_ENABLE:
+                    if not value & PON:
+                        self.regs[APDS9930_STATUS] = 0
+                    if not self.regs[APDS9930_ENABLE] & (PEN | AEN) and value & (PEN | AEN):
+                        # The first cycle starts when the write lands (advance() sets now)
+                        self.cycle_start = self.now
+                self.regs[self.address] = value
+            if self.auto_increment:
+                self.address = (self.address + 1) & 0x1F
+
+    def i2c_read(self, length):
+        out = bytearray(length)
+        for i in range(length):
+            out[i] = self.regs[self.address]
+            if self.address == APDS9930_PDATAL + 1:
+                self.regs[APDS9930_STATUS] &= ~STATUS_PVALID & 0xFF
+            if self.auto_increment:
+                self.address = (self.address + 1) & 0x1F
+        return bytes(out)
+
+
+class SimulatedTCA9548A:
+    """TCA9548A model. Each channel is a dict of {address: device}, and may hold another mux."""
+
+    def __init__(self):
+        self.mask = 0
+        self.channels = [{} for _ in range(8)]
+
+    def i2c_write(self, data):
+        if data:
+            self.mask = data[-1]
+
+    def i2c_read(self, length):
+        return bytes([self.mask]) * length
+
+    def attach(self, channel, address, device):
+        self.channels[channel][address] = device
+
+
+class SimulatedI2CBus:
+    """One I2C bus with devices and muxes behind it.
+
+    Keeps a running total of bus time from the bit count of each transaction,
+    so the simulator can tell when a sweep no longer fits its period.
+    """
+
+    def __init__(self, clock_hz=400000, protocol_mangling=True):
+        self.clock_hz = clock_hz
+        # False behaves like the Pi's i2c-bcm2835: no I2C_M_STOP, and a read only as the last message
+        self.protocol_mangling = protocol_mangling
+        self.devices = {}
+        self.busy_time = 0.0
+        self.transactions = 0
+
+    def attach(self, address, device):
+        self.devices[address] = device
+
+    def _targets(self, devices, address, out):
+        device = devices.get(address)
+        if device is not None:
+            out.append(device)
+        for mux_address, mux in devices.items():
+            if isinstance(mux, SimulatedTCA9548A) and mux_address != address:
+                for channel in range(8):
+                    if mux.mask & (1 << channel):
+                        self._targets(mux.channels[channel], address, out)
+        return out
+
+    def _account(self, num_bytes, restarts=0):
+        # 9 clocks per byte (8 data + ACK), plus start/stop and any repeated starts
+        self.busy_time += (num_bytes * 9 + 2 + restarts * 10) / self.clock_hz
+        self.transactions += 1
+
+    def write(self, address, data):
+        self._account(1 + len(data))
+        targets = self._targets(self.devices, address, [])
+        if not targets:
+            raise OSError(errno.EREMOTEIO, "Remote I/O error")
+        for device in targets:
+            device.i2c_write(data)
+
+    def read(self, address, length):
+        self._account(1 + length)
+        targets = self._targets(self.devices, address, [])
+        if not targets:
+            raise OSError(errno.EREMOTEIO, "Remote I/O error")
+        return self._wired_and(targets, length)
+
+    def write_read(self, address, data, length):
+        self._account(2 + len(data) + length, restarts=1)
+        targets = self._targets(self.devices, address, [])
+        if not targets:
+            raise OSError(errno.EREMOTEIO, "Remote I/O error")
+        for device in targets:
+            device.i2c_write(data)
+        return self._wired_and(targets, length)
+
+    def transfer(self, messages):
+        """Run one combined transaction, like a single I2C_RDWR ioctl.
+
+        A TCA9548A only switches channels on a STOP. A mux write therefore
+        takes effect at the next message flagged I2C_M_STOP, or at the end of
+        the transfer.
+
+        Args:
+            messages: List of (address, flags, data). data is bytes for a write
+                and a length for a read (flags & I2C_M_RD)
+
+        Returns:
+            list: bytes for each read message, in order
+        """
+        if not self.protocol_mangling:
+            for i, (_, flags, _) in enumerate(messages):
+                if flags & I2C_M_STOP or (flags & I2C_M_RD and i != len(messages) - 1):
+                    raise OSError(errno.EOPNOTSUPP, "Operation not supported")
+        pending = {}
+        results = []
+        num_bytes = 0
+        for i, (address, flags, data) in enumerate(messages):
+            num_bytes += 1 + (data if flags & I2C_M_RD else len(data))
+            targets = self._targets(self.devices, address, [])
+            if not targets:
+                self._account(num_bytes, i)
+                raise OSError(errno.EREMOTEIO, "Remote I/O error")
+            if flags & I2C_M_RD:
+                results.append(self._wired_and(targets, data))
+            else:
+                for device in targets:
+                    if isinstance(device, SimulatedTCA9548A):
+                        pending[device] = data
+                    else:
+                        device.i2c_write(data)
+            if flags & I2C_M_STOP:
+                for mux, value in pending.items():
+                    mux.i2c_write(value)
+                pending.clear()
+        for mux, value in pending.items():
+            mux.i2c_write(value)
+        self._account(num_bytes, len(messages) - 1)
+        return results
+
+    @staticmethod
+    def _wired_and(targets, length):
+        # Open-drain bus: when several devices answer at once, zeros win
+        result = bytearray(b"\xff" * length)
+        for device in targets:
+            for i, value in enumerate(device.i2c_read(length)):
+                result[i] &= value
+        return bytes(result)
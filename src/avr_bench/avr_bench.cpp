@@ -0,0 +1,52 @@
+/**
+ * @file    avr_bench.cpp
+ * @brief   ATmega328P firmware that times the APDS9930 driver under simavr
+ *
+ * Built by the uno-cycles env and run by avr_bench.py, never flashed. Each
+ * call in BENCH_CALLS runs once between two pin edges (see avr_bench.h), so
+ * the harness gets exact cycle counts and stack depths with no board on the
+ * bench. Timer0's overflow interrupt is turned off first: it would land
+ * inside whichever calls happen to span its period and blur the counts.
+ */
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+
+#include "APDS9930.h"
+#include "avr_bench.h"
+
+static APDS9930 apds;
+static uint16_t proximity;
+static float lux;
+static unsigned long lux_int;
+static APDS9930Sample sample;
+
+#define BENCH_RUN(name, expression) \
+    GPIOR0 = BENCH_##name; \
+    PORTB |= _BV(BENCH_PIN); \
+    asm volatile("" ::: "memory"); \
+    ok = (expression); \
+    asm volatile("" ::: "memory"); \
+    GPIOR1 = ok; \
+    PORTB &= ~_BV(BENCH_PIN);
+
+void setup()
+{
+    bool ok;
+
+    TIMSK0 = 0;
+    DDRB |= _BV(BENCH_PIN);
+
+    BENCH_CALLS(BENCH_RUN)
+
+    /* simavr stops when the core sleeps with interrupts off */
+    GPIOR0 = BENCH_DONE;
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    cli();
+    sleep_enable();
+    sleep_cpu();
+}
+
+void loop()
+{
+}
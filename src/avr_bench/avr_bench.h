@@ -0,0 +1,56 @@
+/**
+ * @file    avr_bench.h
+ * @brief   Calls timed by the ATmega328P driver benchmark, shared with its simavr harness
+ *
+ * avr_bench.cpp runs each call once against a simulated APDS-9930. Before a
+ * call it writes the call's index to GPIOR0 and raises BENCH_PIN. When the
+ * call returns it writes the result (1 for success) to GPIOR1 and drops the
+ * pin. simavr_harness.c takes the cycle counter at both edges. On the rising
+ * edge it also paints the free RAM below the stack pointer, so on the
+ * falling edge it can tell how deep the call went, interrupt frames
+ * included. The `nothing` call measures the marker overhead, which the
+ * harness subtracts.
+ *
+ * Both sides build the call list from BENCH_CALLS, so the index the
+ * firmware writes is the name the harness prints.
+ */
+
+#ifndef AVR_BENCH_H
+#define AVR_BENCH_H
+
+/* Arduino pin 13 (the Uno's LED), PORTB bit 5 */
+#define BENCH_PORT          'B'
+#define BENCH_PIN           5
+
+/* Fixed readings the simulated sensor returns */
+#define BENCH_PDATA         420
+#define BENCH_CH0           1200
+#define BENCH_CH1           300
+
+/* X(name, expression): expression is the call, evaluating true on success */
+#define BENCH_CALLS(X) \
+    X(nothing,                        true) \
+    X(init,                           apds.init()) \
+    X(enableProximitySensor,          apds.enableProximitySensor(false)) \
+    X(enableLightSensor,              apds.enableLightSensor(false)) \
+    X(setLEDDrive,                    apds.setLEDDrive(LED_DRIVE_50MA)) \
+    X(setProximityGain,               apds.setProximityGain(PGAIN_4X)) \
+    X(setAmbientLightGain,            apds.setAmbientLightGain(AGAIN_8X)) \
+    X(setProximityIntLowThreshold,    apds.setProximityIntLowThreshold(10)) \
+    X(setProximityIntHighThreshold,   apds.setProximityIntHighThreshold(80)) \
+    X(readProximity,                  apds.readProximity(proximity)) \
+    X(readAmbientLightLux_float,      apds.readAmbientLightLux(lux)) \
+    X(readAmbientLightLux_ulong,      apds.readAmbientLightLux(lux_int)) \
+    X(readSample,                     apds.readSample(sample))
+
+#define BENCH_ENUM(name, expression)  BENCH_##name,
+
+enum BenchCall {
+    BENCH_CALLS(BENCH_ENUM)
+    BENCH_CALL_COUNT
+};
+
+/* Written to GPIOR0 once every call has run; the firmware then sleeps with interrupts off */
+#define BENCH_DONE          0xFF
+
+#endif
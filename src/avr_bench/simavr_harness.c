@@ -0,0 +1,251 @@
+/**
+ * @file    simavr_harness.c
+ * @brief   Runs the avr_bench firmware on a simulated ATmega328P with an APDS-9930 on TWI
+ *
+ * Usage: simavr_harness <firmware.elf>
+ *
+ * Built on the host against libsimavr by avr_bench.py. The sensor is a
+ * register model: a command byte sets the register pointer (auto-increment
+ * or repeated byte), writes and reads then go through it, and the special
+ * function commands clear the interrupt bits in STATUS. The conversion
+ * registers hold fixed values, since the benchmark is about the driver's
+ * cost and not the readings.
+ *
+ * Prints one line per call in BENCH_CALLS, "name cycles stack_bytes ok",
+ * where cycles still include the marker overhead (the `nothing` line).
+ * Exits non-zero if the core crashes or the firmware never finishes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "avr_ioport.h"
+#include "avr_twi.h"
+
+#include "avr_bench.h"
+
+#define MCU                     "atmega328p"
+#define MCU_FREQUENCY           16000000
+#define MAX_CYCLES              200000000ull
+
+/* ATmega328P data-space addresses */
+#define RAM_START               0x100
+#define GPIOR0_ADDR             0x3E
+#define GPIOR1_ADDR             0x4A
+#define SPL_ADDR                0x5D
+#define SPH_ADDR                0x5E
+
+/* Free RAM is filled with this before each call; the lowest byte changed marks the stack depth */
+#define STACK_PAINT             0xA5
+
+#define APDS9930_I2C_ADDR       0x39
+#define APDS9930_ID_VALUE       0x39
+#define APDS9930_REGS           0x20
+#define APDS9930_ID             0x12
+#define APDS9930_STATUS         0x13
+#define APDS9930_Ch0DATAL       0x14
+#define APDS9930_Ch1DATAL       0x16
+#define APDS9930_PDATAL         0x18
+#define APDS9930_POFFSET        0x1E
+#define COMMAND_TYPE            0x60
+#define COMMAND_AUTO_INCREMENT  0x20
+#define COMMAND_SPECIAL_FN      0x60
+#define COMMAND_ADDR            0x1F
+#define STATUS_AVALID           0x01
+#define STATUS_PVALID           0x02
+#define STATUS_AINT             0x10
+#define STATUS_PINT             0x20
+
+struct apds9930 {
+    avr_irq_t *irq;
+    uint8_t addr;               /* address byte of the current transfer, 0 if not for us */
+    int written;                /* bytes written since the last START */
+    uint8_t reg;
+    uint8_t auto_increment;
+    uint8_t regs[APDS9930_REGS];
+};
+
+struct bench_result {
+    uint64_t cycles;
+    unsigned stack;
+    int ok;
+    int seen;
+};
+
+struct bench {
+    avr_t *avr;
+    uint16_t heap_start;        /* first byte above .data and .bss */
+    uint16_t sp;                /* stack pointer when the pin went up */
+    uint64_t start;
+    int high;
+    struct bench_result results[BENCH_CALL_COUNT];
+};
+
+#define BENCH_NAME(name, expression)    #name,
+
+static const char *bench_names[BENCH_CALL_COUNT] = { BENCH_CALLS(BENCH_NAME) };
+
+static const char *apds9930_irq_names[2] = {
+    [TWI_IRQ_INPUT] = "8>apds9930.out",
+    [TWI_IRQ_OUTPUT] = "32<apds9930.in",
+};
+
+static void apds9930_write(struct apds9930 *p, uint8_t value)
+{
+    if( p->written++ == 0 ) {
+        if( (value & COMMAND_TYPE) == COMMAND_SPECIAL_FN ) {
+            p->regs[APDS9930_STATUS] &= ~(STATUS_AINT | STATUS_PINT);
+        } else {
+            p->reg = value & COMMAND_ADDR;
+            p->auto_increment = (value & COMMAND_TYPE) == COMMAND_AUTO_INCREMENT;
+        }
+        return;
+    }
+    /* ID, STATUS and the conversion results are read-only */
+    if( p->reg < APDS9930_ID || p->reg >= APDS9930_POFFSET ) {
+        p->regs[p->reg] = value;
+    }
+    if( p->auto_increment ) {
+        p->reg = (p->reg + 1) % APDS9930_REGS;
+    }
+}
+
+static uint8_t apds9930_read(struct apds9930 *p)
+{
+    uint8_t value = p->regs[p->reg];
+
+    if( p->auto_increment ) {
+        p->reg = (p->reg + 1) % APDS9930_REGS;
+    }
+    return value;
+}
+
+static void apds9930_twi_hook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    struct apds9930 *p = param;
+    avr_twi_msg_irq_t msg;
+
+    (void)irq;
+    msg.u.v = value;
+    if( msg.u.twi.msg & TWI_COND_STOP ) {
+        p->addr = 0;
+    }
+    if( msg.u.twi.msg & TWI_COND_START ) {
+        p->addr = (msg.u.twi.addr >> 1) == APDS9930_I2C_ADDR ? msg.u.twi.addr : 0;
+        p->written = 0;
+        if( p->addr ) {
+            avr_raise_irq(p->irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, p->addr, 1));
+        }
+    }
+    if( !p->addr ) {
+        return;
+    }
+    if( msg.u.twi.msg & TWI_COND_WRITE ) {
+        avr_raise_irq(p->irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, p->addr, 1));
+        apds9930_write(p, msg.u.twi.data);
+    }
+    if( msg.u.twi.msg & TWI_COND_READ ) {
+        avr_raise_irq(p->irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_READ, p->addr, apds9930_read(p)));
+    }
+}
+
+static void apds9930_attach(avr_t *avr, struct apds9930 *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->regs[APDS9930_ID] = APDS9930_ID_VALUE;
+    p->regs[APDS9930_STATUS] = STATUS_AVALID | STATUS_PVALID;
+    p->regs[APDS9930_Ch0DATAL] = BENCH_CH0 & 0xFF;
+    p->regs[APDS9930_Ch0DATAL + 1] = BENCH_CH0 >> 8;
+    p->regs[APDS9930_Ch1DATAL] = BENCH_CH1 & 0xFF;
+    p->regs[APDS9930_Ch1DATAL + 1] = BENCH_CH1 >> 8;
+    p->regs[APDS9930_PDATAL] = BENCH_PDATA & 0xFF;
+    p->regs[APDS9930_PDATAL + 1] = BENCH_PDATA >> 8;
+
+    p->irq = avr_alloc_irq(&avr->irq_pool, 0, 2, apds9930_irq_names);
+    avr_irq_register_notify(p->irq + TWI_IRQ_OUTPUT, apds9930_twi_hook, p);
+    avr_connect_irq(p->irq + TWI_IRQ_INPUT, avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT));
+    avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT), p->irq + TWI_IRQ_OUTPUT);
+}
+
+static void bench_pin_hook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    struct bench *b = param;
+    uint8_t *data = b->avr->data;
+    struct bench_result *result;
+    uint16_t low;
+
+    (void)irq;
+    if( value && !b->high ) {
+        b->start = b->avr->cycle;
+        b->sp = data[SPL_ADDR] | (data[SPH_ADDR] << 8);
+        /* The stack grows down from sp, which points at the next free byte */
+        if( b->sp >= b->heap_start ) {
+            memset(data + b->heap_start, STACK_PAINT, b->sp + 1 - b->heap_start);
+        }
+    } else if( !value && b->high && data[GPIOR0_ADDR] < BENCH_CALL_COUNT ) {
+        result = &b->results[data[GPIOR0_ADDR]];
+        result->cycles = b->avr->cycle - b->start;
+        result->ok = data[GPIOR1_ADDR] != 0;
+        result->seen = 1;
+        for( low = b->heap_start; low <= b->sp && data[low] == STACK_PAINT; low++ ) {
+        }
+        result->stack = b->sp + 1 - low;
+    }
+    b->high = value != 0;
+}
+
+int main(int argc, char **argv)
+{
+    elf_firmware_t firmware;
+    struct apds9930 sensor;
+    struct bench bench;
+    avr_t *avr;
+    int state;
+    int i;
+
+    if( argc != 2 ) {
+        fprintf(stderr, "usage: %s firmware.elf\n", argv[0]);
+        return 2;
+    }
+    memset(&firmware, 0, sizeof(firmware));
+    if( elf_read_firmware(argv[1], &firmware) != 0 ) {
+        fprintf(stderr, "can't read %s\n", argv[1]);
+        return 2;
+    }
+    strcpy(firmware.mmcu, MCU);
+    firmware.frequency = MCU_FREQUENCY;
+    avr = avr_make_mcu_by_name(firmware.mmcu);
+    if( !avr ) {
+        fprintf(stderr, "simavr has no %s core\n", MCU);
+        return 2;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+
+    apds9930_attach(avr, &sensor);
+    memset(&bench, 0, sizeof(bench));
+    bench.avr = avr;
+    bench.heap_start = RAM_START + firmware.datasize + firmware.bsssize;
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BENCH_PORT), BENCH_PIN),
+                            bench_pin_hook, &bench);
+
+    state = cpu_Running;
+    while( state != cpu_Done && state != cpu_Crashed && avr->cycle < MAX_CYCLES ) {
+        state = avr_run(avr);
+    }
+    if( state == cpu_Crashed || avr->data[GPIOR0_ADDR] != BENCH_DONE ) {
+        fprintf(stderr, "firmware did not finish (state %d, last call %u, %llu cycles)\n",
+                state, avr->data[GPIOR0_ADDR], (unsigned long long)avr->cycle);
+        return 1;
+    }
+    for( i = 0; i < BENCH_CALL_COUNT; i++ ) {
+        if( bench.results[i].seen ) {
+            printf("%s %llu %u %d\n", bench_names[i], (unsigned long long)bench.results[i].cycles,
+                   bench.results[i].stack, bench.results[i].ok);
+        }
+    }
+    return 0;
+}
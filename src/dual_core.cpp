@@ -0,0 +1,164 @@
+/**
+ * @file    dual_core.cpp
+ * @brief   Core pinning and cross-core signals for the dual-core firmware build
+ */
+
+#include "dual_core.h"
+
+#ifdef STREAM_DUAL_CORE
+
+#if defined(ESP32)
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#define DUAL_CORE_STACK         4096
+#define DUAL_CORE_PRIORITY      (configMAX_PRIORITIES - 2)
+
+static TaskHandle_t led_task;
+static QueueHandle_t config_queue;
+
+static void runTask(void *fn)
+{
+    ((CoreTaskFn)fn)();
+}
+
+/**
+ * @brief Creates the mailbox, so configuration can be posted before the tasks start
+ */
+void coreBegin()
+{
+    config_queue = xQueueCreate(1, sizeof(FastPathConfig));
+}
+
+/**
+ * @brief Starts the sweep on core 0 and the LED output on core 1
+ *
+ * Both run at the same high priority on their own core, so neither
+ * preempts the other. The Wi-Fi/BT stack, if enabled, shares core 0.
+ */
+void coreStart(CoreTaskFn sensor, CoreTaskFn led)
+{
+    xTaskCreatePinnedToCore(runTask, "leds", DUAL_CORE_STACK, (void *)led, DUAL_CORE_PRIORITY,
+                            &led_task, DUAL_CORE_LED);
+    xTaskCreatePinnedToCore(runTask, "sweep", DUAL_CORE_STACK, (void *)sensor, DUAL_CORE_PRIORITY,
+                            NULL, DUAL_CORE_SENSOR);
+}
+
+/**
+ * @brief Retires the Arduino loop task once the pinned tasks are running
+ */
+void coreIdle()
+{
+    vTaskDelete(NULL);
+}
+
+void ledWake()
+{
+    xTaskNotifyGive(led_task);
+}
+
+void ledWakeFromISR()
+{
+    BaseType_t woken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(led_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void ledWait(uint32_t timeout_ms)
+{
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+}
+
+void configPost(const FastPathConfig &config)
+{
+    xQueueOverwrite(config_queue, &config);
+}
+
+bool configTake(FastPathConfig &config)
+{
+    return xQueueReceive(config_queue, &config, 0) == pdTRUE;
+}
+
+#else
+
+/* Native build: two threads stand in for the two cores */
+
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static std::mutex wake_lock;
+static std::condition_variable wake_cond;
+static bool woken;
+
+static std::mutex config_lock;
+static FastPathConfig config_slot;
+static bool config_ready;
+
+void coreBegin()
+{
+}
+
+void coreStart(CoreTaskFn sensor, CoreTaskFn led)
+{
+    std::thread(led).detach();
+    std::thread(sensor).detach();
+}
+
+void coreIdle()
+{
+    for( ;; ) {
+        pause();
+    }
+}
+
+void ledWake()
+{
+    {
+        std::lock_guard<std::mutex> guard(wake_lock);
+        woken = true;
+    }
+    wake_cond.notify_one();
+}
+
+void ledWakeFromISR()
+{
+    ledWake();
+}
+
+void ledWait(uint32_t timeout_ms)
+{
+    std::unique_lock<std::mutex> guard(wake_lock);
+
+    wake_cond.wait_for(guard, std::chrono::milliseconds(timeout_ms), [] { return woken; });
+    woken = false;
+}
+
+void configPost(const FastPathConfig &config)
+{
+    std::lock_guard<std::mutex> guard(config_lock);
+
+    config_slot = config;
+    config_ready = true;
+}
+
+bool configTake(FastPathConfig &config)
+{
+    std::unique_lock<std::mutex> guard(config_lock, std::try_to_lock);
+
+    if( !guard.owns_lock() || !config_ready ) {
+        return false;
+    }
+    config = config_slot;
+    config_ready = false;
+    return true;
+}
+
+#endif
+
+#endif
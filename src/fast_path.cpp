@@ -0,0 +1,243 @@
+/**
+ * @file    fast_path.cpp
+ * @brief   On-MCU trigger filter and stair lighting, with no host round trip
+ */
+
+#include "fast_path.h"
+#include "led_output.h"
+#include "APDS9930.h"
+
+/**
+ * @brief Fills in the thresholds and effect main.py uses, with no layout
+ *
+ * @param[out] config configuration to fill
+ */
+void defaultFastPathConfig(FastPathConfig &config)
+{
+    memset(&config, 0, sizeof(config));
+    config.on = FAST_PATH_DEFAULT_ON;
+    config.off = FAST_PATH_DEFAULT_OFF;
+    config.effect.red = 255;
+    config.effect.green = 0;
+    config.effect.blue = 255;
+    config.effect.fade_in = 5;
+    config.effect.fade_out = 5;
+    config.effect.frame_ms = 20;
+}
+
+/**
+ * @brief Constructor - default thresholds, nothing triggered
+ */
+TriggerFilter::TriggerFilter() :
+    on(FAST_PATH_DEFAULT_ON),
+    off(FAST_PATH_DEFAULT_OFF)
+{
+    memset(triggered, 0, sizeof(triggered));
+}
+
+/**
+ * @brief Runs one reading through the trigger filter
+ *
+ * Only fresh proximity data counts; a sweep that reads a sensor before its
+ * next conversion lands gets PVALID clear and changes nothing.
+ *
+ * @param[in] channel global channel
+ * @param[in] status STATUS as streamed (STREAM_STATUS_ERROR on a failed read)
+ * @param[in] pdata proximity counts
+ * @return New state (1 triggered, 0 released) on an edge, -1 otherwise
+ */
+int8_t TriggerFilter::update(uint8_t channel, uint8_t status, uint16_t pdata)
+{
+    uint8_t bit = 1 << (channel % 8);
+    uint8_t *bits;
+
+    if( channel >= STREAM_MAX_SAMPLES || (status & STREAM_STATUS_ERROR) || !(status & APDS9930_PVALID) ) {
+        return -1;
+    }
+    bits = &triggered[channel / 8];
+    if( *bits & bit ) {
+        if( pdata >= off ) {
+            return -1;
+        }
+        *bits &= ~bit;
+        return 0;
+    }
+    if( pdata < on ) {
+        return -1;
+    }
+    *bits |= bit;
+
+    return 1;
+}
+
+/**
+ * @brief Constructor - no layout until the host (or storage) provides one
+ */
+StairCompositor::StairCompositor() :
+    stairs(0),
+    dirty(false),
+    last_frame(0)
+{
+    FastPathConfig defaults;
+
+    defaultFastPathConfig(defaults);
+    effect = defaults.effect;
+    memset(slot_of, FAST_PATH_NO_STAIR, sizeof(slot_of));
+}
+
+/**
+ * @brief Takes a new layout and effect and rebuilds the channel and LED maps
+ *
+ * The strip runs stair 1 first, so each stair's first LED is the sum of the
+ * LED counts of every lower-numbered stair, as in stair_pipeline.py.
+ * Triggered stairs stay lit under the new layout.
+ *
+ * @param[in] config configuration from the host or from storage
+ * @param[in] triggered trigger bitmask from the filter
+ */
+void StairCompositor::apply(const FastPathConfig &config, const uint8_t *triggered)
+{
+    uint8_t i;
+    uint8_t j;
+
+    stairs = min(config.stairs, (uint8_t)FAST_PATH_MAX_STAIRS);
+    memcpy(layout, config.layout, sizeof(layout[0]) * stairs);
+    effect = config.effect;
+    memset(slot_of, FAST_PATH_NO_STAIR, sizeof(slot_of));
+    for( i = 0; i < stairs; i++ ) {
+        if( layout[i].channel < STREAM_MAX_SAMPLES ) {
+            slot_of[layout[i].channel] = i;
+        }
+        start[i] = 0;
+        for( j = 0; j < stairs; j++ ) {
+            if( layout[j].stair < layout[i].stair ) {
+                start[i] += layout[j].leds;
+            }
+        }
+        level[i] = 0;
+        target[i] = 0;
+        step[i] = 255;
+    }
+    sync(triggered);
+    for( i = 0; i < stairs; i++ ) {
+        level[i] = target[i];
+    }
+    dirty = true;
+}
+
+/**
+ * @brief Starts the fade for one trigger edge
+ *
+ * @param[in] channel global channel
+ * @param[in] state 1 triggered, 0 released
+ */
+void StairCompositor::edge(uint8_t channel, uint8_t state)
+{
+    uint8_t slot;
+
+    if( channel >= STREAM_MAX_SAMPLES || (slot = slot_of[channel]) == FAST_PATH_NO_STAIR ) {
+        return;
+    }
+    if( state ) {
+        startFade(slot, 255, effect.fade_in);
+    } else {
+        startFade(slot, 0, effect.fade_out);
+    }
+}
+
+/**
+ * @brief Brings every stair's target in line with a trigger bitmask
+ *
+ * Used after a layout change, and on a dual-core build when edges were
+ * dropped because the compositor fell behind.
+ *
+ * @param[in] triggered trigger bitmask from the filter
+ */
+void StairCompositor::sync(const uint8_t *triggered)
+{
+    uint8_t i;
+    uint8_t channel;
+    uint8_t lit;
+
+    for( i = 0; i < stairs; i++ ) {
+        channel = layout[i].channel;
+        if( channel >= STREAM_MAX_SAMPLES ) {
+            continue;
+        }
+        lit = (triggered[channel / 8] & (1 << (channel % 8))) ? 255 : 0;
+        if( target[i] != lit ) {
+            startFade(i, lit, lit ? effect.fade_in : effect.fade_out);
+        }
+    }
+}
+
+/**
+ * @brief Benchmark load: fades every settled stair to the other end
+ */
+void StairCompositor::cycle()
+{
+    uint8_t i;
+
+    for( i = 0; i < stairs; i++ ) {
+        if( level[i] == target[i] ) {
+            startFade(i, target[i] ? 0 : 255, target[i] ? effect.fade_out : effect.fade_in);
+        }
+    }
+}
+
+/**
+ * @brief Starts a fade from the current level
+ */
+void StairCompositor::startFade(uint8_t slot, uint8_t to, uint8_t frames)
+{
+    uint8_t distance = (to > level[slot]) ? to - level[slot] : level[slot] - to;
+
+    target[slot] = to;
+    step[slot] = frames ? max(1, (distance + frames - 1) / frames) : 255;
+    dirty = true;
+}
+
+/**
+ * @brief Advances running fades by one frame and shows the strip
+ *
+ * A new edge renders straight away; running fades advance once per
+ * frame_ms. Nothing is sent to the strip while every stair is settled.
+ *
+ * @param[in] now_us current micros()
+ * @return True if the strip was shown
+ */
+bool StairCompositor::render(uint32_t now_us)
+{
+    uint8_t i;
+    bool fading = false;
+
+    if( !dirty && now_us - last_frame < (uint32_t)effect.frame_ms * 1000 ) {
+        return false;
+    }
+    for( i = 0; i < stairs; i++ ) {
+        if( level[i] != target[i] ) {
+            fading = true;
+            break;
+        }
+    }
+    if( !fading && !dirty ) {
+        return false;
+    }
+
+    for( i = 0; i < stairs; i++ ) {
+        if( level[i] < target[i] ) {
+            level[i] = (target[i] - level[i] > step[i]) ? level[i] + step[i] : target[i];
+        } else if( level[i] > target[i] ) {
+            level[i] = (level[i] - target[i] > step[i]) ? level[i] - step[i] : target[i];
+        }
+        ledFill(start[i], layout[i].leds,
+                (uint16_t)effect.red * level[i] / 255,
+                (uint16_t)effect.green * level[i] / 255,
+                (uint16_t)effect.blue * level[i] / 255);
+    }
+    ledShow();
+    dirty = false;
+    last_frame = now_us;
+
+    return true;
+}
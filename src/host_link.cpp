@@ -0,0 +1,195 @@
+/**
+ * @file    host_link.cpp
+ * @brief   Host -> MCU commands for the fast path, read without ever blocking
+ */
+
+#include "host_link.h"
+
+#if defined(__AVR__) || defined(ESP32)
+#include <EEPROM.h>
+#define HOST_LINK_EEPROM
+#endif
+
+/* Stored block: magic, config, CRC of the config */
+struct StoredConfig {
+    uint16_t magic;
+    FastPathConfig config;
+    uint16_t crc;
+};
+
+/**
+ * @brief Constructor
+ *
+ * @param[in] apply called with the full configuration whenever it changes
+ */
+HostLink::HostLink(ApplyFn apply) :
+    apply(apply),
+    len(0),
+    overflow(false)
+{
+    defaultFastPathConfig(config);
+}
+
+/**
+ * @brief Restores the last configuration the host sent, or applies the defaults
+ */
+void HostLink::begin()
+{
+#ifdef HOST_LINK_EEPROM
+#ifdef ESP32
+    EEPROM.begin(sizeof(StoredConfig));
+#endif
+    load();
+#endif
+    apply(config);
+}
+
+/**
+ * @brief Reads whatever bytes are waiting and applies any complete command
+ *
+ * @param[in] in serial port to read
+ * @return True if a command was applied (the caller acknowledges it)
+ */
+bool HostLink::poll(Stream &in)
+{
+    bool applied = false;
+    int value;
+    size_t raw;
+
+    while( in.available() > 0 ) {
+        value = in.read();
+        if( value < 0 ) {
+            break;
+        }
+        if( value != 0 ) {
+            if( len < sizeof(buf) ) {
+                buf[len++] = value;
+            } else {
+                overflow = true;
+            }
+            continue;
+        }
+
+        /* Delimiter: decode what came before it unless it was too long to keep */
+        if( !overflow && len ) {
+            raw = StreamFrame::decode(buf, len);
+            if( raw && handle(buf, raw) ) {
+                applied = true;
+            }
+        }
+        len = 0;
+        overflow = false;
+    }
+
+    return applied;
+}
+
+/**
+ * @brief Applies one decoded command frame
+ *
+ * @param[in] frame raw frame without its CRC
+ * @param[in] len frame length
+ * @return True if the command was valid and applied
+ */
+bool HostLink::handle(const uint8_t *frame, size_t len)
+{
+    const uint8_t *entry = frame + STREAM_HEADER_LEN;
+    uint8_t count = frame[STREAM_HEADER_LEN - 1];
+    uint8_t i;
+    uint8_t phases = 0;
+
+    switch( frame[0] ) {
+    case STREAM_CMD_TRIGGER:
+        if( count != 1 || len != STREAM_HEADER_LEN + STREAM_TRIGGER_LEN ) {
+            return false;
+        }
+        config.on = entry[0] | (entry[1] << 8);
+        config.off = entry[2] | (entry[3] << 8);
+        break;
+
+    case STREAM_CMD_LAYOUT:
+        if( count > FAST_PATH_MAX_STAIRS || len != STREAM_HEADER_LEN + (size_t)count * STREAM_LAYOUT_LEN ) {
+            return false;
+        }
+        config.stairs = count;
+        for( i = 0; i < count; i++, entry += STREAM_LAYOUT_LEN ) {
+            config.layout[i].channel = entry[0];
+            config.layout[i].stair = entry[1];
+            config.layout[i].leds = entry[2] | (entry[3] << 8);
+        }
+        break;
+
+    case STREAM_CMD_EFFECT:
+        if( count != 1 || len != STREAM_HEADER_LEN + STREAM_EFFECT_LEN ) {
+            return false;
+        }
+        config.effect.red = entry[0];
+        config.effect.green = entry[1];
+        config.effect.blue = entry[2];
+        config.effect.fade_in = entry[3];
+        config.effect.fade_out = entry[4];
+        config.effect.frame_ms = entry[5];
+        break;
+
+    case STREAM_CMD_PHASES:
+        if( count > STREAM_MAX_SAMPLES || len != STREAM_HEADER_LEN + (size_t)count * STREAM_PHASE_LEN ) {
+            return false;
+        }
+        for( i = 0; i < count; i++ ) {
+            if( entry[i * STREAM_PHASE_LEN] >= STREAM_MAX_SAMPLES || entry[i * STREAM_PHASE_LEN + 1] >= STREAM_MAX_PHASES ) {
+                return false;
+            }
+        }
+        memset(config.phase_mask, 0, sizeof(config.phase_mask));
+        for( i = 0; i < count; i++, entry += STREAM_PHASE_LEN ) {
+            config.phase_mask[entry[1]][entry[0] / 8] |= 1 << (entry[0] % 8);
+            if( entry[1] >= phases ) {
+                phases = entry[1] + 1;
+            }
+        }
+        config.phases = phases;
+        break;
+
+    default:
+        return false;
+    }
+
+    apply(config);
+    save();
+
+    return true;
+}
+
+/**
+ * @brief Loads the stored configuration, if it is intact
+ */
+void HostLink::load()
+{
+#ifdef HOST_LINK_EEPROM
+    StoredConfig stored;
+
+    EEPROM.get(0, stored);
+    if( stored.magic == HOST_LINK_MAGIC &&
+        stored.crc == StreamFrame::crc16(0xFFFF, (const uint8_t *)&stored.config, sizeof(stored.config)) ) {
+        config = stored.config;
+    }
+#endif
+}
+
+/**
+ * @brief Stores the configuration, skipping the write if nothing changed
+ */
+void HostLink::save()
+{
+#ifdef HOST_LINK_EEPROM
+    StoredConfig stored;
+
+    stored.magic = HOST_LINK_MAGIC;
+    stored.config = config;
+    stored.crc = StreamFrame::crc16(0xFFFF, (const uint8_t *)&stored.config, sizeof(stored.config));
+    EEPROM.put(0, stored);
+#ifdef ESP32
+    EEPROM.commit();
+#endif
+#endif
+}
@@ -0,0 +1,82 @@
+/**
+ * @file    led_output.cpp
+ * @brief   WS2812 output for the firmware's on-MCU fast path
+ */
+
+#include "led_output.h"
+
+#if defined(STREAM_LED_PIN)
+
+#include <FastLED.h>
+
+static CRGB leds[STREAM_LED_MAX];
+static uint32_t shows = 0;
+
+void ledBegin()
+{
+    FastLED.addLeds<WS2812B, STREAM_LED_PIN, GRB>(leds, STREAM_LED_MAX);
+    FastLED.clear(true);
+}
+
+void ledFill(uint16_t start, uint16_t count, uint8_t red, uint8_t green, uint8_t blue)
+{
+    if( start >= STREAM_LED_MAX ) {
+        return;
+    }
+    fill_solid(leds + start, min(count, (uint16_t)(STREAM_LED_MAX - start)), CRGB(red, green, blue));
+}
+
+void ledShow()
+{
+    FastLED.show();
+    shows++;
+}
+
+uint32_t ledShows()
+{
+    return shows;
+}
+
+#elif defined(STREAM_LED_NATIVE)
+
+/* Native build: keep the pixels so a test can inspect them, but drive nothing */
+static uint8_t pixels[STREAM_LED_MAX * 3];
+static uint16_t used = 0;
+static uint32_t shows = 0;
+
+/* WS2812 wire time: 24 bits at 1.25 µs per LED, then the latch */
+#define LED_NATIVE_US_PER_LED   30
+#define LED_NATIVE_LATCH_US     50
+
+void ledBegin()
+{
+    memset(pixels, 0, sizeof(pixels));
+}
+
+void ledFill(uint16_t start, uint16_t count, uint8_t red, uint8_t green, uint8_t blue)
+{
+    uint16_t i;
+
+    for( i = start; i < start + count && i < STREAM_LED_MAX; i++ ) {
+        pixels[i * 3] = green;
+        pixels[i * 3 + 1] = red;
+        pixels[i * 3 + 2] = blue;
+    }
+    used = max(used, (uint16_t)min(start + count, STREAM_LED_MAX));
+}
+
+/**
+ * @brief Blocks for as long as a real show would hold the CPU
+ */
+void ledShow()
+{
+    delayMicroseconds(used * LED_NATIVE_US_PER_LED + LED_NATIVE_LATCH_US);
+    shows++;
+}
+
+uint32_t ledShows()
+{
+    return shows;
+}
+
+#endif
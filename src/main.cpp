@@ -0,0 +1,687 @@
+/**
+ * @file    main.cpp
+ * @brief   Aggregator firmware: sweeps every APDS-9930 and streams frames to the host
+ *
+ * The MCU sits next to the TCA9548A muxes and owns the I2C bus. It reads
+ * every populated sensor back to back (STATUS through PDATA in one burst per
+ * sensor) and sends one StreamFrame per sweep over USB-serial at STREAM_BAUD.
+ * The Pi then reads a single byte stream instead of running thousands of I2C
+ * transactions per second from Python.
+ *
+ * Sensors free-run in proximity mode. A sweep reads each one whether or not
+ * a new conversion has landed; PVALID in the streamed STATUS says which
+ * readings are fresh. If the host sent phase groups (STREAM_CMD_PHASES),
+ * the sweep starts, reads and stops one group at a time instead, so
+ * neighbouring stairs' LEDs never pulse together.
+ *
+ * Each fresh reading also goes through the trigger filter. Edges light the
+ * stair straight from the MCU (with STREAM_LED_PIN set) and are sent to the
+ * host in an edge frame after the sweep's sample frame. Host commands are
+ * picked up between sweeps without waiting for them.
+ *
+ * With STREAM_DUAL_CORE the sweep and the LED output run as two tasks on
+ * separate cores (dual_core.h). Edges go across in an SpscRing and the
+ * trigger bitmask in a DoubleBuffer, so a blocking strip show never delays
+ * a sweep and neither side takes a lock. A stats frame once a second
+ * reports both rates; STREAM_BENCH keeps every stair fading so the LED side
+ * runs at full load.
+ *
+ * Each sensor has an APDS9930AutoGain that backs its LED current, pulse
+ * count and gain off while its reflection runs near saturation, and scales
+ * PDATA back to the driver defaults, so thresholds hold at every setting.
+ * Build with STREAM_FIXED_GAIN to keep every sensor at the defaults.
+ *
+ * The mux addresses come from STREAM_MUXES, e.g.
+ * -DSTREAM_MUXES="0x70,0x77" in platformio.ini.
+ *
+ * With STREAM_INT_PINS, one GPIO per mux in the same order, each wired to
+ * the shared INT line of that mux's sensors, a free-running sweep skips
+ * muxes whose line is high. A low line is handed to serviceInterrupt(),
+ * which reads every sensor on the mux and clears only the ones that fired.
+ * Sensors interrupt above the trigger threshold, so stairs already
+ * triggered are read every sweep until they release. A sweep that reads
+ * nothing sends no sample frame. The interrupt threshold goes through each
+ * sensor's APDS9930AutoGain, so it holds at every rung.
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "APDS9930AutoGain.h"
+#include "APDS9930Mux.h"
+#include "dual_core.h"
+#include "fast_path.h"
+#include "host_link.h"
+#include "led_output.h"
+#include "stream_frame.h"
+
+#ifndef STREAM_MUXES
+#define STREAM_MUXES 0x70, 0x77
+#endif
+
+/* Edges reported per sweep; more than this at once only loses the report, not the light */
+#define STREAM_MAX_EDGES 16
+
+#define STREAM_STATS_INTERVAL   1000000     // µs
+#define STREAM_RETEST_INTERVAL  5000000     // µs between route retests, one route each
+
+/* Phased sweeps: PTIME 0xFF (2.73 ms) plus 8 pulses, 25% over for oscillator spread as in phasing.py */
+#define STREAM_PHASE_SETTLE_US  3600
+
+#ifdef STREAM_DUAL_CORE
+
+#include "double_buffer.h"
+#include "spsc_ring.h"
+
+/* Edges in flight between the cores; a full ring falls back to the bitmask */
+#define STREAM_EDGE_RING        64
+#define STREAM_LED_WAIT_MS      1
+
+struct EdgeEvent {
+    uint8_t channel;
+    uint8_t state;
+};
+
+struct SweepSnapshot {
+    uint8_t triggered[STREAM_MAX_SAMPLES / 8];
+};
+
+typedef std::atomic<uint32_t> Counter;
+
+static SpscRing<EdgeEvent, STREAM_EDGE_RING> edge_ring;
+static DoubleBuffer<SweepSnapshot> snapshots;
+
+#else
+
+typedef uint32_t Counter;
+
+#endif
+
+static APDS9930Mux muxes[] = { STREAM_MUXES };
+static const uint8_t num_muxes = sizeof(muxes) / sizeof(muxes[0]);
+#ifdef STREAM_INT_PINS
+static const uint8_t int_pins[] = { STREAM_INT_PINS };
+static_assert(sizeof(int_pins) == num_muxes, "STREAM_INT_PINS needs one pin per mux in STREAM_MUXES");
+#endif
+#ifndef STREAM_FIXED_GAIN
+static APDS9930AutoGain auto_gain[num_muxes][TCA9548A_CHANNELS];
+#endif
+
+static StreamFrame frame;
+static uint16_t seq = 0;
+
+static void applyConfig(const FastPathConfig &config);
+#ifdef STREAM_INT_PINS
+static void armInterrupts(uint16_t on);
+#endif
+
+static TriggerFilter filter;
+static StairCompositor compositor;
+static HostLink host_link(applyConfig);
+
+static struct {
+    uint8_t channel;
+    uint8_t state;
+    uint16_t dt_us;
+} edges[STREAM_MAX_EDGES];
+static uint8_t num_edges;
+
+/* Written by the LED side, read by the sweep side for the stats frame */
+static Counter led_frames;
+static Counter led_dropped;
+static Counter worst_frame_us;
+
+static uint16_t sweeps;
+static uint32_t info_start;
+static uint16_t worst_sweep_us;
+static uint32_t stats_start;
+static uint32_t retest_start;
+static uint8_t retest_route;
+static bool phased;
+
+/**
+ * @brief Takes a configuration from the host or from storage
+ *
+ * The filter runs in this context and is updated at once. On a dual-core
+ * build the compositor belongs to the LED task, so the configuration is
+ * posted to it instead.
+ */
+static void applyConfig(const FastPathConfig &config)
+{
+    filter.setThresholds(config.on, config.off);
+#ifdef STREAM_INT_PINS
+    armInterrupts(config.on);
+#endif
+#ifdef STREAM_DUAL_CORE
+    configPost(config);
+#else
+    compositor.apply(config, filter.getTriggered());
+#endif
+}
+
+/**
+ * @brief Times one LED frame and counts it if the strip was shown
+ */
+static void renderFrame()
+{
+    uint32_t t_us = micros();
+    uint32_t elapsed;
+
+    if( !compositor.render(t_us) ) {
+        return;
+    }
+    elapsed = micros() - t_us;
+    led_frames++;
+    if( elapsed > worst_frame_us ) {
+        worst_frame_us = elapsed;
+    }
+}
+
+/**
+ * @brief Sends the mux layout so the host can map channels before samples arrive
+ */
+static void sendInfo()
+{
+    uint8_t m;
+
+    info_start = micros();
+    frame.begin(STREAM_FRAME_INFO, seq++, micros());
+    for( m = 0; m < num_muxes; m++ ) {
+        frame.addMux(muxes[m].getAddress(), muxes[m].getPopulated());
+    }
+    frame.send(Serial);
+}
+
+/**
+ * @brief Adds one sample to the frame and runs it through the trigger filter
+ *
+ * @param[in] m mux index
+ * @param[in] channel mux channel
+ * @param[in] status STATUS as streamed
+ * @param[in] pdata proximity counts
+ * @param[in] t_us start of the sweep
+ */
+static void addReading(uint8_t m, uint8_t channel, uint8_t status, uint16_t pdata, uint32_t t_us)
+{
+    uint16_t dt_us;
+    int8_t edge;
+
+    dt_us = micros() - t_us;
+    frame.addSample(m * TCA9548A_CHANNELS + channel, status, pdata, dt_us);
+
+    edge = filter.update(m * TCA9548A_CHANNELS + channel, status, pdata);
+    if( edge < 0 ) {
+        return;
+    }
+#ifdef STREAM_DUAL_CORE
+    edge_ring.push({ (uint8_t)(m * TCA9548A_CHANNELS + channel), (uint8_t)edge });
+    ledWake();
+#else
+    compositor.edge(m * TCA9548A_CHANNELS + channel, edge);
+#endif
+    if( num_edges < STREAM_MAX_EDGES ) {
+        edges[num_edges].channel = m * TCA9548A_CHANNELS + channel;
+        edges[num_edges].state = edge;
+        edges[num_edges].dt_us = dt_us;
+        num_edges++;
+    }
+}
+
+/**
+ * @brief Reads one sensor and passes its sample to addReading()
+ *
+ * @param[in] m mux index
+ * @param[in] channel mux channel; every other mux must be deselected
+ * @param[in] t_us start of the sweep
+ */
+static void readSensor(uint8_t m, uint8_t channel, uint32_t t_us)
+{
+    APDS9930Mux &mux = muxes[m];
+    APDS9930Sample sample;
+    uint8_t status;
+
+    if( mux.select(channel) && mux.sensor().readSample(sample) ) {
+#ifndef STREAM_FIXED_GAIN
+        /* A failed rung write is retried on the next reading */
+        auto_gain[m][channel].update(mux.sensor(), sample);
+#endif
+        status = sample.status & ~STREAM_STATUS_ERROR;
+    } else {
+        /* Enough of these in a row and the route drops to a slower clock */
+        mux.reportError(channel);
+        status = STREAM_STATUS_ERROR;
+        sample.pdata = 0;
+    }
+    addReading(m, channel, status, sample.pdata, t_us);
+}
+
+/**
+ * @brief Switches every sensor between free-running and host-started conversions
+ *
+ * @param[in] on true to stop the free-running cycles, false to restart them
+ */
+static void setPhased(bool on)
+{
+    uint8_t m;
+
+    for( m = 0; m < num_muxes; m++ ) {
+        if( muxes[m].getPopulated() ) {
+            muxes[m].broadcastMode(PROXIMITY, on ? OFF : ON);
+            muxes[m].deselect();
+        }
+    }
+    phased = on;
+}
+
+#ifndef STREAM_INT_PINS
+/**
+ * @brief Reads every free-running sensor, mux by mux
+ *
+ * @param[in] t_us start of the sweep
+ */
+static void sweepFree(uint32_t t_us)
+{
+    uint8_t m;
+    uint8_t channel;
+
+    for( m = 0; m < num_muxes; m++ ) {
+        APDS9930Mux &mux = muxes[m];
+        if( !mux.getPopulated() ) {
+            continue;
+        }
+        for( channel = 0; channel < TCA9548A_CHANNELS; channel++ ) {
+            if( mux.getPopulated() & (1 << channel) ) {
+                readSensor(m, channel, t_us);
+            }
+        }
+
+        /* Every sensor answers at 0x39, so release this mux before the next one selects */
+        mux.deselect();
+    }
+}
+#endif
+
+#ifdef STREAM_INT_PINS
+/**
+ * @brief Sets every sensor to interrupt once PDATA reaches the trigger threshold
+ *
+ * The threshold goes through each sensor's APDS9930AutoGain, which scales
+ * it to the sensor's rung now and again at every rung change. A sensor
+ * that misses the write keeps its old thresholds until then. Before
+ * setup() has begun the muxes nothing is populated and this writes nothing.
+ *
+ * @param[in] on trigger threshold in counts, on the driver defaults' scale
+ */
+static void armInterrupts(uint16_t on)
+{
+    uint16_t high = on ? on - 1 : 0;    // PINT fires above PIHT, the filter at on
+    uint8_t m;
+    uint8_t channel;
+    bool ok;
+
+#ifndef STREAM_FIXED_GAIN
+    APDS9930AutoGain::setIntThresholds(0, high);
+#endif
+    for( m = 0; m < num_muxes; m++ ) {
+        APDS9930Mux &mux = muxes[m];
+        if( !mux.getPopulated() ) {
+            continue;
+        }
+        for( channel = 0; channel < TCA9548A_CHANNELS; channel++ ) {
+            if( !(mux.getPopulated() & (1 << channel)) ) {
+                continue;
+            }
+#ifdef STREAM_FIXED_GAIN
+            ok = mux.select(channel) && mux.sensor().setProximityIntLowThreshold(0) &&
+                 mux.sensor().setProximityIntHighThreshold(high);
+#else
+            ok = mux.select(channel) && auto_gain[m][channel].applyIntThresholds(mux.sensor());
+#endif
+            if( !ok ) {
+                mux.reportError(channel);
+            }
+        }
+        mux.deselect();
+    }
+}
+
+/**
+ * @brief Reads the muxes whose INT line is low, and the stairs already triggered
+ *
+ * An idle mux costs one pin read. Triggered stairs don't interrupt on the
+ * way down, so they are read directly until the filter releases them.
+ *
+ * @param[in] t_us start of the sweep
+ */
+static void sweepInt(uint32_t t_us)
+{
+    APDS9930Sample samples[TCA9548A_CHANNELS];
+    uint8_t fired;
+    uint8_t held;
+    uint8_t m;
+    uint8_t channel;
+
+    for( m = 0; m < num_muxes; m++ ) {
+        APDS9930Mux &mux = muxes[m];
+        if( !mux.getPopulated() ) {
+            continue;
+        }
+        fired = 0;
+        if( digitalRead(int_pins[m]) == LOW ) {
+            fired = mux.serviceInterrupt(samples);
+        }
+        held = filter.getTriggered()[m] & mux.getPopulated() & ~fired;
+        for( channel = 0; channel < TCA9548A_CHANNELS; channel++ ) {
+            if( fired & (1 << channel) ) {
+#ifndef STREAM_FIXED_GAIN
+                /* serviceInterrupt() read it raw and deselected; update() rescales it and may change rung */
+                if( !mux.select(channel) ) {
+                    mux.reportError(channel);
+                    addReading(m, channel, STREAM_STATUS_ERROR, 0, t_us);
+                    continue;
+                }
+                auto_gain[m][channel].update(mux.sensor(), samples[channel]);
+#endif
+                addReading(m, channel, samples[channel].status & ~STREAM_STATUS_ERROR, samples[channel].pdata,
+                           t_us);
+            } else if( held & (1 << channel) ) {
+                readSensor(m, channel, t_us);
+            }
+        }
+        mux.deselect();
+    }
+}
+#endif
+
+/**
+ * @brief Converts and reads the host's phase groups one after another
+ *
+ * Each group is started with one ENABLE write per mux, read once a full
+ * conversion has landed, and stopped before the next group starts, so
+ * sensors in different groups never pulse together. Populated channels the
+ * host left out convert with group 0.
+ *
+ * @param[in] config configuration holding the groups
+ * @param[in] t_us start of the sweep
+ */
+static void sweepPhased(const FastPathConfig &config, uint32_t t_us)
+{
+    uint8_t mask[STREAM_MAX_MUXES];
+    uint32_t start;
+    uint32_t elapsed;
+    uint8_t assigned;
+    uint8_t g;
+    uint8_t m;
+    uint8_t channel;
+
+    for( g = 0; g < config.phases; g++ ) {
+        start = micros();
+        for( m = 0; m < num_muxes; m++ ) {
+            mask[m] = config.phase_mask[g][m];
+            if( g == 0 ) {
+                for( assigned = 0, channel = 0; channel < config.phases; channel++ ) {
+                    assigned |= config.phase_mask[channel][m];
+                }
+                mask[m] |= ~assigned;
+            }
+            mask[m] &= muxes[m].getPopulated();
+            if( mask[m] ) {
+                muxes[m].broadcastMode(PROXIMITY, ON, mask[m]);
+                muxes[m].deselect();
+            }
+        }
+
+        /* One full cycle, with room for the slowest part's oscillator */
+        elapsed = micros() - start;
+        if( elapsed < STREAM_PHASE_SETTLE_US ) {
+            delayMicroseconds(STREAM_PHASE_SETTLE_US - elapsed);
+        }
+
+        for( m = 0; m < num_muxes; m++ ) {
+            if( !mask[m] ) {
+                continue;
+            }
+            for( channel = 0; channel < TCA9548A_CHANNELS; channel++ ) {
+                if( mask[m] & (1 << channel) ) {
+                    readSensor(m, channel, t_us);
+                }
+            }
+            muxes[m].broadcastMode(PROXIMITY, OFF, mask[m]);
+            muxes[m].deselect();
+        }
+    }
+}
+
+/**
+ * @brief Reads every populated sensor once and sends the readings as one frame
+ *
+ * Sensors free-run unless the host sent phase groups. Lights are updated
+ * before the frames go out, so the serial link never sits between a step
+ * and its stair.
+ */
+static void sweep()
+{
+    const FastPathConfig &config = host_link.getConfig();
+    uint32_t t_us = micros();
+    uint16_t dt_us;
+    uint8_t e;
+
+    if( phased != (config.phases > 1) ) {
+        setPhased(config.phases > 1);
+    }
+
+    frame.begin(STREAM_FRAME_SAMPLES, seq, t_us);
+    if( phased ) {
+        sweepPhased(config, t_us);
+    } else {
+#ifdef STREAM_INT_PINS
+        sweepInt(t_us);
+#else
+        sweepFree(t_us);
+#endif
+    }
+#ifdef STREAM_DUAL_CORE
+    memcpy(snapshots.back().triggered, filter.getTriggered(), sizeof(SweepSnapshot::triggered));
+    snapshots.publish();
+#else
+    renderFrame();
+#endif
+    /* An INT sweep with every mux idle reads nothing; don't fill the link with empty frames */
+    if( frame.count() ) {
+        frame.send(Serial);
+        seq++;
+    }
+
+    if( num_edges ) {
+        frame.begin(STREAM_FRAME_EDGES, seq++, t_us);
+        for( e = 0; e < num_edges; e++ ) {
+            frame.addEdge(edges[e].channel, edges[e].state, edges[e].dt_us);
+        }
+        frame.send(Serial);
+        num_edges = 0;
+    }
+
+    sweeps++;
+    dt_us = min(micros() - t_us, (uint32_t)0xFFFF);
+    if( dt_us > worst_sweep_us ) {
+        worst_sweep_us = dt_us;
+    }
+}
+
+/**
+ * @brief Sends the sweep and LED frame rates for the last interval
+ */
+static void sendStats()
+{
+    uint32_t now = micros();
+    uint32_t frames = led_frames;
+    uint32_t dropped = led_dropped;
+    static uint32_t last_frames;
+    static uint32_t last_dropped;
+
+    if( now - stats_start < STREAM_STATS_INTERVAL ) {
+        return;
+    }
+    frame.begin(STREAM_FRAME_STATS, seq++, now);
+    frame.addStats(sweeps, frames - last_frames, dropped - last_dropped, worst_sweep_us,
+                   min((uint32_t)worst_frame_us, (uint32_t)0xFFFF));
+    frame.send(Serial);
+
+    last_frames = frames;
+    last_dropped = dropped;
+    worst_frame_us = 0;
+    worst_sweep_us = 0;
+    sweeps = 0;
+    stats_start = now;
+}
+
+/**
+ * @brief Lets the next populated route try one bus speed faster
+ *
+ * Routes that reportError() slowed down get their speed back once the fault
+ * clears. One route per interval keeps the pause to a few reads.
+ */
+static void retestRoute()
+{
+    uint32_t now = micros();
+    uint8_t i;
+    uint8_t m;
+    uint8_t channel;
+
+    if( now - retest_start < STREAM_RETEST_INTERVAL ) {
+        return;
+    }
+    retest_start = now;
+    for( i = 0; i < num_muxes * TCA9548A_CHANNELS; i++ ) {
+        retest_route = (retest_route + 1) % (num_muxes * TCA9548A_CHANNELS);
+        m = retest_route / TCA9548A_CHANNELS;
+        channel = retest_route % TCA9548A_CHANNELS;
+        if( muxes[m].getPopulated() & (1 << channel) ) {
+            muxes[m].retest(channel);
+            muxes[m].deselect();
+            return;
+        }
+    }
+}
+
+/**
+ * @brief One pass of the sensor side: sweep, host commands, periodic frames
+ */
+static void sensorStep()
+{
+    sweep();
+    if( host_link.poll(Serial) || micros() - info_start >= STREAM_INFO_INTERVAL ) {
+        sendInfo();
+    }
+    sendStats();
+    retestRoute();
+}
+
+#ifdef STREAM_DUAL_CORE
+
+static void sensorTask()
+{
+    for( ;; ) {
+        sensorStep();
+    }
+}
+
+/**
+ * @brief LED core: applies edges and configuration, renders and shows frames
+ *
+ * Wakes on every queued edge, and otherwise every STREAM_LED_WAIT_MS to
+ * advance running fades. If edges were dropped, the stairs are brought in
+ * line with the first trigger bitmask published after the drop.
+ */
+static void ledTask()
+{
+    FastPathConfig config;
+    SweepSnapshot snapshot;
+    EdgeEvent event;
+    uint32_t dropped;
+    uint32_t resync_from = 0;
+    bool resync = false;
+
+    for( ;; ) {
+        ledWait(STREAM_LED_WAIT_MS);
+        if( configTake(config) ) {
+            snapshots.read(snapshot);
+            compositor.apply(config, snapshot.triggered);
+        }
+        while( edge_ring.pop(event) ) {
+            compositor.edge(event.channel, event.state);
+        }
+        dropped = edge_ring.takeDropped();
+        if( dropped ) {
+            led_dropped += dropped;
+            resync_from = snapshots.read(snapshot);
+            resync = true;
+        }
+        if( resync && snapshots.read(snapshot) != resync_from ) {
+            compositor.sync(snapshot.triggered);
+            resync = false;
+        }
+#ifdef STREAM_BENCH
+        compositor.cycle();
+#endif
+        renderFrame();
+    }
+}
+
+#endif
+
+void setup()
+{
+    uint8_t m;
+
+    Serial.begin(STREAM_BAUD);
+    Wire.begin();
+    ledBegin();
+#ifdef STREAM_DUAL_CORE
+    coreBegin();
+#endif
+    host_link.begin();
+
+    /* A stored phase plan holds from the first sweep; the sweep starts each group itself */
+    phased = host_link.getConfig().phases > 1;
+    for( m = 0; m < num_muxes; m++ ) {
+#ifdef STREAM_INT_PINS
+        pinMode(int_pins[m], INPUT_PULLUP);
+#endif
+        if( muxes[m].begin() ) {
+#ifdef STREAM_INT_PINS
+            /* armInterrupts() below sets the thresholds; a latch before then is only serviced once */
+            muxes[m].broadcastMode(PROXIMITY_INT, ON);
+#endif
+            muxes[m].broadcastMode(POWER, ON);
+            if( !phased ) {
+                muxes[m].broadcastMode(PROXIMITY, ON);
+            }
+            muxes[m].deselect();
+        }
+    }
+#ifdef STREAM_INT_PINS
+    armInterrupts(host_link.getConfig().on);
+#endif
+
+    /* Close off anything begin() printed, so the host's first frame starts clean */
+    Serial.write((uint8_t)0);
+    sendInfo();
+    stats_start = micros();
+    retest_start = stats_start;
+#ifdef STREAM_DUAL_CORE
+    coreStart(sensorTask, ledTask);
+#endif
+}
+
+void loop()
+{
+#ifdef STREAM_DUAL_CORE
+    coreIdle();
+#else
+#ifdef STREAM_BENCH
+    compositor.cycle();
+#endif
+    sensorStep();
+#endif
+}
@@ -0,0 +1,81 @@
+/**
+ * @file    Arduino.h
+ * @brief   Minimal Arduino core for the native (Linux) build of the firmware
+ *
+ * Just enough of the Arduino API for the APDS9930 library and src/main.cpp.
+ * Serial writes to the pty named on the command line, and Wire forwards each
+ * transaction to the Python device model on stdin/stdout (see Wire.h and
+ * mcu_sim.py), as does digitalRead(). Timing functions run on CLOCK_MONOTONIC.
+ */
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define F(x)        (x)
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+#define pgm_read_dword(addr)    (*(const uint32_t *)(addr))
+#define DEC         10
+#define HEX         16
+#define LOW         0
+#define HIGH        1
+#define INPUT       0
+#define INPUT_PULLUP 2
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+/* 32 bits like the AVR core, so wraparound matches the hardware */
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+
+/* Pins are simulated by the device model too; only inputs (sensor INT lines) exist */
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+
+template<class A, class B> auto max(A a, B b) -> decltype(a + b) { return a > b ? a : b; }
+template<class A, class B> auto min(A a, B b) -> decltype(a + b) { return a < b ? a : b; }
+
+class Stream {
+public:
+    virtual ~Stream() {}
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t *data, size_t len);
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t print(unsigned long value, int base);
+    size_t println(const char *s) { return print(s) + print("\r\n"); }
+    size_t println(unsigned long value, int base) { return print(value, base) + print("\r\n"); }
+    size_t println() { return print("\r\n"); }
+};
+
+/* Buffers output and writes it to the pty at each frame delimiter and after every loop() */
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    bool open(const char *path);
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *data, size_t len);
+    int available();
+    int read();
+    void flush();
+
+private:
+    int fd = -1;
+    uint8_t buf[4096];
+    size_t len = 0;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * @file    Wire.h
+ * @brief   Wire (I2C) for the native build, backed by the Python device model
+ *
+ * Each transaction is one request on stdout and one reply on stdin:
+ *
+ *   'W' addr len data[len]   ->  status (0 = ACK, 2 = address NACK)
+ *   'R' addr len             ->  count data[count]
+ *   'C' u32 clock_hz         ->  (no reply)
+ *   'I' pin                  ->  level (digitalRead() of a sensor INT line)
+ *
+ * Writes are buffered until endTransmission(), as on the hardware.
+ */
+
+#ifndef NATIVE_WIRE_H
+#define NATIVE_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WIRE_BUFFER_LENGTH  32
+
+class TwoWire {
+public:
+    void begin() {}
+    void setClock(uint32_t hz);
+    void beginTransmission(uint8_t addr) { tx_addr = addr; tx_len = 0; }
+    void beginTransmission(int addr) { beginTransmission((uint8_t)addr); }
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *data, size_t len);
+    uint8_t endTransmission(uint8_t stop = true);
+    uint8_t requestFrom(uint8_t addr, uint8_t len, uint8_t stop = true);
+    uint8_t requestFrom(int addr, int len) { return requestFrom((uint8_t)addr, (uint8_t)len); }
+    int available() { return rx_len - rx_pos; }
+    int read() { return rx_pos < rx_len ? rx_buf[rx_pos++] : -1; }
+
+private:
+    uint8_t tx_addr = 0;
+    uint8_t tx_buf[WIRE_BUFFER_LENGTH];
+    uint8_t tx_len = 0;
+    uint8_t rx_buf[WIRE_BUFFER_LENGTH];
+    uint8_t rx_len = 0;
+    uint8_t rx_pos = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,275 @@
+/**
+ * @file    native_main.cpp
+ * @brief   Runs the firmware as a Linux process against the Python device model
+ *
+ * Usage: program <serial device | fd:N> [clock drift ppm]
+ *
+ * mcu_sim.py starts this with a pipe pair on stdin/stdout for I2C and the
+ * master side of a pty as fd:N for Serial, so the host opens the slave path
+ * just as it would open /dev/ttyACM0. The optional drift scales micros() so
+ * the host's clock model has something to track.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+
+void setup();
+void loop();
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+static struct timespec start;
+static double drift = 1.0;
+
+static uint64_t elapsedNs()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ull + now.tv_nsec - start.tv_nsec;
+}
+
+uint32_t micros()
+{
+    return (uint32_t)(elapsedNs() / 1000 * drift);
+}
+
+uint32_t millis()
+{
+    return (uint32_t)(elapsedNs() / 1000000 * drift);
+}
+
+void delay(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    usleep(us);
+}
+
+size_t Stream::print(unsigned long value, int base)
+{
+    char text[24];
+
+    snprintf(text, sizeof(text), base == HEX ? "%lX" : "%lu", value);
+    return print(text);
+}
+
+size_t Stream::write(const uint8_t *data, size_t len)
+{
+    size_t i;
+
+    for( i = 0; i < len; i++ ) {
+        write(data[i]);
+    }
+    return len;
+}
+
+/* -- Serial ---------------------------------------------------------------- */
+
+bool HardwareSerial::open(const char *path)
+{
+    struct termios tio;
+
+    if( strncmp(path, "fd:", 3) == 0 ) {
+        fd = atoi(path + 3);
+        return fcntl(fd, F_GETFD) >= 0;
+    }
+    fd = ::open(path, O_RDWR | O_NOCTTY);
+    if( fd < 0 ) {
+        return false;
+    }
+    if( tcgetattr(fd, &tio) == 0 ) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return true;
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{
+    if( len == sizeof(buf) ) {
+        flush();
+    }
+    buf[len++] = value;
+    /* The sweep may run in its own thread and never return to loop() */
+    if( value == 0 ) {
+        flush();
+    }
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t count)
+{
+    size_t i;
+
+    for( i = 0; i < count; i++ ) {
+        write(data[i]);
+    }
+    return count;
+}
+
+int HardwareSerial::available()
+{
+    int pending = 0;
+
+    if( ioctl(fd, FIONREAD, &pending) < 0 ) {
+        return 0;
+    }
+    return pending;
+}
+
+int HardwareSerial::read()
+{
+    uint8_t value;
+
+    if( available() <= 0 || ::read(fd, &value, 1) != 1 ) {
+        return -1;
+    }
+    return value;
+}
+
+void HardwareSerial::flush()
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while( done < len ) {
+        n = ::write(fd, buf + done, len - done);
+        if( n < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            /* Host gone: nothing left to stream to */
+            exit(0);
+        }
+        done += n;
+    }
+    len = 0;
+}
+
+/* -- Wire ------------------------------------------------------------------ */
+
+static void pipeWrite(const uint8_t *data, size_t len)
+{
+    if( fwrite(data, 1, len, stdout) != len || fflush(stdout) != 0 ) {
+        exit(0);
+    }
+}
+
+static void pipeRead(uint8_t *data, size_t len)
+{
+    if( fread(data, 1, len, stdin) != len ) {
+        exit(0);
+    }
+}
+
+void TwoWire::setClock(uint32_t hz)
+{
+    uint8_t request[5] = { 'C', (uint8_t)hz, (uint8_t)(hz >> 8), (uint8_t)(hz >> 16), (uint8_t)(hz >> 24) };
+
+    pipeWrite(request, sizeof(request));
+}
+
+size_t TwoWire::write(uint8_t value)
+{
+    if( tx_len >= WIRE_BUFFER_LENGTH ) {
+        return 0;
+    }
+    tx_buf[tx_len++] = value;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t len)
+{
+    size_t i;
+
+    for( i = 0; i < len; i++ ) {
+        if( !write(data[i]) ) {
+            return i;
+        }
+    }
+    return len;
+}
+
+uint8_t TwoWire::endTransmission(uint8_t stop)
+{
+    uint8_t header[3] = { 'W', tx_addr, tx_len };
+    uint8_t status;
+
+    (void)stop;
+    pipeWrite(header, sizeof(header));
+    pipeWrite(tx_buf, tx_len);
+    pipeRead(&status, 1);
+    return status;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t len, uint8_t stop)
+{
+    uint8_t request[3] = { 'R', addr, (uint8_t)min(len, (uint8_t)WIRE_BUFFER_LENGTH) };
+
+    (void)stop;
+    pipeWrite(request, sizeof(request));
+    pipeRead(&rx_len, 1);
+    pipeRead(rx_buf, rx_len);
+    rx_pos = 0;
+    return rx_len;
+}
+
+/* -- GPIO ------------------------------------------------------------------ */
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+int digitalRead(uint8_t pin)
+{
+    uint8_t request[2] = { 'I', pin };
+    uint8_t level;
+
+    pipeWrite(request, sizeof(request));
+    pipeRead(&level, 1);
+    return level;
+}
+
+/* -- Entry point ----------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    if( argc < 2 ) {
+        fprintf(stderr, "usage: %s <serial device | fd:N> [clock drift ppm]\n", argv[0]);
+        return 2;
+    }
+    if( argc > 2 ) {
+        drift = 1.0 + atof(argv[2]) / 1e6;
+    }
+    if( !Serial.open(argv[1]) ) {
+        perror(argv[1]);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    setup();
+#ifndef STREAM_DUAL_CORE
+    /* With STREAM_DUAL_CORE, setup() has started the sweep thread, which owns Serial from then on */
+    Serial.flush();
+#endif
+    for( ;; ) {
+        loop();
+        Serial.flush();
+    }
+}
@@ -0,0 +1,177 @@
+/**
+ * @file    stream_frame.cpp
+ * @brief   Frame building, CRC and COBS encoding for the sample stream
+ */
+
+#include "stream_frame.h"
+
+#ifdef __AVR__
+#include <util/crc16.h>
+#endif
+
+/**
+ * @brief Starts a new frame, discarding whatever was built before
+ *
+ * @param[in] type STREAM_FRAME_SAMPLES or STREAM_FRAME_INFO
+ * @param[in] seq frame sequence number
+ * @param[in] t_us timestamp of the sweep start
+ */
+void StreamFrame::begin(uint8_t type, uint16_t seq, uint32_t t_us)
+{
+    len = 0;
+    put8(type);
+    put16(seq);
+    put16(t_us & 0xFFFF);
+    put16(t_us >> 16);
+    put8(0);
+}
+
+/**
+ * @brief Appends one sensor reading. Readings past STREAM_MAX_SAMPLES are dropped.
+ */
+void StreamFrame::addSample(uint8_t channel, uint8_t status, uint16_t pdata, uint16_t dt_us)
+{
+    if( buf[STREAM_HEADER_LEN - 1] >= STREAM_MAX_SAMPLES ) {
+        return;
+    }
+    put8(channel);
+    put8(status);
+    put16(pdata);
+    put16(dt_us);
+    buf[STREAM_HEADER_LEN - 1]++;
+}
+
+/**
+ * @brief Appends one mux entry to an info frame
+ */
+void StreamFrame::addMux(uint8_t address, uint8_t populated)
+{
+    if( buf[STREAM_HEADER_LEN - 1] >= STREAM_MAX_MUXES ) {
+        return;
+    }
+    put8(address);
+    put8(populated);
+    buf[STREAM_HEADER_LEN - 1]++;
+}
+
+/**
+ * @brief Appends one trigger edge to an edge frame
+ */
+void StreamFrame::addEdge(uint8_t channel, uint8_t state, uint16_t dt_us)
+{
+    if( buf[STREAM_HEADER_LEN - 1] >= STREAM_MAX_SAMPLES ) {
+        return;
+    }
+    put8(channel);
+    put8(state);
+    put16(dt_us);
+    buf[STREAM_HEADER_LEN - 1]++;
+}
+
+/**
+ * @brief Appends the timing entry to a stats frame
+ */
+void StreamFrame::addStats(uint16_t sweeps, uint16_t frames, uint16_t dropped, uint16_t sweep_us, uint16_t frame_us)
+{
+    if( buf[STREAM_HEADER_LEN - 1] ) {
+        return;
+    }
+    put16(sweeps);
+    put16(frames);
+    put16(dropped);
+    put16(sweep_us);
+    put16(frame_us);
+    buf[STREAM_HEADER_LEN - 1]++;
+}
+
+/**
+ * @brief Closes the frame with its CRC and writes it COBS-encoded
+ *
+ * COBS replaces every 0x00 with the distance to the next one, so the only
+ * zero on the wire is the delimiter. Runs are written straight from the
+ * frame buffer; there is no second encoded copy.
+ *
+ * @param[in] out serial port (or any Stream) to write to
+ */
+void StreamFrame::send(Stream &out)
+{
+    uint16_t crc = crc16(0xFFFF, buf, len);
+    put16(crc);
+
+    size_t start = 0;
+    while( start <= len ) {
+        size_t end = start;
+        while( end < len && buf[end] != 0 && end - start < 254 ) {
+            end++;
+        }
+        out.write((uint8_t)(end - start + 1));
+        out.write(buf + start, end - start);
+
+        /* A full 254-byte run has no zero to skip; the next run starts right after it */
+        if( end - start == 254 && end < len ) {
+            start = end;
+        } else {
+            start = end + 1;
+        }
+    }
+    out.write((uint8_t)0);
+}
+
+/**
+ * @brief COBS-decodes a received frame in place and checks its CRC
+ *
+ * @param[in,out] data encoded frame without the 0x00 delimiter
+ * @param[in] len encoded length
+ * @return Length of the raw frame without its CRC, or 0 if it is corrupt
+ */
+size_t StreamFrame::decode(uint8_t *data, size_t len)
+{
+    size_t src = 0;
+    size_t dst = 0;
+    uint8_t code;
+
+    while( src < len ) {
+        code = data[src];
+        if( code == 0 || src + code > len ) {
+            return 0;
+        }
+        memmove(data + dst, data + src + 1, code - 1);
+        dst += code - 1;
+        src += code;
+        if( code < 0xFF && src < len ) {
+            data[dst++] = 0;
+        }
+    }
+    if( dst < STREAM_HEADER_LEN + STREAM_CRC_LEN ) {
+        return 0;
+    }
+    dst -= STREAM_CRC_LEN;
+    if( crc16(0xFFFF, data, dst) != (data[dst] | (data[dst + 1] << 8)) ) {
+        return 0;
+    }
+
+    return dst;
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, MSB first)
+ *
+ * @param[in] crc running value, 0xFFFF to start
+ * @param[in] data bytes to add
+ * @param[in] len number of bytes
+ * @return updated CRC
+ */
+uint16_t StreamFrame::crc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+    for( size_t i = 0; i < len; i++ ) {
+#ifdef __AVR__
+        crc = _crc_xmodem_update(crc, data[i]);
+#else
+        crc ^= (uint16_t)data[i] << 8;
+        for( uint8_t bit = 0; bit < 8; bit++ ) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+#endif
+    }
+    return crc;
+}
@@ -0,0 +1,402 @@
+#!/usr/bin/env python3
+
+import argparse
+import collections
+from array import array
+import json
+import os
+import random
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+STAIR_BUS_GROUP = "239.255.67.83"
+STAIR_BUS_PORT = 6783
+STAIR_BUS_MAGIC = b"CS"
+STAIR_BUS_VERSION = 1
+MAX_STAIRS = 512            # global stair numbers 0-511
+MAX_EDGES = 16              # per datagram; a busier frame sends more than one
+HEARTBEAT_INTERVAL = 0.5    # seconds; an idle node still refreshes its state this often
+NODE_TIMEOUT = 1.5          # seconds without a datagram before a node's stairs are released
+MAX_PENDING = 64            # default local edges held between flushes
+
+# Fixed-size datagram, little-endian:
+#   2s magic, u8 version, u8 node, u16 seq, u16 edge count, u32 t_us (sender CLOCK_MONOTONIC)
+#   MAX_EDGES * (u16 stair, u8 state, u8 age in ms before t_us, capped at 255)
+#   MAX_STAIRS / 8 bytes: the sender's triggered stairs, bit (stair % 8) of byte (stair // 8)
+_header = struct.Struct("<2sBBHHI")
+_edge = struct.Struct("<HBB")
+BITMAP_LEN = MAX_STAIRS // 8
+EDGES_OFFSET = _header.size
+BITMAP_OFFSET = EDGES_OFFSET + MAX_EDGES * _edge.size
+DATAGRAM_LEN = BITMAP_OFFSET + BITMAP_LEN
+_ZEROS = memoryview(bytes(MAX_EDGES * _edge.size))
+
+
+def _now_us():
+    return time.clock_gettime_ns(time.CLOCK_MONOTONIC) // 1000 & 0xFFFFFFFF
+
+
+class StairBus:
+    """Shares stair trigger edges and state between controllers over UDP multicast.
+
+    Each controller runs its own sensors and LED segments and owns the
+    stairs its sensors watch. Local edges are queued with edge() and sent by
+    flush(), which the caller runs once per LED frame. A frame's edges go out
+    together in one fixed-size datagram. Every datagram also carries the
+    sender's full trigger bitmap, so a lost datagram is repaired by the next
+    one. The state is sent again on the frame after any edges, and an idle
+    node resends it every HEARTBEAT_INTERVAL.
+
+    Receivers drop their own datagrams, count sequence gaps as loss and drop
+    stale or duplicate datagrams. on_edge(node, stair, state, t_us) is called
+    for each remote edge, including edges recovered from a bitmap after loss
+    and releases for a node that has gone silent. t_us is the edge time on
+    the sender's CLOCK_MONOTONIC, or on this node's for a release after
+    timeout. Controllers do not share that clock, so t_us only orders edges
+    from one sender; it is not a time on this node. state() gives the global
+    bitmap: this node's stairs plus every live remote node's.
+
+    Use poll() as an EventLoop reader callback on fd. Pending edges are
+    held in preallocated arrays, and datagrams are built and received in
+    place, so steady-state traffic allocates nothing (replay.py --alloc-check).
+    """
+
+    def __init__(self, node, on_edge=None, group=STAIR_BUS_GROUP, port=STAIR_BUS_PORT, interface="0.0.0.0",
+                 ttl=1, drop=0.0, max_pending=MAX_PENDING):
+        """
+        Args:
+            node: This controller's id, 0-255, unique on the group
+            on_edge: Called as on_edge(node, stair, state, t_us) for remote edges. t_us is
+                sender-local microseconds (low 32 bits), only comparable with the same node's
+            group: Multicast group address
+            port: UDP port
+            interface: Local address to send and join on; "127.0.0.1" keeps it on loopback
+            ttl: Multicast TTL, 1 to stay on the local network
+            drop: Fraction of datagrams to skip sending, to exercise loss recovery
+            max_pending: Local edges held between flushes, e.g. two per local stair. Edges
+                past that are not sent, but the bitmap in the next datagram still has them
+        """
+        self.node = node
+        self.on_edge = on_edge
+        self.drop = drop
+
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+        self.sock.bind(("", port))
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP,
+                             socket.inet_aton(group) + socket.inet_aton(interface))
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(interface))
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, ttl)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+        self.sock.setblocking(False)
+        self.fd = self.sock.fileno()
+        self.address = (group, port)
+
+        self.local = bytearray(BITMAP_LEN)
+        # Local edges since the last flush, preallocated so edge() never allocates
+        self._pending_stair = array("H", bytes(2 * max_pending))
+        self._pending_state = bytearray(max_pending)
+        self._pending_us = array("I", bytes(4 * max_pending))
+        self._num_pending = 0
+        self._seq = 0
+        self._last_send = 0.0
+        self._repeat = False
+        self._tx = bytearray(DATAGRAM_LEN)
+        self._rx = bytearray(DATAGRAM_LEN + 1)
+        self._rx_view = memoryview(self._rx)
+
+        self.nodes = {}             # node -> [last seq, last seen (monotonic), bitmap]
+        self.sent = 0
+        self.received = 0
+        self.lost = 0
+        self.stale = 0
+        self.invalid = 0
+        self.repaired = 0
+        self.overflowed = 0
+
+    # -- Sending ---------------------------------------------------------------
+
+    def edge(self, stair, state):
+        """Queue a local trigger edge for the next flush()."""
+        if not 0 <= stair < MAX_STAIRS:
+            return
+        if state:
+            self.local[stair >> 3] |= 1 << (stair & 7)
+        else:
+            self.local[stair >> 3] &= ~(1 << (stair & 7)) & 0xFF
+        n = self._num_pending
+        if n == len(self._pending_state):
+            self.overflowed += 1
+            return
+        self._pending_stair[n] = stair
+        self._pending_state[n] = 1 if state else 0
+        self._pending_us[n] = _now_us()
+        self._num_pending = n + 1
+
+    def flush(self):
+        """Send this frame's edges, or a heartbeat if one is due, and expire silent nodes.
+
+        Returns:
+            int: Datagrams sent
+        """
+        now = time.monotonic()
+        self._expire(now)
+        pending = self._num_pending
+        if not pending and not self._repeat and now - self._last_send < HEARTBEAT_INTERVAL:
+            return 0
+        # The frame after edges resends the state, so one lost datagram costs a frame, not a heartbeat
+        self._repeat = pending > 0
+        count = 0
+        first = 0
+        while True:
+            batch = min(pending - first, MAX_EDGES)
+            self._send(first, batch)
+            count += 1
+            first += batch
+            if first >= pending:
+                break
+        self._num_pending = 0
+        self._last_send = now
+        return count
+
+    def _send(self, first, batch):
+        t_us = _now_us()
+        buf = self._tx
+        _header.pack_into(buf, 0, STAIR_BUS_MAGIC, STAIR_BUS_VERSION, self.node, self._seq, batch, t_us)
+        offset = EDGES_OFFSET
+        for n in range(first, first + batch):
+            _edge.pack_into(buf, offset, self._pending_stair[n], self._pending_state[n],
+                            min(255, ((t_us - self._pending_us[n]) & 0xFFFFFFFF) // 1000))
+            offset += _edge.size
+        buf[offset:BITMAP_OFFSET] = _ZEROS[:BITMAP_OFFSET - offset]
+        buf[BITMAP_OFFSET:] = self.local
+        self._seq = (self._seq + 1) & 0xFFFF
+        if self.drop and random.random() < self.drop:
+            return
+        try:
+            self.sock.sendto(buf, self.address)
+            self.sent += 1
+        except OSError:
+            pass
+
+    # -- Receiving -------------------------------------------------------------
+
+    def poll(self):
+        """Apply one datagram from the socket.
+
+        The EventLoop's readers are level-triggered, so it calls back while
+        more are queued. Reading until EAGAIN would raise, and allocate an
+        exception, on every wakeup.
+        """
+        try:
+            length = self.sock.recv_into(self._rx)
+        except (BlockingIOError, InterruptedError):
+            return
+        self._receive(length, time.monotonic())
+
+    def _receive(self, length, now):
+        rx = self._rx
+        if length != DATAGRAM_LEN:
+            self.invalid += 1
+            return
+        magic, version, node, seq, count, t_us = _header.unpack_from(rx, 0)
+        if magic != STAIR_BUS_MAGIC or version != STAIR_BUS_VERSION or count > MAX_EDGES:
+            self.invalid += 1
+            return
+        if node == self.node:
+            return
+        entry = self.nodes.get(node)
+        if entry is None:
+            entry = self.nodes[node] = [seq, now, bytearray(BITMAP_LEN)]
+        else:
+            gap = (seq - entry[0]) & 0xFFFF
+            if gap == 0 or gap >= 0x8000:
+                self.stale += 1
+                return
+            self.lost += gap - 1
+            entry[0] = seq
+            entry[1] = now
+        self.received += 1
+
+        bitmap = entry[2]
+        on_edge = self.on_edge
+        offset = EDGES_OFFSET
+        for _ in range(count):
+            stair, state, age_ms = _edge.unpack_from(rx, offset)
+            offset += _edge.size
+            if stair >= MAX_STAIRS:
+                continue
+            bit = 1 << (stair & 7)
+            if state:
+                bitmap[stair >> 3] |= bit
+            else:
+                bitmap[stair >> 3] &= ~bit & 0xFF
+            if on_edge:
+                on_edge(node, stair, state, (t_us - age_ms * 1000) & 0xFFFFFFFF)
+
+        # Anything the edges didn't explain was in a lost datagram
+        sent_bitmap = self._rx_view[BITMAP_OFFSET:DATAGRAM_LEN]
+        if sent_bitmap != bitmap:
+            self._apply_bitmap(node, bitmap, sent_bitmap, t_us)
+
+    def _apply_bitmap(self, node, bitmap, new, t_us):
+        for index in range(BITMAP_LEN):
+            changed = bitmap[index] ^ new[index]
+            while changed:
+                bit = changed & -changed
+                changed ^= bit
+                state = 1 if new[index] & bit else 0
+                self.repaired += 1
+                if self.on_edge:
+                    self.on_edge(node, index * 8 + bit.bit_length() - 1, state, t_us)
+            bitmap[index] = new[index]
+
+    def _expire(self, now):
+        for _, seen, _ in self.nodes.values():
+            if now - seen > NODE_TIMEOUT:
+                break
+        else:
+            return
+        for node, (_, seen, bitmap) in list(self.nodes.items()):
+            if now - seen > NODE_TIMEOUT:
+                print(f"Stair bus node {node} went silent, releasing its stairs")
+                self._apply_bitmap(node, bitmap, bytes(BITMAP_LEN), _now_us())
+                del self.nodes[node]
+
+    # -- State -----------------------------------------------------------------
+
+    def state(self):
+        """Global trigger bitmap: this node's stairs OR every live remote node's."""
+        merged = bytearray(self.local)
+        for _, _, bitmap in self.nodes.values():
+            for index in range(BITMAP_LEN):
+                merged[index] |= bitmap[index]
+        return merged
+
+    def triggered(self, stair):
+        if self.local[stair >> 3] & (1 << (stair & 7)):
+            return True
+        return any(bitmap[stair >> 3] & (1 << (stair & 7)) for _, _, bitmap in self.nodes.values())
+
+    def close(self):
+        self.sock.close()
+
+
+# -- Loopback test --------------------------------------------------------------
+
+def _node_main(args):
+    """One controller: its share of a simulated crowd, edges on the bus, a view of everyone else."""
+    from crowd_sim import Crowd
+    from event_loop import EventLoop
+
+    num_stairs = args.stairs * args.nodes
+    own = range(args.node * args.stairs, (args.node + 1) * args.stairs)
+    start = args.start
+    # Every node walks the same seeded crowd, so each one knows the truth for the whole staircase
+    crowd = Crowd(num_stairs, args.people, random.Random(args.seed))
+    latencies = []
+
+    def on_edge(node, stair, state, t_us):
+        # Every node runs on this host, so the sender's monotonic clock is ours too
+        latencies.append(((_now_us() - t_us) & 0xFFFFFFFF) / 1000.0)
+
+    bus = StairBus(args.node, on_edge, port=args.port, interface="127.0.0.1", ttl=0, drop=args.drop)
+    loop = EventLoop()
+    loop.add_reader(bus.fd, bus.poll)
+    local = {}
+    history = collections.deque([set()] * 3, maxlen=3)
+    behind = 0
+    checked = 0
+
+    def on_frame(expirations):
+        nonlocal behind, checked
+        now = time.monotonic() - start
+        if now < args.seconds:
+            crowd.update(now)
+            occupied = crowd.distances(now)
+            for stair in own:
+                state = stair in occupied
+                if local.get(stair, False) != state:
+                    local[stair] = state
+                    bus.edge(stair, state)
+            history.append(set(occupied))
+        bus.flush()
+        if 1.0 < now < args.seconds:
+            # A remote stair is behind if the view matches neither of the last two frames' truth:
+            # one frame for the sender to batch and one for this node's frame phase
+            view = bus.state()
+            for stair in range(num_stairs):
+                if stair not in own:
+                    checked += 1
+                    seen = bool(view[stair >> 3] & (1 << (stair & 7)))
+                    if seen != (stair in history[-2]) and seen != (stair in history[-3]):
+                        behind += 1
+        if now >= args.seconds + 2 * HEARTBEAT_INTERVAL:
+            loop.stop()
+
+    loop.add_timer(args.frame, on_frame)
+    loop.run()
+    latencies.sort()
+    view = bus.state()
+    json.dump({
+        "node": args.node, "sent": bus.sent, "received": bus.received, "lost": bus.lost, "stale": bus.stale,
+        "invalid": bus.invalid, "repaired": bus.repaired, "edges": len(latencies),
+        "p50": latencies[len(latencies) // 2] if latencies else 0.0,
+        "p99": latencies[int(len(latencies) * 0.99)] if latencies else 0.0,
+        "behind": behind, "checked": checked,
+        "local": [stair for stair in own if local.get(stair)],
+        "view": [stair for stair in range(num_stairs) if view[stair >> 3] & (1 << (stair & 7))],
+    }, sys.stdout)
+    print()
+    bus.close()
+    loop.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run several controllers on loopback multicast and check "
+                                                 "that each sees the whole staircase")
+    parser.add_argument("--nodes", type=int, default=4, help="Controller processes")
+    parser.add_argument("--stairs", type=int, default=14, help="Stairs per controller")
+    parser.add_argument("--people", type=float, default=30.0, help="Arrivals per minute")
+    parser.add_argument("--seconds", type=float, default=10.0)
+    parser.add_argument("--frame", type=float, default=0.05, help="LED frame interval, the batching period")
+    parser.add_argument("--drop", type=float, default=0.0, help="Fraction of datagrams each node drops")
+    parser.add_argument("--port", type=int, default=STAIR_BUS_PORT)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--node", type=int, help=argparse.SUPPRESS)
+    parser.add_argument("--start", type=float, help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.node is not None:
+        _node_main(args)
+        return 0
+
+    start = time.monotonic() + 0.5
+    common = [sys.executable, os.path.abspath(__file__), "--nodes", str(args.nodes), "--stairs", str(args.stairs),
+              "--people", str(args.people), "--seconds", str(args.seconds), "--frame", str(args.frame),
+              "--drop", str(args.drop), "--port", str(args.port), "--seed", str(args.seed), "--start", str(start)]
+    procs = [subprocess.Popen(common + ["--node", str(node)], stdout=subprocess.PIPE) for node in range(args.nodes)]
+    # The report is each node's last line of output
+    reports = [json.loads(proc.communicate()[0].splitlines()[-1]) for proc in procs]
+
+    truth = sorted(stair for report in reports for stair in report["local"])
+    ok = True
+    print(f"{args.nodes} nodes x {args.stairs} stairs, {DATAGRAM_LEN}-byte datagrams every "
+          f"{args.frame * 1000:.0f} ms frame with edges, drop {args.drop:.0%}")
+    for report in reports:
+        converged = report["view"] == truth
+        ok = ok and converged
+        print(f"node {report['node']}: sent {report['sent']}  received {report['received']}  "
+              f"lost {report['lost']}  repaired {report['repaired']}  remote edges {report['edges']}  "
+              f"latency p50 {report['p50']:.1f} ms p99 {report['p99']:.1f} ms  "
+              f"view more than a frame behind {report['behind'] / max(1, report['checked']):.2%} of stair-frames  "
+              f"{'converged' if converged else 'DIVERGED'}")
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
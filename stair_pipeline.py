@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+
+import time
+
+from tracing import (trace_point, FILTER_EDGE, COMPOSITOR_FRAME, SHOW_START, SHOW_END,
+                     AUDIO_SUBMIT)
+
+try:
+    from rpi_ws281x import Color
+except ImportError:
+    # Same packing as rpi_ws281x, so the pipeline can run off the Pi (replay, benchmarks)
+    def Color(red, green, blue, white=0):
+        return (white << 24) | (red << 16) | (green << 8) | blue
+
+# Distance configuration (in millimeters)
+TRIGGER_DISTANCE = 609.6  # 24 inches in mm - when to consider "triggered"
+
+# Mapping of multiplexer channels to stair numbers
+# Format: {global_channel: stair_number}
+# Use None for unconnected channels
+STAIR_MAPPING = {
+    0: 9,    # Multiplexer 1, Channel 0 -> Stair 9
+    1: 10,    # Multiplexer 1, Channel 1 -> Stair 10
+    2: None,    # Multiplexer 1, Channel 2 -> NOT CONNECTED
+    3: None,    # Multiplexer 1, Channel 3 -> NOT CONNECTED
+    4: 11,    # Multiplexer 1, Channel 4 -> Stair 11
+    5: 12,    # Multiplexer 1, Channel 5 -> Stair 12
+    6: 13,    # Multiplexer 1, Channel 6 -> Stair 13
+    7: 14,    # Multiplexer 1, Channel 7 -> Stair 14
+
+    8: 1,    # Multiplexer 2, Channel 0 -> Stair 1
+    9: 2,   # Multiplexer 2, Channel 1 -> Stair 2
+    10: 3,  # Multiplexer 2, Channel 2 -> Stair 3
+    11: 4,  # Multiplexer 2, Channel 3 -> Stair 4
+    12: 5,  # Multiplexer 2, Channel 4 -> Stair 5
+    13: 6,  # Multiplexer 2, Channel 5 -> Stair 6
+    14: 7,  # Multiplexer 2, Channel 6 -> Stair 7
+    15: 8,  # Multiplexer 2, Channel 7 -> Stair 8
+}
+
+# Mapping of stair numbers to their LED counts
+# Format: {stair_number: led_count}
+# Default is 114 LEDs per stair if not specified
+STAIR_LED_COUNTS = {
+    1: 114,   # Stair 1: 
+    2: 114,   # Stair 2: 
+    3: 114,   # Stair 3: 
+    4: 114,   # Stair 4: 
+    5: 114,   # Stair 5: 
+    6: 112,   # Stair 6: 
+    7: 112,   # Stair 7: 
+    8: 114,   # Stair 8: 
+    9: 112,   # Stair 9: 
+    10: 114,  # Stair 10:
+    11: 114,  # Stair 11:
+    12: 114,  # Stair 12:
+    13: 114,  # Stair 13:
+    14: 114,  # Stair 14:
+}
+LED_COUNT = sum(STAIR_LED_COUNTS.values())
+
+def get_led_count_for_stair(stair_number):
+    """Get the number of LEDs for a given stair number.
+    
+    Args:
+        stair_number: The stair number to look up
+        
+    Returns:
+        int: Number of LEDs for the stair (defaults to 130 if not specified)
+    """
+    return STAIR_LED_COUNTS.get(stair_number, 130)
+
+def fade_stair_leds(strip, stair_num, target_brightness, fade_steps=10, fade_delay=0.001,
+                    led_counts=STAIR_LED_COUNTS):
+    """Fade a stair's LEDs to a target brightness level.
+    
+    Args:
+        strip: LED strip object
+        stair_num: Stair number to fade
+        target_brightness: Target brightness (0-255)
+        fade_steps: Number of steps for fade
+        fade_delay: Delay between steps in seconds
+        led_counts: Dict of {stair_number: led_count} for the strip layout
+    """
+    if strip is None or stair_num not in led_counts:
+        return
+        
+    # Calculate LED range for this stair
+    start_led = sum(led_counts[i] for i in range(1, stair_num))
+    end_led = start_led + led_counts[stair_num] - 1
+    
+    # Get current brightness of first LED in stair (assuming all LEDs in stair have same brightness)
+    current_color = strip.getPixelColor(start_led)
+    current_brightness = max(
+        (current_color >> 16) & 0xFF,  # Red
+        (current_color >> 8) & 0xFF,   # Green
+        current_color & 0xFF           # Blue
+    )
+    
+    # Calculate step size
+    step_size = (target_brightness - current_brightness) / fade_steps
+    
+    # Fade to target brightness
+    for step in range(fade_steps):
+        brightness = int(current_brightness + (step_size * (step + 1)))
+        color = Color(brightness, 0, brightness)  # Purple color with current brightness
+        
+        for i in range(start_led, end_led + 1):
+            strip.setPixelColor(i, color)
+        trace_point(COMPOSITOR_FRAME, stair_num)
+        trace_point(SHOW_START)
+        strip.show()
+        trace_point(SHOW_END)
+        time.sleep(fade_delay)
+
+
+class StairPipeline:
+    """Trigger filter -> LED fade -> audio, fed one sensor sample at a time.
+
+    The sensor loop in main.py and the replay harness both push samples through
+    this class, so benchmarks exercise exactly the production code path.
+
+    With frame_driven=True, edges only set fade targets and the caller steps
+    all running fades with render_frame() from its frame timer, so a trigger
+    never blocks the sensor loop and each frame costs one strip.show(). Every
+    stair's fade state is allocated up front from led_counts, so edges and
+    frames reuse it instead of allocating (replay.py --alloc-check).
+    """
+
+    def __init__(self, strip, audio=None, fade_in_delay=0.01, fade_out_delay=0.002, stats=None,
+                 stair_mapping=STAIR_MAPPING, led_counts=STAIR_LED_COUNTS, frame_driven=False):
+        """Create the pipeline.
+
+        Args:
+            strip: LED strip object, or None to run without LEDs
+            audio: Object with a play_sound(stair_num) method, or None for no audio
+            fade_in_delay: Delay between fade steps when a stair triggers, in seconds
+            fade_out_delay: Delay between fade steps when a stair releases, in seconds
+            stats: Optional object with add(stage, nanoseconds) for per-stage timing
+            stair_mapping: Dict of {global_channel: stair_number or None}
+            led_counts: Dict of {stair_number: led_count}
+            frame_driven: Step fades from render_frame() instead of blocking in process_sample()
+        """
+        self.strip = strip
+        self.audio = audio
+        self.fade_in_delay = fade_in_delay
+        self.fade_out_delay = fade_out_delay
+        self.stats = stats
+        self.stair_mapping = stair_mapping
+        self.led_counts = led_counts
+        self.sensor_states = {}  # channel -> triggered state
+        self.frame_driven = frame_driven
+
+        # First LED of each stair
+        self.stair_starts = {}
+        start_led = 0
+        for stair_num in sorted(led_counts):
+            self.stair_starts[stair_num] = start_led
+            start_led += led_counts[stair_num]
+
+        # stair -> [brightness, step size, steps left (0 when idle), target], one per stair
+        self.fades = {stair_num: [0.0, 0.0, 0, 0] for stair_num in self.stair_starts}
+        self._fade_order = [(stair_num, self.fades[stair_num], self.stair_starts[stair_num],
+                             self.stair_starts[stair_num] + led_counts[stair_num]) for stair_num in self.stair_starts]
+        self.fading = 0  # Stairs with a fade running
+
+    def add_sensor(self, channel):
+        self.sensor_states[channel] = False
+
+    def remove_sensor(self, channel):
+        self.sensor_states.pop(channel, None)
+
+    def process_sample(self, channel, distance):
+        """Run one valid distance reading through the pipeline.
+
+        Args:
+            channel: Global channel number
+            distance: Distance in mm
+
+        Returns:
+            bool or None: New trigger state if it changed, None otherwise
+        """
+        stats = self.stats
+        t0 = time.perf_counter_ns() if stats else 0
+
+        # Update trigger state
+        was_triggered = self.sensor_states.get(channel, False)
+        is_triggered = distance < TRIGGER_DISTANCE
+        if is_triggered == was_triggered:
+            if stats:
+                stats.add("filter", time.perf_counter_ns() - t0)
+            return None
+        self.sensor_states[channel] = is_triggered
+        trace_point(FILTER_EDGE, channel)
+        if stats:
+            t1 = time.perf_counter_ns()
+            stats.add("filter", t1 - t0)
+
+        # Get corresponding stair number
+        stair_num = self.stair_mapping.get(channel)
+        if stair_num is not None:
+            self.apply_edge(stair_num, is_triggered, t1 if stats else 0)
+        return is_triggered
+
+    def apply_edge(self, stair_num, is_triggered, t1=0):
+        """Run the LED fade and audio for one stair edge.
+
+        process_sample() calls this for local sensors. A controller sharing a
+        staircase (stair_bus.py) calls it for edges from the others, so its
+        LED segment and speaker follow stairs it has no sensor on. Stairs not
+        in led_counts get no fade.
+
+        Args:
+            stair_num: Stair number
+            is_triggered: New trigger state
+            t1: perf_counter_ns() when the filter finished, for stage timing
+        """
+        stats = self.stats
+        if self.strip is not None and self.frame_driven:
+            self._start_fade(stair_num, 255 if is_triggered else 0, fade_steps=5)
+        elif self.strip is not None:
+            if is_triggered:
+                fade_stair_leds(self.strip, stair_num, 255, fade_steps=5, fade_delay=self.fade_in_delay,
+                                led_counts=self.led_counts)
+            else:
+                fade_stair_leds(self.strip, stair_num, 0, fade_steps=5, fade_delay=self.fade_out_delay,
+                                led_counts=self.led_counts)
+            if stats:
+                t2 = time.perf_counter_ns()
+                stats.add("led", t2 - t1)
+                t1 = t2
+
+        if is_triggered and self.audio is not None:
+            self.audio.play_sound(stair_num)
+            trace_point(AUDIO_SUBMIT, stair_num)
+            if stats:
+                stats.add("audio", time.perf_counter_ns() - t1)
+
+    def _start_fade(self, stair_num, target_brightness, fade_steps):
+        fade = self.fades.get(stair_num)
+        if fade is None:
+            return
+        current_color = self.strip.getPixelColor(self.stair_starts[stair_num])
+        current_brightness = max((current_color >> 16) & 0xFF, (current_color >> 8) & 0xFF, current_color & 0xFF)
+        if not fade[2]:
+            self.fading += 1
+        fade[0] = current_brightness
+        fade[1] = (target_brightness - current_brightness) / fade_steps
+        fade[2] = fade_steps
+        fade[3] = target_brightness
+
+    def render_frame(self):
+        """Advance every running fade by one step and show the frame.
+
+        Returns:
+            bool: True if fades are still running and another frame is needed
+        """
+        if not self.fading or self.strip is None:
+            return False
+        strip = self.strip
+        for stair_num, fade, start_led, end_led in self._fade_order:
+            if not fade[2]:
+                continue
+            fade[0] += fade[1]
+            fade[2] -= 1
+            brightness = fade[3] if fade[2] <= 0 else max(0, min(255, int(fade[0])))
+            color = Color(brightness, 0, brightness)  # Purple color with current brightness
+            for i in range(start_led, end_led):
+                strip.setPixelColor(i, color)
+            if fade[2] <= 0:
+                fade[2] = 0
+                self.fading -= 1
+        trace_point(COMPOSITOR_FRAME, self.fading)
+        trace_point(SHOW_START)
+        strip.show()
+        trace_point(SHOW_END)
+        return self.fading > 0
@@ -0,0 +1,445 @@
+#!/usr/bin/env python3
+
+import argparse
+import binascii
+import os
+import struct
+import termios
+import time
+import tty
+from array import array
+
+from i2c_rdwr import SAMPLE_LEN
+from sim_apds9930 import PROX_K
+
+# Mirrors include/stream_frame.h
+STREAM_FRAME_SAMPLES = 0x01
+STREAM_FRAME_INFO = 0x02
+STREAM_FRAME_EDGES = 0x03
+STREAM_FRAME_STATS = 0x04
+STREAM_CMD_TRIGGER = 0x10
+STREAM_CMD_LAYOUT = 0x11
+STREAM_CMD_EFFECT = 0x12
+STREAM_CMD_PHASES = 0x13
+STREAM_HEADER_FORMAT = "<BHIB"      # type, seq, t_us, count
+STREAM_HEADER_LEN = struct.calcsize(STREAM_HEADER_FORMAT)
+STREAM_SAMPLE_FORMAT = "<BBHH"      # channel, status, pdata, dt_us
+STREAM_SAMPLE_LEN = struct.calcsize(STREAM_SAMPLE_FORMAT)
+STREAM_MUX_FORMAT = "<BB"           # address, populated mask
+STREAM_EDGE_FORMAT = "<BBH"         # channel, state, dt_us
+STREAM_EDGE_LEN = struct.calcsize(STREAM_EDGE_FORMAT)
+STREAM_STATS_FORMAT = "<HHHHH"      # sweeps/s, LED frames/s, dropped edges, worst sweep us, worst frame us
+STREAM_STATS_LEN = struct.calcsize(STREAM_STATS_FORMAT)
+STREAM_STATUS_ERROR = 0x80
+STREAM_MAX_CHANNELS = 64
+MAX_ENCODED = 512           # Largest COBS frame plus slack; anything longer without a 0x00 is junk
+RING_SIZE = 64 * 1024
+READ_SIZE = 16 * 1024
+CLOCK_WINDOW = 0.5          # seconds of MCU time per minimum-delay point
+CLOCK_POINTS = 32           # window minima kept for the drift fit
+RELEASE_MARGIN = 1.1        # a foot must move this much further away to release the trigger
+
+_header = struct.Struct(STREAM_HEADER_FORMAT)
+_u16 = struct.Struct("<H")
+_stats = struct.Struct(STREAM_STATS_FORMAT)
+
+
+class ClockSync:
+    """Maps the MCU's 32-bit micros() onto host time.monotonic().
+
+    Every frame gives host_rx - mcu_time = offset + transport delay, and the
+    delay is never negative. The smallest value in each CLOCK_WINDOW is the
+    best estimate of the offset at that moment. A least-squares line through
+    the last CLOCK_POINTS minima gives the offset and the MCU crystal's drift,
+    so timestamps stay right between windows. USB batching adds delay that
+    varies by up to a millisecond, and the minima filter it out.
+    """
+
+    def __init__(self):
+        self.wraps = 0
+        self.last_us = None
+        self.points = []            # (mcu seconds, min delay) per window
+        self.window_end = None
+        self.window_min = None
+        self.offset = None
+        self.skew = 0.0             # host seconds per MCU second - 1
+        self.ref = 0.0
+
+    def unwrap(self, t_us):
+        """Extend micros() past its 71 minute wrap. Returns MCU seconds."""
+        if self.last_us is not None and t_us < self.last_us - 0x80000000:
+            self.wraps += 1
+        self.last_us = t_us
+        return (self.wraps * 0x100000000 + t_us) / 1e6
+
+    def observe(self, mcu_s, host_s):
+        """Feed one frame's MCU timestamp and the host time it was read."""
+        delay = host_s - mcu_s
+        if self.window_end is None:
+            self.window_end = mcu_s + CLOCK_WINDOW
+            self.window_min = delay
+            self.offset = delay
+            self.ref = mcu_s
+        elif mcu_s < self.window_end:
+            self.window_min = min(self.window_min, delay)
+        else:
+            self.points.append((self.window_end - CLOCK_WINDOW / 2, self.window_min))
+            del self.points[:-CLOCK_POINTS]
+            self.window_end = mcu_s + CLOCK_WINDOW
+            self.window_min = delay
+            self._fit()
+        if not self.points:
+            self.offset = min(self.offset, delay)
+
+    def _fit(self):
+        n = len(self.points)
+        if n < 2:
+            self.ref, self.offset = self.points[0]
+            return
+        mean_x = sum(x for x, _ in self.points) / n
+        mean_y = sum(y for _, y in self.points) / n
+        sxx = sum((x - mean_x) ** 2 for x, _ in self.points)
+        sxy = sum((x - mean_x) * (y - mean_y) for x, y in self.points)
+        self.skew = sxy / sxx if sxx else 0.0
+        self.ref = mean_x
+        self.offset = mean_y
+
+    def to_host(self, mcu_s):
+        """Host monotonic time for an MCU time in seconds."""
+        return mcu_s + self.offset + self.skew * (mcu_s - self.ref)
+
+    @property
+    def drift_ppm(self):
+        """How fast the MCU clock runs against the host's, in ppm."""
+        return -self.skew * 1e6
+
+
+def cobs_encode(data):
+    """COBS-encode one frame and append the 0x00 delimiter."""
+    out = bytearray()
+    for block in bytes(data).split(b"\x00"):
+        while len(block) >= 254:
+            out += b"\xff" + block[:254]
+            block = block[254:]
+        out += bytes([len(block) + 1]) + block
+    out.append(0)
+    return bytes(out)
+
+
+def encode_command(command, entries, count):
+    """Build one host -> MCU command frame, ready to write."""
+    raw = _header.pack(command, 0, 0, count) + entries
+    return cobs_encode(raw + _u16.pack(binascii.crc_hqx(raw, 0xFFFF)))
+
+
+def config_commands(stair_mapping, led_counts, trigger_distance, color=(255, 0, 255), fade_in=5, fade_out=5,
+                    frame_ms=20, groups=()):
+    """Commands that give the firmware's fast path the same behaviour as StairPipeline.
+
+    The trigger distance becomes a PDATA threshold through the proximity model
+    at the driver defaults. The release threshold sits RELEASE_MARGIN further
+    out, so a foot hovering at the edge doesn't flicker the stair.
+
+    `groups` is a phasing.plan_groups() plan in stream channel numbers. The
+    firmware then converts the groups one at a time; with fewer than two
+    groups its sensors free-run.
+
+    Returns:
+        list: Encoded frames to write in order
+    """
+    on = int(PROX_K / trigger_distance ** 2)
+    off = int(PROX_K / (trigger_distance * RELEASE_MARGIN) ** 2)
+    layout = [(channel, stair, led_counts[stair]) for channel, stair in sorted(stair_mapping.items())
+              if stair is not None and stair in led_counts]
+    phases = [(channel, group) for group, channels in enumerate(groups) for channel in channels]
+    return [
+        encode_command(STREAM_CMD_TRIGGER, struct.pack("<HH", on, off), 1),
+        encode_command(STREAM_CMD_LAYOUT, b"".join(struct.pack("<BBH", *entry) for entry in layout), len(layout)),
+        encode_command(STREAM_CMD_EFFECT, bytes((*color, fade_in, fade_out, frame_ms)), 1),
+        encode_command(STREAM_CMD_PHASES, b"".join(struct.pack("<BB", *entry) for entry in phases), len(phases)),
+    ]
+
+
+def open_serial(path, baud=1000000):
+    """Open a tty raw and non-blocking. Returns the fd."""
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK | os.O_CLOEXEC)
+    tty.setraw(fd)
+    attrs = termios.tcgetattr(fd)
+    speed = getattr(termios, f"B{baud}", None)
+    if speed is not None:
+        attrs[4] = attrs[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+class StreamDecoder:
+    """Decodes the aggregator firmware's frame stream into a sample block.
+
+    Bytes are read in large chunks straight into a preallocated buffer. Each
+    frame is COBS-decoded in place, since decoding never makes it longer,
+    and its CRC is checked with binascii.crc_hqx, which is table-driven C.
+    Its samples are then written into `block`. The per-frame path allocates
+    no buffers.
+
+    `block` has the same layout as i2c_rdwr.SweepPlan's: SAMPLE_LEN bytes per
+    channel (STATUS, Ch0, Ch1, PDATA, little-endian), indexed here by global
+    channel. The stream carries no ALS data, so Ch0/Ch1 stay zero. valid[ch]
+    is 0 for a failed read. host_time[ch] is when the read happened, in host
+    monotonic seconds. After each sample frame, on_sweep(count) is called
+    and touched[:count] lists the channels it updated. Trigger edges from
+    the firmware's fast path arrive as on_edge(channel, state, host time).
+    The firmware's once-a-second timing report arrives as on_stats(sweeps,
+    frames, dropped, worst sweep us, worst frame us), and the latest is kept
+    in `stats`.
+
+    Use poll() as an EventLoop reader callback on fd.
+    """
+
+    def __init__(self, fd, on_sweep=None, on_info=None, on_edge=None, on_stats=None, channels=STREAM_MAX_CHANNELS):
+        self.fd = fd
+        self.on_sweep = on_sweep
+        self.on_info = on_info
+        self.on_edge = on_edge
+        self.on_stats = on_stats
+        self.stats = None
+        self.clock = ClockSync()
+
+        self.block = bytearray(channels * SAMPLE_LEN)
+        self.valid = bytearray(channels)
+        self.host_time = array("d", bytes(8 * channels))
+        self.touched = bytearray(channels)
+        self.muxes = {}
+
+        self._ring = bytearray(RING_SIZE)
+        self._view = memoryview(self._ring)
+        self._head = 0
+        self._tail = 0
+        self._last_seq = None
+
+        self.frames = 0
+        self.samples = 0
+        self.edges = 0
+        self.corrupt = 0
+        self.lost = 0
+        self.bytes = 0
+
+    def poll(self):
+        """Read everything available and decode every complete frame. Returns frames decoded."""
+        decoded = 0
+        while True:
+            if self._tail > RING_SIZE - READ_SIZE:
+                self._compact()
+            try:
+                n = os.readv(self.fd, [self._view[self._tail:self._tail + READ_SIZE]])
+            except BlockingIOError:
+                break
+            if n == 0:
+                break
+            now = time.monotonic()
+            self._tail += n
+            self.bytes += n
+            decoded += self._scan(now)
+            if n < READ_SIZE:
+                break
+        return decoded
+
+    def _compact(self):
+        pending = self._tail - self._head
+        if pending > MAX_ENCODED:
+            # No delimiter in sight: not our stream, or a broken frame
+            self.corrupt += 1
+            pending = 0
+            self._head = self._tail
+        self._ring[:pending] = self._view[self._head:self._tail]
+        self._head = 0
+        self._tail = pending
+
+    def _scan(self, now):
+        ring = self._ring
+        decoded = 0
+        while True:
+            end = ring.find(0, self._head, self._tail)
+            if end < 0:
+                break
+            start = self._head
+            self._head = end + 1
+            if end == start:
+                continue
+            length = self._cobs_decode(start, end)
+            if length < 0 or not self._frame(start, length, now):
+                # Library boot text ahead of the first frame is expected, not corruption
+                if self._last_seq is not None:
+                    self.corrupt += 1
+                continue
+            decoded += 1
+        if self._head == self._tail:
+            self._head = self._tail = 0
+        return decoded
+
+    def _cobs_decode(self, start, end):
+        """Decode ring[start:end] in place. Returns the decoded length, or -1."""
+        ring = self._ring
+        view = self._view
+        src = start
+        dst = start
+        while src < end:
+            code = ring[src]
+            block_end = src + code
+            if block_end > end:
+                return -1
+            n = code - 1
+            if n:
+                view[dst:dst + n] = view[src + 1:block_end]
+                dst += n
+            src = block_end
+            if code < 0xFF and src < end:
+                ring[dst] = 0
+                dst += 1
+        return dst - start
+
+    def _frame(self, start, length, now):
+        if length < STREAM_HEADER_LEN + 2:
+            return False
+        crc_at = start + length - 2
+        if binascii.crc_hqx(self._view[start:crc_at], 0xFFFF) != _u16.unpack_from(self._ring, crc_at)[0]:
+            return False
+        frame_type, seq, t_us, count = _header.unpack_from(self._ring, start)
+
+        if self._last_seq is not None:
+            self.lost += (seq - self._last_seq - 1) & 0xFFFF
+        self._last_seq = seq
+        self.frames += 1
+
+        if frame_type == STREAM_FRAME_INFO:
+            ring = self._ring
+            pos = start + STREAM_HEADER_LEN
+            self.muxes = {ring[pos + 2 * i]: ring[pos + 2 * i + 1] for i in range(count)}
+            if self.on_info:
+                self.on_info(self.muxes)
+            return True
+        if frame_type == STREAM_FRAME_EDGES:
+            if STREAM_HEADER_LEN + count * STREAM_EDGE_LEN + 2 != length:
+                return False
+            ring = self._ring
+            base = self.clock.to_host(self.clock.unwrap(t_us)) if self.clock.offset is not None else now
+            pos = start + STREAM_HEADER_LEN
+            for _ in range(count):
+                self.edges += 1
+                if self.on_edge:
+                    self.on_edge(ring[pos], ring[pos + 1], base + (ring[pos + 2] | ring[pos + 3] << 8) * 1e-6)
+                pos += STREAM_EDGE_LEN
+            return True
+        if frame_type == STREAM_FRAME_STATS:
+            if count != 1 or STREAM_HEADER_LEN + STREAM_STATS_LEN + 2 != length:
+                return False
+            self.stats = _stats.unpack_from(self._ring, start + STREAM_HEADER_LEN)
+            if self.on_stats:
+                self.on_stats(*self.stats)
+            return True
+        if frame_type != STREAM_FRAME_SAMPLES or STREAM_HEADER_LEN + count * STREAM_SAMPLE_LEN + 2 != length:
+            return False
+
+        clock = self.clock
+        mcu_s = clock.unwrap(t_us)
+        clock.observe(mcu_s, now)
+        base = clock.to_host(mcu_s)
+        scale = 1e-6 * (1.0 + clock.skew)
+
+        ring = self._ring
+        view = self._view
+        block = self.block
+        valid = self.valid
+        host_time = self.host_time
+        touched = self.touched
+        limit = len(valid)
+        pos = start + STREAM_HEADER_LEN
+        used = 0
+        for _ in range(count):
+            channel = ring[pos]
+            if channel < limit:
+                status = ring[pos + 1]
+                o = channel * SAMPLE_LEN
+                if status & STREAM_STATUS_ERROR:
+                    valid[channel] = 0
+                else:
+                    valid[channel] = 1
+                    block[o] = status
+                    view_o = o + 5
+                    block[view_o:view_o + 2] = view[pos + 2:pos + 4]
+                host_time[channel] = base + (ring[pos + 4] | ring[pos + 5] << 8) * scale
+                touched[used] = channel
+                used += 1
+            pos += STREAM_SAMPLE_LEN
+        self.samples += used
+        if self.on_sweep:
+            self.on_sweep(used)
+        return True
+
+    def send(self, frames):
+        """Write encoded command frames. The firmware acknowledges each with an info frame."""
+        for frame in frames:
+            os.write(self.fd, frame)
+
+    def sample(self, channel):
+        """(status, ch0, ch1, pdata) for one channel from the latest frame that held it."""
+        b = self.block
+        o = channel * SAMPLE_LEN
+        return b[o], b[o + 1] | b[o + 2] << 8, b[o + 3] | b[o + 4] << 8, b[o + 5] | b[o + 6] << 8
+
+
+def _run(decoder, duration):
+    """Decode for `duration` seconds. Returns decoder thread CPU seconds."""
+    import select
+
+    poller = select.poll()
+    poller.register(decoder.fd, select.POLLIN)
+    cpu = 0.0
+    end = time.monotonic() + duration
+    while time.monotonic() < end:
+        if poller.poll(100):
+            t0 = time.thread_time()
+            decoder.poll()
+            cpu += time.thread_time() - t0
+    return cpu
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode the aggregator firmware's sample stream")
+    parser.add_argument("--port", help="Serial device, e.g. /dev/ttyACM0 (default: run mcu_sim.py)")
+    parser.add_argument("--baud", type=int, default=1000000)
+    parser.add_argument("--duration", type=float, default=10.0, help="Seconds to decode")
+    parser.add_argument("--stairs", type=int, default=64, help="Simulated sensors without --port")
+    parser.add_argument("--drift-ppm", type=float, default=50.0, help="Simulated MCU clock error")
+    args = parser.parse_args()
+
+    proc = None
+    if args.port:
+        fd = open_serial(args.port, args.baud)
+    else:
+        import mcu_sim
+        program = mcu_sim.NATIVE_PROGRAM.format(env="native")
+        if not os.path.exists(program):
+            mcu_sim.build_native(program)
+        proc, _, fd, _ = mcu_sim.start(program, args.stairs, 20.0, args.drift_ppm)
+        os.set_blocking(fd, False)
+
+    decoder = StreamDecoder(fd)
+    try:
+        cpu = _run(decoder, args.duration)
+    finally:
+        if proc:
+            proc.kill()
+    rate = decoder.samples / args.duration
+    print(f"frames {decoder.frames}  samples {decoder.samples} ({rate:.0f}/s)  "
+          f"{decoder.bytes / args.duration / 1000:.0f} kB/s  corrupt {decoder.corrupt}  lost {decoder.lost}")
+    print(f"decoder CPU {cpu / args.duration * 100:.1f}% of one core "
+          f"({cpu / max(1, decoder.samples) * 1e6:.2f} us/sample)  "
+          f"clock drift {decoder.clock.drift_ppm:+.1f} ppm  muxes {len(decoder.muxes)}")
+    if decoder.stats:
+        sweeps, frames, dropped, sweep_us, frame_us = decoder.stats
+        print(f"firmware: sweep {sweeps} Hz (worst {sweep_us} us)  LED frames {frames} Hz (worst {frame_us} us)  "
+              f"dropped edges {dropped}")
+
+
+if __name__ == "__main__":
+    main()
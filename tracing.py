@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+
+import json
+import os
+import threading
+from array import array
+from time import perf_counter_ns
+
+# Trace points along the foot -> light -> sound path
+CONVERSION_COMPLETE = 1   # Sensor reports a finished measurement
+BURST_READ_DONE = 2       # Measurement data read off the bus
+FILTER_EDGE = 3           # Trigger state changed (arg: channel)
+COMPOSITOR_FRAME = 4      # LED frame composed (arg: stair)
+SHOW_START = 5            # strip.show() called
+SHOW_END = 6              # strip.show() returned
+AUDIO_SUBMIT = 7          # Sound handed to the mixer (arg: stair)
+
+POINT_NAMES = {
+    CONVERSION_COMPLETE: "conversion complete",
+    BURST_READ_DONE: "burst read done",
+    FILTER_EDGE: "filter edge",
+    COMPOSITOR_FRAME: "compositor frame",
+    SHOW_START: "show",
+    SHOW_END: "show",
+    AUDIO_SUBMIT: "audio submit",
+}
+
+RING_CAPACITY = 16384     # Events per thread, must be a power of two
+_FIELDS = 3               # timestamp ns, point, arg
+
+# Off by default: set from config, or flip at run time (main.py toggles it on SIGUSR2)
+enabled = False
+_local = threading.local()
+_rings = []
+_rings_lock = threading.Lock()
+
+
+class _Ring:
+    """Fixed-size event ring owned by a single thread.
+
+    Only the owning thread writes to it, so recording needs no lock; a dump
+    taken while the thread is running may see the one event being written.
+    """
+
+    __slots__ = ("tid", "name", "data", "pos")
+
+    def __init__(self):
+        thread = threading.current_thread()
+        self.tid = threading.get_native_id()
+        self.name = thread.name
+        self.data = array("q", bytes(8 * _FIELDS * RING_CAPACITY))
+        self.pos = 0
+
+
+def _new_ring():
+    ring = _Ring()
+    _local.ring = ring
+    with _rings_lock:
+        _rings.append(ring)
+    return ring
+
+
+def trace_point(point, arg=0):
+    """Record a trace point on the calling thread's ring.
+
+    Args:
+        point: One of the trace point constants
+        arg: Optional integer argument (channel, stair number, ...)
+    """
+    if not enabled:
+        return
+    try:
+        ring = _local.ring
+    except AttributeError:
+        ring = _new_ring()
+    pos = ring.pos
+    i = (pos & (RING_CAPACITY - 1)) * _FIELDS
+    data = ring.data
+    data[i] = perf_counter_ns()
+    data[i + 1] = point
+    data[i + 2] = arg
+    ring.pos = pos + 1
+
+
+def _ring_events(ring):
+    """Return the events currently held by a ring, oldest first."""
+    pos = ring.pos
+    count = min(pos, RING_CAPACITY)
+    data = ring.data
+    for n in range(pos - count, pos):
+        i = (n & (RING_CAPACITY - 1)) * _FIELDS
+        yield data[i], data[i + 1], data[i + 2]
+
+
+def dump_chrome_trace(path):
+    """Write all rings as Chrome trace_event JSON (load it in chrome://tracing or Perfetto).
+
+    Args:
+        path: Output file path
+
+    Returns:
+        int: Number of events written
+    """
+    pid = os.getpid()
+    with _rings_lock:
+        rings = list(_rings)
+
+    events = []
+    for ring in rings:
+        events.append({"name": "thread_name", "ph": "M", "pid": pid, "tid": ring.tid,
+                       "args": {"name": ring.name}})
+        for ts, point, arg in _ring_events(ring):
+            event = {"name": POINT_NAMES.get(point, str(point)), "pid": pid, "tid": ring.tid,
+                     "ts": ts / 1000.0}
+            if point == SHOW_START:
+                event["ph"] = "B"
+            elif point == SHOW_END:
+                event["ph"] = "E"
+            else:
+                event["ph"] = "i"
+                event["s"] = "t"
+                event["args"] = {"arg": arg}
+            events.append(event)
+
+    with open(path, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+    return len(events) - len(rings)
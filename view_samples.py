@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+
+import argparse
+import time
+
+from sample_log import SampleLogReader
+
+STALE_AFTER_US = 5_000_000  # Channels silent for longer than this are shown as disconnected
+
+
+def print_sensor_status_table(reader, active_sensors, sensor_states, current_distances):
+    """Print a formatted table of all sensor statuses."""
+    print("\033[2J\033[H")  # Clear screen and move cursor to top
+    print("Sensor Status Table:")
+    print("┌─────────────┬─────────────┬────────────┬──────────┬───────────┬──────────┐")
+    print("│ Multiplexer │   Channel   │ Connected  │ Distance │ Triggered │   Stair  │")
+    print("├─────────────┼─────────────┼────────────┼──────────┼───────────┼──────────┤")
+
+    # Create a list of channels with their stair numbers for sorting
+    channels_with_stairs = []
+    for channel in range(reader.num_channels):
+        mux_num = channel // 8 + 1
+        local_channel = channel % 8
+        is_active = channel in active_sensors
+        distance = current_distances.get(channel, None)
+        is_triggered = sensor_states.get(channel, False)
+        stair_num = reader.stair_mapping.get(channel, None)
+
+        # Add to list with stair number for sorting
+        channels_with_stairs.append((channel, mux_num, local_channel, is_active, distance, is_triggered, stair_num))
+
+    # Sort by stair number (descending), with None values at the end
+    channels_with_stairs.sort(key=lambda x: (x[6] is None, -x[6] if x[6] is not None else 0))
+
+    # Print sorted rows
+    for channel, mux_num, local_channel, is_active, distance, is_triggered, stair_num in channels_with_stairs:
+        status = "Yes" if is_active else "No "
+        distance_str = f"{distance:.1f}mm" if distance is not None else "---"
+        triggered_str = "Yes" if is_triggered else "No "
+        stair_str = str(stair_num) if stair_num is not None else "---"
+
+        print(f"│     {mux_num}       │     {local_channel}       │    {status}    │ {distance_str:>8} │    {triggered_str}    │   {stair_str:>4}   │")
+
+    print("└─────────────┴─────────────┴────────────┴──────────┴───────────┴──────────┘")
+    print(f"\nTrigger threshold: {reader.trigger_distance:.1f}mm")
+
+
+def state_at(reader, t_us=None):
+    """Replay the log up to t_us and return the sensor state at that moment.
+
+    Args:
+        reader: SampleLogReader
+        t_us: Time in microseconds since log start, or None for the end of the log
+
+    Returns:
+        tuple: (time reached, active_sensors, sensor_states, current_distances)
+    """
+    first_block = 0
+    if t_us is not None:
+        first_block = reader.find_block(max(0, t_us - STALE_AFTER_US))
+
+    last_seen = {}
+    sensor_states = {}
+    current_distances = {}
+    now_us = 0
+    for sample_us, channel, distance, triggered in reader.samples(first_block):
+        if t_us is not None and sample_us > t_us:
+            break
+        now_us = sample_us
+        last_seen[channel] = sample_us
+        current_distances[channel] = distance
+        sensor_states[channel] = triggered
+
+    active_sensors = [channel for channel, seen in last_seen.items()
+                      if current_distances[channel] is not None and now_us - seen <= STALE_AFTER_US]
+    return now_us, active_sensors, sensor_states, current_distances
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Render the sensor status table from a sample log")
+    parser.add_argument("log", nargs="?", default="logs/samples.bin", help="Sample log path")
+    parser.add_argument("--at", type=float, default=None,
+                        help="Seconds since log start to show (default: end of log)")
+    parser.add_argument("--follow", action="store_true", help="Redraw every second until Ctrl+C")
+    args = parser.parse_args()
+
+    t_us = None if args.at is None else int(args.at * 1_000_000)
+    try:
+        while True:
+            reader = SampleLogReader(args.log)
+            now_us, active_sensors, sensor_states, current_distances = state_at(reader, t_us)
+            print_sensor_status_table(reader, active_sensors, sensor_states, current_distances)
+            wall = time.localtime((reader.start_epoch_us + now_us) / 1_000_000)
+            print(f"At {time.strftime('%Y-%m-%d %H:%M:%S', wall)} ({now_us / 1_000_000:.1f}s into log)")
+            if not args.follow:
+                break
+            time.sleep(1)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -4,14 +4,27 @@ import busio
 import adafruit_vl53l0x
 from adafruit_tca9548a import TCA9548A
 import errno
+from mux_topology import MuxRoute, MuxTopology
+from realtime import clock_nanosleep_until
+from tracing import trace_point, CONVERSION_COMPLETE, BURST_READ_DONE
+
+READ_TIMEOUT_NS = 100_000_000       # Give up on a single-shot measurement after 100ms
+DATA_READY_POLL_NS = 500_000        # Once the timing budget has passed, re-check data ready this often
 
 class VL53L0XMultiplexer:
-    def __init__(self, i2c_bus=None, tca_addresses=[0x70, 0x77]):
+    def __init__(self, i2c_bus=None, tca_addresses=[0x70, 0x77], cascades=None):
         """Initialize the VL53L0X multiplexer.
-        
+
+        Global channels 0 to 8 * len(tca_addresses) - 1 are the channels of the
+        muxes on the bus, as before. Each cascaded mux adds 8 more channels
+        after those, in the order given. A channel with muxes behind it holds
+        no sensor itself.
+
         Args:
             i2c_bus: Optional I2C bus instance. If None, will create one using board.SCL/SDA
             tca_addresses: List of I2C addresses for TCA9548A multiplexers (default: [0x70, 0x77])
+            cascades: Optional dict of parent route -> addresses of the muxes behind
+                that channel, e.g. {"0x70:3": [0x74, 0x75], "0x70:3/0x74:0": [0x71]}
         """
         # Create I2C bus if not provided
         self.i2c = i2c_bus if i2c_bus else busio.I2C(board.SCL, board.SDA)
@@ -52,90 +65,137 @@ class VL53L0XMultiplexer:
         
         if self.working_multiplexers == 0:
             raise RuntimeError("No multiplexers could be initialized. Please check connections.")
-        
-        # Lists to store sensor objects and status (16 channels total, 8 per multiplexer)
-        self.sensors = [None] * (8 * len(self.tcas))
-        self.initialized = [False] * (8 * len(self.tcas))
-        
+
+        # Full mux path of every channel that can hold a sensor; the topology
+        # tracks what each mux has selected so a read only writes what changed
+        self.routes = {}
+        for mux_idx, (addr, tca) in enumerate(self.tcas):
+            if tca is not None:
+                for local_channel in range(8):
+                    self.routes[8 * mux_idx + local_channel] = MuxRoute(((addr, local_channel),))
+        self.topology = MuxTopology(self.routes.values())
+        self._add_cascades(cascades or {})
+        self.num_channels = 8 * (len(self.tcas) + sum(len(addrs) for addrs in (cascades or {}).values()))
+
+        # Lists to store sensor objects and status, indexed by global channel
+        self.sensors = [None] * self.num_channels
+        self.initialized = [False] * self.num_channels
+
+        # Settings from each channel's first successful init, reapplied on re-init
+        self.calibration = {}
+
+        # Exception behind the most recent failed read per channel, for health scoring
+        self.last_error = {}
+
         # Disable all channels initially
         self._disable_all_channels()
         
-    def _get_multiplexer_and_channel(self, global_channel):
-        """Convert global channel number to multiplexer and local channel.
-        
-        Args:
-            global_channel: Channel number (0-15)
-            
-        Returns:
-            tuple: (multiplexer_index, local_channel) or (None, None) if invalid
+    def _add_cascades(self, cascades):
+        """Probe each cascaded mux and add its channels after the bus-level ones.
+
+        A channel that leads to a mux stops being a sensor channel. A cascaded
+        mux that doesn't answer keeps its channel numbers, but they have no route.
         """
-        if not 0 <= global_channel < (8 * len(self.tcas)):
-            return None, None
-        return divmod(global_channel, 8)
-        
+        next_channel = 8 * len(self.tcas)
+        for parent, addrs in cascades.items():
+            parent = MuxRoute.of(parent)
+            reachable = parent[-1][0] in self.topology.segments.get(parent[:-1], ())
+            for addr in addrs:
+                base = next_channel
+                next_channel += 8
+                if not reachable:
+                    print(f"Multiplexer at {parent}/0x{addr:02x} is behind a missing multiplexer. Skipping.")
+                    continue
+                try:
+                    self._write_selects(self.topology.select(parent))
+                    self.i2c.writeto(addr, bytes([0]))
+                except OSError:
+                    print(f"Multiplexer not found at {parent}/0x{addr:02x}. Skipping.")
+                    continue
+                for local_channel in range(8):
+                    route = self.topology.add(MuxRoute(parent + ((addr, local_channel),)))
+                    self.routes[base + local_channel] = route
+                self.topology.state[(parent, addr)] = 0
+                for channel, route in list(self.routes.items()):
+                    if route == parent:
+                        del self.routes[channel]
+                print(f"Successfully initialized multiplexer at {parent}/0x{addr:02x}")
+
+    def route(self, global_channel):
+        """MuxRoute to a channel, or None if no working mux path reaches it."""
+        return self.routes.get(global_channel)
+
+    def channels(self):
+        """Every routable channel, in depth-first order: the sweep order with the fewest mux writes."""
+        return sorted(self.routes, key=self.routes.__getitem__)
+
+    def _write_selects(self, writes):
+        try:
+            for addr, value in writes:
+                self.i2c.writeto(addr, bytes([value]))
+        except OSError:
+            # Some write may or may not have landed; rewrite the whole path next time
+            self.topology.invalidate()
+            raise
+
     def _disable_all_channels(self):
         """Disable all multiplexer channels."""
         # Writing 0 disables all channels
         for addr, tca in self.tcas:
             if tca is not None:  # Only try to disable channels on working multiplexers
                 self.i2c.writeto(addr, bytes([0]))
-        time.sleep(0.01)  # Reduced from 0.1s to 0.01s
-        
+        self.topology.invalidate()
+
     def _select_channel(self, global_channel):
-        """Select a specific channel and disable all others.
-        
+        """Connect a channel, writing only the muxes whose selection has to change.
+
+        A TCA9548A switches at the STOP of the write, so no settle delay is needed.
+
         Args:
-            global_channel: Global channel number (0-15)
+            global_channel: Global channel number
         """
-        mux_idx, local_channel = self._get_multiplexer_and_channel(global_channel)
-        if mux_idx is None:
-            return False
-            
-        # Check if the multiplexer is working
-        if self.tcas[mux_idx][1] is None:
-            print(f"Cannot select channel {global_channel} - multiplexer at 0x{self.tcas[mux_idx][0]:02x} is not working")
+        route = self.routes.get(global_channel)
+        if route is None:
+            print(f"Cannot select channel {global_channel} - no working multiplexer route to it")
             return False
-            
-        # First disable all channels on all multiplexers
-        self._disable_all_channels()
-        
-        # Then enable the selected channel on the correct multiplexer
-        addr = self.tcas[mux_idx][0]
-        self.i2c.writeto(addr, bytes([1 << local_channel]))
-        time.sleep(0.01)  # Reduced from 0.1s to 0.01s
+        self._write_selects(self.topology.select(route))
         return True
-            
+
     def init_sensor(self, global_channel):
         """Initialize a VL53L0X sensor on the specified channel.
         
         Args:
-            global_channel: Global channel number (0-15)
+            global_channel: Global channel number
             
         Returns:
             bool: True if initialization successful, False otherwise
         """
-        mux_idx, local_channel = self._get_multiplexer_and_channel(global_channel)
-        if mux_idx is None:
+        if not 0 <= global_channel < self.num_channels:
             print(f"Invalid channel number: {global_channel}")
             return False
-            
-        # Check if the multiplexer is working
-        if self.tcas[mux_idx][1] is None:
-            print(f"Cannot initialize sensor on channel {global_channel} - multiplexer at 0x{self.tcas[mux_idx][0]:02x} is not working")
-            return False
-            
+
         try:
             # Select the channel
             if not self._select_channel(global_channel):
                 return False
-            
-            # Initialize VL53L0X on this channel
-            i2c_channel = self.tcas[mux_idx][1][local_channel]
-            sensor = adafruit_vl53l0x.VL53L0X(i2c_channel)
-            
-            # Configure for faster readings
-            sensor.measurement_timing_budget = 20000  # Reduced from 33000 to 20000 (20ms)
-            
+
+            # Initialize VL53L0X on the bus itself: every access selects its route
+            # first, so the sensor needs no mux channel object of its own
+            sensor = adafruit_vl53l0x.VL53L0X(self.i2c)
+
+            calibration = self.calibration.get(global_channel)
+            if calibration is None:
+                # Configure for faster readings
+                sensor.measurement_timing_budget = 20000  # Reduced from 33000 to 20000 (20ms)
+                self.calibration[global_channel] = {
+                    "measurement_timing_budget": sensor.measurement_timing_budget,
+                    "signal_rate_limit": sensor.signal_rate_limit,
+                }
+            else:
+                # Coming back after a dropout: restore what this sensor ran with before
+                for name, value in calibration.items():
+                    setattr(sensor, name, value)
+
             # Store sensor object
             self.sensors[global_channel] = sensor
             self.initialized[global_channel] = True
@@ -148,28 +208,121 @@ class VL53L0XMultiplexer:
             self.initialized[global_channel] = False
             return False
             
+    def probe_channel(self, global_channel, sensor_addr=0x29):
+        """Check whether a sensor acknowledges on a channel, without initializing it.
+
+        Costs two short bus transactions and no settle delays, so it fits in
+        the gap between sweep reads.
+
+        Args:
+            global_channel: Global channel number
+            sensor_addr: I2C address of the sensor behind the mux
+
+        Returns:
+            bool: True if something acknowledged sensor_addr on that channel
+        """
+        try:
+            if not self._route(global_channel):
+                return False
+            self.i2c.writeto(sensor_addr, b"")
+            return True
+        except OSError:
+            return False
+
+    def read_model_id(self, global_channel, sensor_addr=0x29, register=0xC0):
+        """Read a sensor's identification register (VL53L0X model ID, 0xEE).
+
+        Args:
+            global_channel: Global channel number
+            sensor_addr: I2C address of the sensor behind the mux
+            register: ID register to read
+
+        Returns:
+            int: Register value, or None if the sensor didn't answer
+        """
+        try:
+            if not self._route(global_channel):
+                return None
+            value = bytearray(1)
+            self.i2c.writeto_then_readfrom(sensor_addr, bytes([register]), value)
+            return value[0]
+        except OSError:
+            return None
+
+    def _route(self, global_channel):
+        """Select a channel without logging a missing route (raises OSError)."""
+        route = self.routes.get(global_channel)
+        if route is None:
+            return False
+        self._write_selects(self.topology.select(route))
+        return True
+
     def read_range(self, global_channel):
         """Read the range from a sensor.
         
         Args:
-            global_channel: Global channel number (0-15)
+            global_channel: Global channel number
             
         Returns:
             int: Range in millimeters, or None if error
         """
-        if not 0 <= global_channel < (8 * len(self.tcas)) or not self.initialized[global_channel]:
+        if not 0 <= global_channel < self.num_channels or not self.initialized[global_channel]:
             return None
             
         try:
             # Select the channel before reading
             if not self._select_channel(global_channel):
                 return None
-                
-            return self.sensors[global_channel].range
+
+            sensor = self.sensors[global_channel]
+            if getattr(sensor, "is_continuous_mode", False):
+                # Continuous mode: the data-ready interrupt already fired, just read and clear it
+                trace_point(CONVERSION_COMPLETE, global_channel)
+                distance = sensor.read_range()
+            elif hasattr(sensor, "do_range_measurement"):
+                # Split the single-shot measurement so conversion and read can be traced
+                sensor.do_range_measurement()
+                start_ns = time.monotonic_ns()
+                # Sleep through the conversion rather than spin on data_ready: under
+                # SCHED_FIFO a spin starves every lower-priority thread on this core
+                budget_us = self.calibration.get(global_channel, {}).get("measurement_timing_budget", 0)
+                clock_nanosleep_until(start_ns + budget_us * 1000)
+                while not sensor.data_ready:
+                    now_ns = time.monotonic_ns()
+                    if now_ns - start_ns > READ_TIMEOUT_NS:
+                        raise RuntimeError("Timeout waiting for VL53L0X!")
+                    clock_nanosleep_until(now_ns + DATA_READY_POLL_NS)
+                trace_point(CONVERSION_COMPLETE, global_channel)
+                distance = sensor.read_range()
+            else:
+                distance = sensor.range
+            trace_point(BURST_READ_DONE, global_channel)
+            return distance
         except Exception as e:
             print(f"Error reading sensor on channel {global_channel}: {str(e)}")
+            self.last_error[global_channel] = e
             return None
             
+    def start_continuous(self, global_channel):
+        """Put a sensor in continuous ranging mode so its GPIO1 pin signals each new sample.
+
+        Args:
+            global_channel: Global channel number
+
+        Returns:
+            bool: True if continuous mode was started, False otherwise
+        """
+        if not 0 <= global_channel < self.num_channels or not self.initialized[global_channel]:
+            return False
+        try:
+            if not self._select_channel(global_channel):
+                return False
+            self.sensors[global_channel].start_continuous()
+            return True
+        except Exception as e:
+            print(f"Failed to start continuous mode on channel {global_channel}: {str(e)}")
+            return False
+
     def read_all_ranges(self):
         """Read ranges from all initialized sensors.
         
@@ -177,7 +330,7 @@ class VL53L0XMultiplexer:
             dict: Dictionary mapping channel numbers to ranges (in mm)
         """
         ranges = {}
-        for channel in range(8 * len(self.tcas)):
+        for channel in self.channels():
             if self.initialized[channel]:
                 range_mm = self.read_range(channel)
                 if range_mm is not None: